@@ -5,10 +5,13 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#include <stdbool.h>
 #include "hvc_response.h"
-
-// TODO should be configurable
-#define HVC_UART_NUM 2
+#include "hvc_command.h"
+#include "hvc_image.h"
+#include "hvc_log.h"
+#include "hvc_metrics.h"
+#include "hvc_trace.h"
 
 /*
  * Function sync code, all functions must return this
@@ -71,61 +74,460 @@ extern "C" {
 #define HVC_CMD_GET_DETECTION_SIZE    0x08
 #define HVC_CMD_SET_FACE_ANGLE        0x09
 #define HVC_CMD_GET_FACE_ANGLE        0x0A
+#define HVC_CMD_SET_BAUDRATE          0x0E
+#define HVC_CMD_REGISTER_DATA         0x10
+#define HVC_CMD_DELETE_DATA           0x11
+#define HVC_CMD_DELETE_USER           0x12
+#define HVC_CMD_DELETE_ALL_DATA       0x13
+#define HVC_CMD_GET_USER_DATA         0x15
+#define HVC_CMD_SAVE_ALBUM            0x20
+#define HVC_CMD_LOAD_ALBUM            0x21
+#define HVC_CMD_WRITE_ALBUM           0x22
+#define HVC_CMD_REFORMAT_FLASH        0x30
+
+/*
+ * List of supported UART rates. The HVC always powers up at 9600.
+ */
+#define HVC_BAUD_9600    0x00
+#define HVC_BAUD_38400   0x01
+#define HVC_BAUD_115200  0x02
+#define HVC_BAUD_230400  0x03
+#define HVC_BAUD_460800  0x04
+#define HVC_BAUD_921600  0x05
+#define HVC_BAUD_COUNT   6
+
+/*
+ * Time the HVC needs to switch rates after acknowledging the change
+ */
+#define HVC_BAUDRATE_SETTLE_MS 10
+
+/*
+ * Face recognition album. Every user holds up to HVC_ALBUM_MAX_DATA
+ * registered faces, the album is an opaque blob of HVC_ALBUM_SIZE_MIN to
+ * HVC_ALBUM_SIZE_MAX bytes that is moved in HVC_ALBUM_CHUNK byte chunks.
+ * Album commands get HVC_ALBUM_TIMEOUT ms on top of the retry period,
+ * the HVC detects a face or writes its flash before it answers.
+ */
+#define HVC_ALBUM_MAX_USERS 100
+#define HVC_ALBUM_MAX_DATA  10
+#define HVC_ALBUM_SIZE_MIN  32
+#define HVC_ALBUM_SIZE_MAX  816032
+#define HVC_ALBUM_CHUNK     1024
+#define HVC_ALBUM_TIMEOUT   5000
 
 /*
- * Retry definitions
+ * Settings handled by hvc_apply_config
+ */
+#define HVC_CONFIG_CAMERA_ANGLE    0x01
+#define HVC_CONFIG_THRESHOLDS      0x02
+#define HVC_CONFIG_DETECTION_SIZE  0x04
+#define HVC_CONFIG_FACE_ANGLE      0x08
+#define HVC_CONFIG_ALL             0x0F
+
+/*
+ * Status codes returned by the caller-owned (_r) API
+ */
+#define HVC_OK              0
+#define HVC_ERR_TIMEOUT     -1
+#define HVC_ERR_SYNC        -2
+#define HVC_ERR_RESPONSE    -3
+#define HVC_ERR_SHORT_READ  -4
+#define HVC_ERR_PAYLOAD     -5
+#define HVC_ERR_ARGS        -6
+#define HVC_ERR_SINK        -7
+#define HVC_ERR_BUSY        -8
+#define HVC_ERR_WRITE       -9
+#define HVC_ERR_CANCELLED   -10
+
+/*
+ * Retry definitions. Every retry extends the response deadline
+ * by HVC_READ_RETRY_SLEEP milliseconds.
  */
 #define HVC_READ_RETRY_SLEEP    1000
 #define HVC_DEFAULT_READ_RETRY  5
 
 /*
- * Image settings
+ * Response framing. The caller is woken once the header has arrived
+ * and again once the payload has arrived (or HVC_RESPONSE_WAIT_MAX
+ * bytes of it, larger payloads such as images are streamed).
+ */
+#define HVC_HEADER_SIZE         6
+#define HVC_RESPONSE_TIMEOUT    100
+#define HVC_RESPONSE_WAIT_MAX   2048
+
+/*
+ * Resynchronisation. A header that can't answer the command in flight
+ * is line noise or a stale response, the parser skips to the next sync
+ * code and gives up after HVC_RESYNC_MAX discarded bytes.
  */
+#define HVC_RESYNC_MAX          4096
+
+/*
+ * Worst case transfer time per byte, in microseconds, at 9600 baud.
+ * Used to extend the payload deadline for long responses.
+ */
+#define HVC_BYTE_TIMEOUT_US     1100
+
+/*
+ * Deadline of a transport read of length bytes, the gap allowed within
+ * a response plus the worst case transfer time
+ */
+#define HVC_READ_TIMEOUT(length) (HVC_RESPONSE_TIMEOUT + (int) (((int64_t) (length) * HVC_BYTE_TIMEOUT_US) / 1000))
+
+/*
+ * Image settings. Images are streamed to the image sink in chunks of
+ * at most HVC_IMAGE_READ_BUFFER bytes. A sink that accepts nothing is
+ * retried HVC_IMAGE_SINK_RETRY times, HVC_IMAGE_SINK_SLEEP ms apart.
+ */
+#define HVC_IMAGE_HEADER_SIZE 4
 #define HVC_IMAGE_READ_BUFFER 400
-#define HVC_IMAGE_READ_SLEEP_MS 10
+#define HVC_IMAGE_SINK_RETRY  10
+#define HVC_IMAGE_SINK_SLEEP  5
+
+/*
+ * Largest image an execution returns (QVGA) and the face image returned
+ * when registering album data, both including the image header.
+ */
+#define HVC_IMAGE_MAX_SIZE      (HVC_IMAGE_HEADER_SIZE + 320 * 240)
+#define HVC_REGISTER_IMAGE_SIZE (HVC_IMAGE_HEADER_SIZE + 64 * 64)
+
+/*
+ * Payload sizes of the fixed size responses
+ */
+#define HVC_VERSION_SIZE          19
+#define HVC_CAMERA_ANGLE_SIZE     1
+#define HVC_THRESHOLDS_SIZE       8
+#define HVC_DETECTION_LIMITS_SIZE 12
+#define HVC_FACE_ANGLE_SIZE       2
+#define HVC_USER_DATA_SIZE        2
+
+/*
+ * Execution response layout. Body and hand records are fixed size, face
+ * records grow with every estimation requested.
+ */
+#define HVC_EXECUTION_HEADER_SIZE 4
+#define HVC_DETECTION_SIZE        8
+#define HVC_FACE_DIRECTION_SIZE   8
+#define HVC_FACE_AGE_SIZE         3
+#define HVC_FACE_GENDER_SIZE      3
+#define HVC_FACE_GAZE_SIZE        2
+#define HVC_FACE_BLINK_SIZE       4
+#define HVC_FACE_EXPRESSION_SIZE  6
+#define HVC_FACE_RECOGNITION_SIZE 4
 
 /*
- * Temporary buffers and definitions
+ * Temporary buffers and definitions. The receive buffer fits the
+ * largest possible execution result (35 bodies, hands and faces with
+ * every estimation enabled).
  */
 #define SEND_BUFFER_SIZE    32
+#define RECV_BUFFER_SIZE    2048
 #define CMD_SIZE            4
 
+/*
+ * Transport callbacks, implemented by every port. ctx is handed back
+ * unchanged so one port can drive several sensors.
+ *
+ * read         read length bytes, waiting at most timeout_ms for them.
+ *              The library waits for a response first and then reads
+ *              whole payloads in a single call, the timeout covers
+ *              their transfer.
+ * write        write length bytes, returns the number written
+ * available    bytes ready to be read without blocking
+ * wait         block until length bytes are available or timeout_ms
+ *              passed, returns the bytes available
+ * sleep        pause the calling task
+ * set_baudrate move the host side of the link to another rate, may be
+ *              NULL if the link has no rate
+ * clock        monotonic time in microseconds, may be NULL, round trip
+ *              times are not measured then
+ */
+struct hvc_transport
+{
+  int (*read)(void* ctx, char* data, int length, int timeout_ms);
+  int (*write)(void* ctx, const char* data, int length);
+  int (*available)(void* ctx);
+  int (*wait)(void* ctx, int length, int timeout_ms);
+  void (*sleep)(void* ctx, int ms);
+  bool (*set_baudrate)(void* ctx, int baudrate);
+  int64_t (*clock)(void* ctx);
+  void* ctx;
+};
+
+/*
+ * A single HVC. Every sensor gets its own device, the library keeps no
+ * global state so devices can be driven from different tasks.
+ */
+struct hvc_device
+{
+  struct hvc_transport transport;
+  int read_retry;
+  int last_response_length;
+  struct hvc_image_sink* image_sink;
+
+  // Command in flight and when it was sent, for the round trip metrics
+  int command;
+  int64_t command_start;
+  struct hvc_metrics metrics;
+
+  // Optional binary trace, NULL when disabled
+  struct hvc_trace* trace;
+
+  // Reusable receive buffer for bulk reads
+  char recv_buffer[RECV_BUFFER_SIZE];
+};
+
+void hvc_device_init(struct hvc_device* dev, const struct hvc_transport* transport);
+
+/*
+ * Transport helpers, dispatch to the device's transport
+ */
+int hvc_read_bytes(struct hvc_device* dev, char* data, int length);
+
+int hvc_write_bytes(struct hvc_device* dev, char* data, int length);
+
+int hvc_read_bytes_available(struct hvc_device* dev);
+
+int hvc_wait_bytes_available(struct hvc_device* dev, int length, int timeout_ms);
+
+void hvc_sleep(struct hvc_device* dev, int ms);
+
+bool hvc_set_host_baudrate(struct hvc_device* dev, int baudrate);
+
+void hvc_set_retry(struct hvc_device* dev, int retry);
+
+/*
+ * Counters and round trip histograms, reset with hvc_metrics_reset
+ */
+struct hvc_metrics* hvc_get_metrics(struct hvc_device* dev);
+
+/*
+ * Monotonic time in microseconds from the transport, -1 without a clock
+ */
+int64_t hvc_clock(struct hvc_device* dev);
+
+/*
+ * Record the completion of the command in flight
+ */
+void hvc_command_done(struct hvc_device* dev, int status);
+
+/*
+ * Count a recovery from line noise that discarded bytes
+ */
+void hvc_count_resync(struct hvc_device* dev, int discarded);
+
+/*
+ * Record HVC_TRACE_* events of the device into trace, NULL disables
+ * tracing again
+ */
+void hvc_set_trace(struct hvc_device* dev, struct hvc_trace* trace);
+
+/*
+ * Record an event if tracing is enabled, stamped with the transport clock
+ */
+void hvc_trace_event(struct hvc_device* dev, int event, int arg0, int arg1);
+
+/*
+ * Register the sink that receives images requested through the
+ * HVC_EX_IMAGE_* execution options. Pass NULL to discard images.
+ */
+void hvc_set_image_sink(struct hvc_device* dev, struct hvc_image_sink* sink);
+
+struct hvc_image_sink* hvc_get_image_sink(struct hvc_device* dev);
+
+/*
+ * Validate a response header against the command it answers and store
+ * the payload length in length. Returns HVC_OK, HVC_ERR_RESPONSE for a
+ * well formed error response or HVC_ERR_SYNC if the bytes can't be a
+ * response to cmd. cmd -1 accepts any length.
+ */
+int hvc_check_header(const char* header, int cmd, int* length);
+
+/*
+ * Offset of the next possible header start within length bytes, never 0
+ */
+int hvc_resync_offset(const char* data, int length);
+
+/*
+ * Discard whatever the transport has buffered, returns the number of
+ * bytes dropped. Stale bytes are flushed before every command.
+ */
+int hvc_flush(struct hvc_device* dev);
+
+/*
+ * Frame and write a command without waiting for the response
+ */
+int hvc_send_command(struct hvc_device* dev, char cmd, int data_size, const char* data);
+
+/*
+ * Run any command through its descriptor (see hvc_command.h): encode
+ * request, wait for the response and decode its payload into response.
+ * request and response may be NULL for commands without arguments or
+ * without a decoder.
+ */
+int hvc_command_run(struct hvc_device* dev, int cmd, const void* request, void* response);
+
+/*
+ * Getters come in two flavours. The plain version allocates the response,
+ * which the caller must free, and returns NULL on failure. The _r version
+ * fills a caller owned response and returns an HVC_OK/HVC_ERR_* status.
+ */
+struct hvc_get_version_response* hvc_get_version(struct hvc_device* dev);
+
+int hvc_get_version_r(struct hvc_device* dev, struct hvc_get_version_response* res);
+
+bool hvc_set_camera_angle(struct hvc_device* dev, char angle);
+
+struct hvc_get_camera_angle_response* hvc_get_camera_angle(struct hvc_device* dev);
+
+int hvc_get_camera_angle_r(struct hvc_device* dev, struct hvc_get_camera_angle_response* res);
+
+bool hvc_set_threshold_values(struct hvc_device* dev, int body, int hand, int face, int recognition);
+
+struct hvc_get_threshold_values_response* hvc_get_threshold_values(struct hvc_device* dev);
+
+int hvc_get_threshold_values_r(struct hvc_device* dev, struct hvc_get_threshold_values_response* res);
+
+bool hvc_set_detection_size(struct hvc_device* dev, int min_body, int max_body, int min_hand, int max_hand, int min_face, int max_face);
+
+struct hvc_get_detection_size_response* hvc_get_detection_size(struct hvc_device* dev);
+
+int hvc_get_detection_size_r(struct hvc_device* dev, struct hvc_get_detection_size_response* res);
+
+bool hvc_set_face_angle(struct hvc_device* dev, char yaw, char roll);
+
+struct hvc_get_face_angle_response* hvc_get_face_angle(struct hvc_device* dev);
+
+int hvc_get_face_angle_r(struct hvc_device* dev, struct hvc_get_face_angle_response* res);
+
+/*
+ * Every persistent setting of the HVC
+ */
+struct hvc_config
+{
+  struct hvc_get_camera_angle_response camera_angle;
+  struct hvc_get_threshold_values_response thresholds;
+  struct hvc_get_detection_size_response detection_size;
+  struct hvc_get_face_angle_response face_angle;
+};
 
-extern int hvc_read_retry;
+/*
+ * Read every setting in one burst of commands
+ */
+int hvc_get_config_r(struct hvc_device* dev, struct hvc_config* res);
 
-void hvc_log_debug(const char* format, ...);
+/*
+ * Bring the HVC to config, only writing the settings that differ from
+ * what it reports. Every write is attempted up to retries + 1 times.
+ * Returns the HVC_CONFIG_* settings written or HVC_ERR_RESPONSE if one
+ * could not be written.
+ */
+int hvc_apply_config(struct hvc_device* dev, const struct hvc_config* config, int retries);
 
-void hvc_log_info(const char* format, ...);
+/*
+ * Write every setting in one burst without reading them first, for an
+ * HVC that just powered up with its defaults. Falls back to
+ * hvc_apply_config if the burst fails, returns like it.
+ */
+int hvc_restore_config(struct hvc_device* dev, const struct hvc_config* config, int retries);
 
-void hvc_log_error(const char* format, ...);
+/*
+ * Switch the HVC to one of the HVC_BAUD_* rates. The HVC acknowledges at
+ * the current rate, the host has to follow with hvc_set_host_baudrate.
+ */
+bool hvc_set_baudrate(struct hvc_device* dev, int rate);
 
-int hvc_read_bytes(char* data, int length);
+/*
+ * Baudrate in bits per second for a HVC_BAUD_* rate, or 0
+ */
+int hvc_baudrate_value(int rate);
 
-int hvc_write_bytes(char* data, int length);
+/*
+ * Find the rate the HVC currently talks at, then move both ends to the
+ * fastest rate up to max_baudrate that passes a version check. Falls back
+ * to slower rates on failure. Returns the final baudrate, HVC_ERR_TIMEOUT
+ * if the HVC could not be reached at all, HVC_ERR_RESPONSE if it can't be
+ * moved down to max_baudrate or HVC_ERR_ARGS if max_baudrate is below the
+ * slowest rate.
+ */
+int hvc_negotiate_baudrate(struct hvc_device* dev, int max_baudrate);
 
-int hvc_read_bytes_available();
+struct hvc_execution_response* hvc_execution(struct hvc_device* dev, int function, int image);
 
-void hvc_set_retry(int retry);
+/*
+ * Run a detection, streaming the image (if any) to the image sink. The
+ * image status is returned once the detections are decoded, so with
+ * HVC_ERR_SINK or an image HVC_ERR_SHORT_READ res is still filled in.
+ */
+int hvc_execution_r(struct hvc_device* dev, int function, int image, struct hvc_execution_response* res);
 
-struct hvc_get_version_response* hvc_get_version();
+/*
+ * Album stream callback, moves album data between the HVC and host
+ * storage. When saving it receives length bytes and returns length, when
+ * loading it fills up to length bytes and returns the number filled.
+ * A negative value, or more than length, aborts the transfer.
+ */
+typedef int (*hvc_album_cb)(void* ctx, char* data, int length);
 
-bool hvc_set_camera_angle(char angle);
+/*
+ * Register the face in front of the camera as data_id of user_id. The
+ * 64x64 face image the HVC answers with goes to the image sink. Album
+ * commands return an HVC_OK/HVC_ERR_* status.
+ */
+int hvc_register_data(struct hvc_device* dev, int user_id, int data_id);
 
-struct hvc_get_camera_angle_response* hvc_get_camera_angle();
+int hvc_delete_data(struct hvc_device* dev, int user_id, int data_id);
 
-bool hvc_set_threshold_values(int body, int hand, int face, int recognition);
+int hvc_delete_user(struct hvc_device* dev, int user_id);
 
-struct hvc_get_threshold_values_response* hvc_get_threshold_values();
+int hvc_delete_all_data(struct hvc_device* dev);
 
-bool hvc_set_detection_size(int min_body, int max_body, int min_hand, int max_hand, int min_face, int max_face);
+struct hvc_get_user_data_response* hvc_get_user_data(struct hvc_device* dev, int user_id);
 
-struct hvc_get_detection_size_response* hvc_get_detection_size();
+int hvc_get_user_data_r(struct hvc_device* dev, int user_id, struct hvc_get_user_data_response* res);
 
-bool hvc_set_face_angle(char yaw, char roll);
+/*
+ * Stream the album out of the HVC to write, returns the album size or
+ * an HVC_ERR_* status.
+ */
+int hvc_save_album(struct hvc_device* dev, hvc_album_cb write, void* ctx);
+
+/*
+ * Stream size bytes pulled from read into the HVC, replacing its album.
+ * The album only survives a power cycle after hvc_write_album.
+ */
+int hvc_load_album(struct hvc_device* dev, int size, hvc_album_cb read, void* ctx);
+
+/*
+ * Persist the album to the HVC's flash
+ */
+int hvc_write_album(struct hvc_device* dev);
+
+int hvc_reformat_flash(struct hvc_device* dev);
+
+/*
+ * Response parsers, decode a payload that has already been received.
+ * Used by the asynchronous engine (see hvc_async.h).
+ */
+int hvc_parse_version(const char* payload, int length, struct hvc_get_version_response* res);
+
+int hvc_parse_camera_angle(const char* payload, int length, struct hvc_get_camera_angle_response* res);
+
+int hvc_parse_threshold_values(const char* payload, int length, struct hvc_get_threshold_values_response* res);
+
+int hvc_parse_detection_size(const char* payload, int length, struct hvc_get_detection_size_response* res);
 
-struct hvc_get_face_angle_response* hvc_get_face_angle();
+int hvc_parse_face_angle(const char* payload, int length, struct hvc_get_face_angle_response* res);
+
+int hvc_parse_user_data(const char* payload, int length, struct hvc_get_user_data_response* res);
+
+/*
+ * Size of the detection part of an execution payload (everything
+ * but the image) given its 4 byte header, or HVC_ERR_PAYLOAD.
+ */
+int hvc_execution_payload_size(const char* header, int function);
 
-struct hvc_execution_response* hvc_execution(int function, int image);
+int hvc_parse_execution(const char* payload, int length, int function, struct hvc_execution_response* res);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,33 @@
+#ifndef HVC_ALBUM_H
+#define HVC_ALBUM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "hvc.h"
+
+/*
+ * Host side album cache. The album is kept in a file so a sensor that
+ * lost its album (replaced, reformatted) is restored with one bulk load
+ * instead of enrolling everyone again. Both directions stream in
+ * HVC_ALBUM_CHUNK byte chunks, the album never has to fit in memory.
+ */
+
+/*
+ * Save the HVC's album to path, returns the album size or an HVC_ERR_*
+ * status. A failed save removes the partial file.
+ */
+int hvc_album_save_file(struct hvc_device* dev, const char* path);
+
+/*
+ * Load the album cached at path into the HVC and persist it to the
+ * HVC's flash, returns an HVC_OK/HVC_ERR_* status.
+ */
+int hvc_album_load_file(struct hvc_device* dev, const char* path);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,113 @@
+#ifndef HVC_ASYNC_H
+#define HVC_ASYNC_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include "hvc.h"
+
+/*
+ * Engine states
+ */
+#define HVC_ASYNC_IDLE          0
+#define HVC_ASYNC_HEADER        1
+#define HVC_ASYNC_PAYLOAD       2
+#define HVC_ASYNC_IMAGE_HEADER  3
+#define HVC_ASYNC_IMAGE         4
+#define HVC_ASYNC_DISCARD       5
+
+struct hvc_async;
+
+/*
+ * Completion callback. On HVC_OK the response payload (without image) is
+ * in async->payload, decode it with the hvc_parse_* functions. An
+ * execution whose image failed (HVC_ERR_SINK, HVC_ERR_TIMEOUT while
+ * streaming) still has its detections there. The payload stays valid
+ * until more bytes are fed. The engine is idle again when the
+ * callback runs, so the next command can be submitted from it.
+ */
+typedef void (*hvc_async_cb)(struct hvc_async* async, int status, void* ctx);
+
+/*
+ * Non-blocking command engine. Commands are submitted with a completion
+ * callback, received bytes are pushed in with hvc_async_feed (or pulled by
+ * hvc_async_poll) and time is advanced with hvc_async_tick. Nothing blocks
+ * or sleeps, so the engine can be driven from any event loop.
+ */
+struct hvc_async
+{
+  struct hvc_device* dev;
+  int state;
+  char cmd;
+  int function;
+  int image;
+
+  hvc_async_cb cb;
+  void* ctx;
+
+  // Header of the response being received
+  char header[HVC_HEADER_SIZE];
+  int header_length;
+  int status;
+
+  // Bytes skipped while looking for the header
+  int discarded;
+
+  // Bytes of the response still to come, after the header
+  int remaining;
+
+  // Non-image part of the payload
+  char payload[RECV_BUFFER_SIZE];
+  int payload_length;
+  int payload_target;
+
+  // Image streaming, a chunk the sink didn't accept is parked here
+  char image_header[HVC_IMAGE_HEADER_SIZE];
+  int image_header_length;
+  bool streaming;
+  int image_status;
+  char pending[HVC_IMAGE_READ_BUFFER];
+  int pending_offset;
+  int pending_length;
+
+  // Milliseconds since submission while waiting for the header, since
+  // the last byte arrived after that
+  int idle_ms;
+};
+
+void hvc_async_init(struct hvc_async* async, struct hvc_device* dev);
+
+bool hvc_async_idle(struct hvc_async* async);
+
+int hvc_async_submit(struct hvc_async* async, char cmd, const char* data, int data_size, hvc_async_cb cb, void* ctx);
+
+int hvc_async_execute(struct hvc_async* async, int function, int image, hvc_async_cb cb, void* ctx);
+
+/*
+ * Number of bytes the engine accepts right now. Zero while the image
+ * sink applies backpressure.
+ */
+int hvc_async_want(struct hvc_async* async);
+
+/*
+ * Push received bytes into the engine, returns the number consumed.
+ */
+int hvc_async_feed(struct hvc_async* async, const char* data, int length);
+
+/*
+ * Pull whatever the transport has buffered into the engine, never blocks
+ */
+void hvc_async_poll(struct hvc_async* async);
+
+/*
+ * Advance the engine clock, fails the command in flight on timeout
+ */
+void hvc_async_tick(struct hvc_async* async, int elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
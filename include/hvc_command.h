@@ -0,0 +1,209 @@
+#ifndef HVC_COMMAND_H
+#define HVC_COMMAND_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include <string.h>
+#include "hvc_response.h"
+
+/*
+ * Wire types of payload fields, all little endian. Every type has a
+ * size, a decoder reading it from p into dst and an encoder writing src
+ * to p. BYTES* are raw strings copied as is.
+ */
+#define HVC_WIRE_SIZE_U8       1
+#define HVC_WIRE_SIZE_S8       1
+#define HVC_WIRE_SIZE_U16      2
+#define HVC_WIRE_SIZE_S16      2
+#define HVC_WIRE_SIZE_U32      4
+#define HVC_WIRE_SIZE_BYTES4   4
+#define HVC_WIRE_SIZE_BYTES12  12
+
+#define HVC_WIRE_U16(p) ((uint16_t) ((uint8_t) (p)[0] | ((uint8_t) (p)[1] << 8)))
+
+#define HVC_WIRE_DECODE_U8(dst, p)      (dst) = (uint8_t) (p)[0]
+#define HVC_WIRE_DECODE_S8(dst, p)      (dst) = (int8_t) (p)[0]
+#define HVC_WIRE_DECODE_U16(dst, p)     (dst) = HVC_WIRE_U16(p)
+#define HVC_WIRE_DECODE_S16(dst, p)     (dst) = (int16_t) HVC_WIRE_U16(p)
+#define HVC_WIRE_DECODE_U32(dst, p)     (dst) = HVC_WIRE_U16(p) | ((uint32_t) HVC_WIRE_U16((p) + 2) << 16)
+#define HVC_WIRE_DECODE_BYTES4(dst, p)  memcpy((dst), (p), 4)
+#define HVC_WIRE_DECODE_BYTES12(dst, p) memcpy((dst), (p), 12)
+
+#define HVC_WIRE_ENCODE_U8(p, src)      (p)[0] = (char) ((src) & 0xFF)
+#define HVC_WIRE_ENCODE_S8(p, src)      HVC_WIRE_ENCODE_U8(p, src)
+#define HVC_WIRE_ENCODE_U16(p, src)     (p)[0] = (char) ((src) & 0xFF), (p)[1] = (char) (((src) >> 8) & 0xFF)
+#define HVC_WIRE_ENCODE_S16(p, src)     HVC_WIRE_ENCODE_U16(p, src)
+#define HVC_WIRE_ENCODE_U32(p, src)     HVC_WIRE_ENCODE_U16(p, (src) & 0xFFFF), HVC_WIRE_ENCODE_U16((p) + 2, ((src) >> 16) & 0xFFFF)
+#define HVC_WIRE_ENCODE_BYTES4(p, src)  memcpy((p), (src), 4)
+#define HVC_WIRE_ENCODE_BYTES12(p, src) memcpy((p), (src), 12)
+
+/*
+ * Payload layouts, one F(member, wire type) per field in wire order.
+ * A setter and its getter share one layout so they can't disagree on the
+ * field order.
+ */
+#define HVC_LAYOUT_VERSION(F) \
+  F(model, BYTES12) F(major_version, U8) F(minor_version, U8) F(release_version, U8) F(revision, BYTES4)
+
+#define HVC_LAYOUT_CAMERA_ANGLE(F) \
+  F(angle, U8)
+
+#define HVC_LAYOUT_THRESHOLDS(F) \
+  F(body, U16) F(hand, U16) F(face, U16) F(recognition, U16)
+
+#define HVC_LAYOUT_DETECTION_SIZE(F) \
+  F(min_body, U16) F(max_body, U16) F(min_hand, U16) F(max_hand, U16) F(min_face, U16) F(max_face, U16)
+
+#define HVC_LAYOUT_FACE_ANGLE(F) \
+  F(yaw, U8) F(roll, U8)
+
+#define HVC_LAYOUT_USER_DATA(F) \
+  F(data, U16)
+
+#define HVC_LAYOUT_EXECUTE(F) \
+  F(function, U16) F(image, U8)
+
+#define HVC_LAYOUT_BAUDRATE(F) \
+  F(rate, U8)
+
+#define HVC_LAYOUT_USER(F) \
+  F(user_id, U16) F(data_id, U8)
+
+#define HVC_LAYOUT_USER_ID(F) \
+  F(user_id, U16)
+
+#define HVC_LAYOUT_ALBUM_SIZE(F) \
+  F(size, U32)
+
+/*
+ * Layouts of the records in an execution response
+ */
+#define HVC_LAYOUT_DETECTION(F) \
+  F(x, S16) F(y, S16) F(size, S16) F(confidence, S16)
+
+#define HVC_LAYOUT_FACE_DIRECTION(F) \
+  F(yaw, S16) F(pitch, S16) F(roll, S16) F(confidence, S16)
+
+#define HVC_LAYOUT_FACE_AGE(F) \
+  F(age, S8) F(confidence, S16)
+
+#define HVC_LAYOUT_FACE_GENDER(F) \
+  F(gender, S8) F(confidence, S16)
+
+#define HVC_LAYOUT_FACE_GAZE(F) \
+  F(yaw, S8) F(pitch, S8)
+
+#define HVC_LAYOUT_FACE_BLINK(F) \
+  F(left, S16) F(right, S16)
+
+#define HVC_LAYOUT_FACE_EXPRESSION(F) \
+  F(neutral, U8) F(happiness, U8) F(surprise, U8) F(anger, U8) F(sadness, U8) F(degree, S8)
+
+#define HVC_LAYOUT_FACE_RECOGNITION(F) \
+  F(user_id, S16) F(score, S16)
+
+/*
+ * Wire size of a layout, a constant expression
+ */
+#define HVC_LAYOUT_FIELD_SIZE(member, wire) + HVC_WIRE_SIZE_##wire
+#define HVC_LAYOUT_SIZE(LAYOUT) (0 LAYOUT(HVC_LAYOUT_FIELD_SIZE))
+
+#define HVC_LAYOUT_FIELD_FITS(member, wire) && sizeof(s->member) >= HVC_WIRE_SIZE_##wire
+#define HVC_LAYOUT_FIELD_DECODE(member, wire) HVC_WIRE_DECODE_##wire(s->member, bytes); bytes += HVC_WIRE_SIZE_##wire;
+#define HVC_LAYOUT_FIELD_ENCODE(member, wire) HVC_WIRE_ENCODE_##wire(bytes, s->member); bytes += HVC_WIRE_SIZE_##wire;
+
+/*
+ * Define a decoder for a layout, it reads HVC_LAYOUT_SIZE(LAYOUT) bytes
+ * into a struct and returns the bytes that follow. Fails to compile if a
+ * member is narrower than its wire type.
+ */
+#define HVC_DEFINE_DECODER(name, type, LAYOUT) \
+  static const char* name(const char* bytes, type* s) \
+  { \
+    _Static_assert(1 LAYOUT(HVC_LAYOUT_FIELD_FITS), #type " can't hold " #LAYOUT); \
+    LAYOUT(HVC_LAYOUT_FIELD_DECODE) \
+    return bytes; \
+  }
+
+/*
+ * Define an encoder for a layout, the counterpart of HVC_DEFINE_DECODER
+ */
+#define HVC_DEFINE_ENCODER(name, type, LAYOUT) \
+  static char* name(char* bytes, const type* s) \
+  { \
+    LAYOUT(HVC_LAYOUT_FIELD_ENCODE) \
+    return bytes; \
+  }
+
+/*
+ * Arguments of the commands that don't write a setting, setters take
+ * the response of their getter.
+ */
+struct hvc_execute_request
+{
+  int function;
+  int image;
+};
+
+struct hvc_baudrate_request
+{
+  int rate;
+};
+
+struct hvc_user_request
+{
+  int user_id;
+  int data_id;
+};
+
+struct hvc_album_size_request
+{
+  uint32_t size;
+};
+
+/*
+ * Command descriptor. Requests are request_size bytes encoded from the
+ * command's request struct, successful responses carry response_min to
+ * response_max payload bytes. timeout is the time the HVC needs to answer
+ * on top of the retry period. Commands with a fixed response have a
+ * decoder filling their response struct, the others (acknowledgements,
+ * executions, images and albums) are read by their own function.
+ */
+struct hvc_command
+{
+  const char* name;
+  int request_size;
+  int response_min;
+  int response_max;
+  int timeout;
+
+  char* (*encode)(char* data, const void* request);
+  const char* (*decode)(const char* payload, void* response);
+};
+
+/*
+ * Descriptor of cmd, NULL for commands the library doesn't know
+ */
+const struct hvc_command* hvc_command_find(int cmd);
+
+/*
+ * Encode the request of cmd into data, which must hold request_size
+ * bytes. Returns the request size or HVC_ERR_ARGS for unknown commands.
+ */
+int hvc_command_encode(int cmd, const void* request, char* data);
+
+/*
+ * Decode a received payload of cmd into its response struct. Returns
+ * HVC_OK, HVC_ERR_PAYLOAD if the payload is too short or HVC_ERR_ARGS if
+ * cmd has no decoder.
+ */
+int hvc_command_decode(int cmd, const char* payload, int length, void* response);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
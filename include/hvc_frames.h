@@ -0,0 +1,77 @@
+#ifndef HVC_FRAMES_H
+#define HVC_FRAMES_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hvc_response.h"
+
+/*
+ * Detection frame, an execution result stamped with the time it was
+ * received and its position in the stream.
+ */
+struct hvc_frame
+{
+  int64_t timestamp;
+  uint32_t sequence;
+  struct hvc_execution_response res;
+};
+
+/*
+ * Ring slot guarded by a sequence lock, seq is odd while the slot is
+ * being written.
+ */
+struct hvc_frame_slot
+{
+  uint32_t seq;
+  struct hvc_frame frame;
+};
+
+/*
+ * Single producer, multiple consumer frame ring. The producer always
+ * overwrites the oldest frame and never waits for readers. Every reader
+ * keeps its own position and counts the frames it missed.
+ */
+struct hvc_frame_ring
+{
+  struct hvc_frame_slot* slots;
+  int size;
+
+  // Frames published so far, the next frame gets this sequence
+  uint32_t head;
+};
+
+struct hvc_frame_reader
+{
+  struct hvc_frame_ring* ring;
+  uint32_t next;
+  uint32_t dropped;
+};
+
+void hvc_frame_ring_init(struct hvc_frame_ring* ring, struct hvc_frame_slot* slots, int size);
+
+/*
+ * Copy a result into the ring, only ever called from one task
+ */
+void hvc_frame_ring_publish(struct hvc_frame_ring* ring, int64_t timestamp, const struct hvc_execution_response* res);
+
+/*
+ * Attach a reader, it receives frames published from now on
+ */
+void hvc_frame_reader_init(struct hvc_frame_reader* reader, struct hvc_frame_ring* ring);
+
+/*
+ * Copy the oldest unread frame into frame. Returns false when the reader
+ * has caught up. Frames overwritten before they were read are skipped
+ * and added to reader->dropped.
+ */
+bool hvc_frame_reader_read(struct hvc_frame_reader* reader, struct hvc_frame* frame);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
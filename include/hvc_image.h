@@ -0,0 +1,170 @@
+#ifndef HVC_IMAGE_H
+#define HVC_IMAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Image sink, receives the grayscale image of an execution response
+ * as it streams in from the sensor.
+ *
+ * begin: called with the image dimensions, return false to skip the image
+ * write: called for every chunk, returns the number of bytes consumed. Return
+ *        0 to apply backpressure (the chunk is offered again shortly) or a
+ *        negative value to abort the capture.
+ * end:   optional, called once with HVC_OK or the error that ended the capture
+ */
+struct hvc_image_sink
+{
+  bool (*begin)(void* ctx, int width, int height);
+  int (*write)(void* ctx, const char* data, int length);
+  void (*end)(void* ctx, int status);
+  void* ctx;
+};
+
+/*
+ * File sink, writes the dimensions as the first 4 bytes followed by
+ * the raw image. The file is rewritten for every image unless append
+ * is set, then images are added to the end.
+ */
+struct hvc_image_file
+{
+  const char* path;
+  FILE* fp;
+  bool append;
+};
+
+/*
+ * Ring buffer sink, queues the same format as the file sink for a
+ * consumer on another task. Safe for a single producer and a single
+ * consumer. A full ring applies backpressure to the reader.
+ *
+ * A frame is written behind the consumer's back at cursor and only
+ * published by moving head once it completed, so a capture that fails
+ * midway leaves nothing behind. The ring has to hold a whole frame.
+ */
+struct hvc_image_ring
+{
+  char* buffer;
+  int size;
+  int head;
+  int tail;
+  int cursor;
+  int frames;
+};
+
+/*
+ * Widest image the encoder takes, QVGA
+ */
+#define HVC_IMAGE_MAX_WIDTH 320
+
+/*
+ * Encoded image formats, the first byte after the dimensions
+ *
+ * KEY    every pixel predicted from its left, upper and upper left
+ *        neighbours (the JPEG-LS median predictor)
+ * DELTA  every HVC_IMAGE_BLOCK pixels of a row predicted from the same
+ *        pixels of the previous image, or from their neighbours if that
+ *        predicted the same columns of the row above better
+ *
+ * The prediction residuals follow as adaptive Rice codes, most
+ * significant bit first. The quotient is sent in unary, capped at
+ * HVC_IMAGE_RICE_LIMIT ones which escape to the raw 8 bit residual. The
+ * last byte is zero padded, so a decoder that knows the dimensions
+ * finds the next image right after it.
+ */
+#define HVC_IMAGE_FORMAT_KEY   1
+#define HVC_IMAGE_FORMAT_DELTA 2
+#define HVC_IMAGE_RICE_LIMIT   16
+#define HVC_IMAGE_BLOCK        16
+#define HVC_IMAGE_BLOCKS       ((HVC_IMAGE_MAX_WIDTH + HVC_IMAGE_BLOCK - 1) / HVC_IMAGE_BLOCK)
+
+/*
+ * Encoded bytes staged before they're handed to the output sink
+ */
+#define HVC_IMAGE_ENCODER_BUFFER 256
+
+/*
+ * Encoding sink, compresses images on the fly and passes the result on
+ * to another sink. The output sink sees the usual dimensions first, then
+ * the encoded image. Only the previous row is kept, unless deltas are
+ * enabled with a reference buffer that holds the previous image.
+ */
+struct hvc_image_encoder
+{
+  struct hvc_image_sink* out;
+
+  // Previous image for deltas, NULL to only send key images. A key
+  // image is sent at least every key_interval images.
+  char* reference;
+  int reference_size;
+  int key_interval;
+  int since_key;
+  bool have_reference;
+
+  // Image in progress
+  int width;
+  int height;
+  int x;
+  int y;
+  int format;
+  bool update_reference;
+  uint8_t row[HVC_IMAGE_MAX_WIDTH];
+  int up_left;
+
+  // Prediction cost of both predictors per block of the row above
+  uint16_t block_spatial[HVC_IMAGE_BLOCKS];
+  uint16_t block_delta[HVC_IMAGE_BLOCKS];
+  int cost_spatial;
+  int cost_delta;
+  bool use_delta;
+
+  // Rice parameter adaptation, sum of residuals over count
+  int rice_sum;
+  int rice_count;
+
+  uint32_t bits;
+  int bit_count;
+  char buffer[HVC_IMAGE_ENCODER_BUFFER];
+  int buffered;
+
+  // Statistics of the last image
+  uint32_t bytes_in;
+  uint32_t bytes_out;
+};
+
+void hvc_image_file_sink_init(struct hvc_image_sink* sink, struct hvc_image_file* file, const char* path);
+
+void hvc_image_ring_sink_init(struct hvc_image_sink* sink, struct hvc_image_ring* ring, char* buffer, int size);
+
+int hvc_image_ring_read(struct hvc_image_ring* ring, char* data, int length);
+
+/*
+ * reference (reference_size bytes, at least width x height) enables
+ * deltas, pass NULL to encode every image on its own
+ */
+void hvc_image_encoder_init(struct hvc_image_sink* sink, struct hvc_image_encoder* encoder, struct hvc_image_sink* out,
+  char* reference, int reference_size, int key_interval);
+
+/*
+ * The next image will be a key image
+ */
+bool hvc_image_encoder_key_due(const struct hvc_image_encoder* encoder);
+
+/*
+ * Decode an encoded image (without its dimensions) into image. For a
+ * delta image, image must hold the previous image, it is updated in
+ * place. Returns the number of bytes used or HVC_ERR_PAYLOAD.
+ */
+int hvc_image_decode(const char* data, int length, int width, int height, char* image);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,84 @@
+#ifndef HVC_KERNELS_H
+#define HVC_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "hvc_response.h"
+
+/*
+ * Image kernels for captured 8 bit grayscale frames. Every kernel has a
+ * vector path for SSE2 and NEON and a portable C path, the brightness sum
+ * of which works on four pixels per 32 bit word. The path is picked at
+ * compile time, define HVC_KERNEL_SCALAR to force the portable one. All
+ * paths give the same results.
+ */
+#if defined(HVC_KERNEL_SCALAR)
+#define HVC_KERNEL_ISA "scalar"
+#elif defined(__SSE2__)
+#define HVC_KERNEL_SSE2
+#define HVC_KERNEL_ISA "sse2"
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define HVC_KERNEL_NEON
+#define HVC_KERNEL_ISA "neon"
+#else
+#define HVC_KERNEL_ISA "scalar"
+#endif
+
+/*
+ * Detection coordinates are given on the full camera resolution, the
+ * QVGA image is scaled down by HVC_KERNEL_SENSOR_WIDTH / 320.
+ */
+#define HVC_KERNEL_SENSOR_WIDTH  1600
+#define HVC_KERNEL_SENSOR_HEIGHT 1200
+
+/*
+ * Change between two frames. sad is the sum of absolute differences,
+ * changed the number of pixels that differ by more than the threshold.
+ */
+struct hvc_motion
+{
+  uint32_t sad;
+  uint32_t changed;
+};
+
+/*
+ * Halve a width x height image in both directions into dst, every output
+ * pixel is the rounded mean of a 2x2 block. An odd last row or column is
+ * dropped.
+ */
+void hvc_kernel_downscale(const uint8_t* src, int width, int height, uint8_t* dst);
+
+/*
+ * Count the length pixels of an image into 256 bins
+ */
+void hvc_kernel_histogram(const uint8_t* image, int length, uint32_t histogram[256]);
+
+/*
+ * Sum and rounded mean brightness of length pixels, 0 for an empty image
+ */
+uint32_t hvc_kernel_sum(const uint8_t* image, int length);
+
+int hvc_kernel_mean(const uint8_t* image, int length);
+
+/*
+ * Compare a frame with the previous one, threshold 0-255
+ */
+void hvc_kernel_motion(const uint8_t* image, const uint8_t* previous, int length, int threshold, struct hvc_motion* motion);
+
+/*
+ * Copy the box of a detection out of a width x height image into dst,
+ * clipped to the image. Stores the size of the crop in crop_width and
+ * crop_height and returns its bytes, or HVC_ERR_ARGS if the box misses
+ * the image or dst can't hold it.
+ */
+int hvc_kernel_crop(const uint8_t* image, int width, int height, const struct hvc_detection* detection,
+  uint8_t* dst, int size, int* crop_width, int* crop_height);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,75 @@
+#ifndef HVC_LOG_H
+#define HVC_LOG_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Log levels. Messages above hvc_log_level are dropped before their
+ * arguments are evaluated or formatted.
+ */
+#define HVC_LOG_LEVEL_NONE  -1
+#define HVC_LOG_LEVEL_ERROR 0
+#define HVC_LOG_LEVEL_INFO  1
+#define HVC_LOG_LEVEL_DEBUG 2
+
+/*
+ * Every call site may log HVC_LOG_BURST messages per HVC_LOG_WINDOW_MS,
+ * the rest are counted and reported with the next message that passes.
+ */
+#define HVC_LOG_BURST     5
+#define HVC_LOG_WINDOW_MS 1000
+
+struct hvc_log_site
+{
+  int64_t window_start;
+  int count;
+  int suppressed;
+};
+
+extern int hvc_log_level;
+
+/*
+ * Implemented by every port, the library calls them through the
+ * HVC_LOG_* macros below.
+ */
+void hvc_log_debug(const char* format, ...);
+
+void hvc_log_info(const char* format, ...);
+
+void hvc_log_error(const char* format, ...);
+
+void hvc_log_set_level(int level);
+
+/*
+ * Monotonic clock in microseconds for the rate limits, call sites are
+ * not limited until a port sets one
+ */
+void hvc_log_set_clock(int64_t (*clock)(void));
+
+/*
+ * Whether the call site may log now
+ */
+bool hvc_log_allow(struct hvc_log_site* site, int level);
+
+#define HVC_LOG(level, fn, ...) \
+  do \
+  { \
+    static struct hvc_log_site _hvc_log_site; \
+    if ((level) <= hvc_log_level && hvc_log_allow(&_hvc_log_site, (level))) fn(__VA_ARGS__); \
+  } \
+  while (0)
+
+#define HVC_LOG_DEBUG(...) HVC_LOG(HVC_LOG_LEVEL_DEBUG, hvc_log_debug, __VA_ARGS__)
+#define HVC_LOG_INFO(...)  HVC_LOG(HVC_LOG_LEVEL_INFO, hvc_log_info, __VA_ARGS__)
+#define HVC_LOG_ERROR(...) HVC_LOG(HVC_LOG_LEVEL_ERROR, hvc_log_error, __VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
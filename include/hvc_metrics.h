@@ -0,0 +1,96 @@
+#ifndef HVC_METRICS_H
+#define HVC_METRICS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+
+/*
+ * Round trip histogram, bucket n counts responses that arrived within
+ * 2^n ms of the command, the last bucket everything slower.
+ */
+#define HVC_METRICS_BUCKETS 12
+
+/*
+ * Distinct HVC_CMD_* commands tracked per device
+ */
+#define HVC_METRICS_COMMANDS 24
+
+/*
+ * Error counters are indexed by -HVC_ERR_*
+ */
+#define HVC_METRICS_ERRORS 11
+
+struct hvc_command_metrics
+{
+  int cmd;
+  uint32_t count;
+  uint32_t errors;
+  uint32_t max_us;
+  uint64_t total_us;
+  uint32_t histogram[HVC_METRICS_BUCKETS];
+};
+
+/*
+ * Per device instrumentation. Updated by the task driving the device,
+ * readers on other tasks may see a command's counters mid-update.
+ */
+struct hvc_metrics
+{
+  uint32_t errors[HVC_METRICS_ERRORS];
+  uint32_t bytes_tx;
+  uint32_t bytes_rx;
+
+  // Image bytes announced by the HVC that never arrived
+  uint32_t image_missing;
+
+  // Times the parser recovered from line noise or stale responses and
+  // the bytes it threw away doing so
+  uint32_t resyncs;
+  uint32_t discarded;
+
+  // Power cycles of the sensor and the time from power on to the first
+  // detection result after it
+  uint32_t wakes;
+  uint32_t wake_last_ms;
+  uint32_t wake_max_ms;
+  uint64_t wake_total_ms;
+
+  int command_count;
+  struct hvc_command_metrics commands[HVC_METRICS_COMMANDS];
+};
+
+void hvc_metrics_reset(struct hvc_metrics* metrics);
+
+/*
+ * Record the round trip of a command, elapsed_us < 0 if unknown
+ */
+void hvc_metrics_command(struct hvc_metrics* metrics, int cmd, int status, int elapsed_us);
+
+/*
+ * Count a failure, status is one of HVC_ERR_*
+ */
+void hvc_metrics_error(struct hvc_metrics* metrics, int status);
+
+/*
+ * Count a recovery that discarded bytes
+ */
+void hvc_metrics_resync(struct hvc_metrics* metrics, int discarded);
+
+/*
+ * Record a power cycle that took elapsed_ms to the first detection
+ */
+void hvc_metrics_wake(struct hvc_metrics* metrics, int elapsed_ms);
+
+/*
+ * Metrics of a command or NULL if it was never sent
+ */
+const struct hvc_command_metrics* hvc_metrics_find(const struct hvc_metrics* metrics, int cmd);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
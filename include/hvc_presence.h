@@ -0,0 +1,108 @@
+#ifndef HVC_PRESENCE_H
+#define HVC_PRESENCE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hvc_response.h"
+
+/*
+ * Largest voting window in frames
+ */
+#define HVC_PRESENCE_MAX_WINDOW 32
+
+/*
+ * A frame's evidence is the confidence of its most confident body or
+ * face, detection confidences range from 0 to 1000.
+ */
+#define HVC_PRESENCE_EVIDENCE_MAX 1000
+
+/*
+ * Presence events. OCCUPIED and VACANT alternate, COUNT reports a change
+ * in the number of people while occupied.
+ */
+#define HVC_PRESENCE_OCCUPIED 0
+#define HVC_PRESENCE_VACANT   1
+#define HVC_PRESENCE_COUNT    2
+
+struct hvc_presence_config
+{
+  // Frames that vote, up to HVC_PRESENCE_MAX_WINDOW
+  int window;
+
+  // Summed evidence of the window at which the scene becomes occupied
+  // and below which it becomes vacant again, enter must exceed leave
+  int enter;
+  int leave;
+
+  // Bodies and faces less confident than this are ignored
+  int min_confidence;
+
+  // Frames in a row a new number of people must win the vote before it
+  // is reported
+  int count_frames;
+};
+
+struct hvc_presence;
+
+/*
+ * Presence event callback, raised from within hvc_presence_update
+ */
+typedef void (*hvc_presence_cb)(struct hvc_presence* presence, int event, void* ctx);
+
+/*
+ * Turns per frame detections into debounced presence. Every frame votes
+ * with its evidence. The scene becomes occupied once the window sum
+ * reaches enter on two frames with detections in a row (or one frame
+ * that reaches enter alone) and stays so until the sum falls below
+ * leave. A person detected with a confidence of at least enter / 2 is
+ * reported on their second frame, dropouts and isolated stray
+ * detections are absorbed by the window. The number of people is the
+ * one with the most evidence in the window.
+ */
+struct hvc_presence
+{
+  struct hvc_presence_config config;
+
+  // Evidence and people of the last window frames, and the evidence sum
+  uint16_t evidence[HVC_PRESENCE_MAX_WINDOW];
+  uint8_t people[HVC_PRESENCE_MAX_WINDOW];
+  int head;
+  int32_t score;
+
+  bool occupied;
+  int count;
+
+  // Number of people waiting to be confirmed and for how many frames
+  int pending_count;
+  int pending_frames;
+
+  // Milliseconds, start of the current occupied or vacant period and
+  // how long the one before it lasted
+  int64_t since;
+  int64_t duration;
+
+  // Statistics, frames fed and events raised
+  uint32_t frames;
+  uint32_t events;
+
+  hvc_presence_cb cb;
+  void* ctx;
+};
+
+void hvc_presence_init(struct hvc_presence* presence, const struct hvc_presence_config* config, hvc_presence_cb cb, void* ctx);
+
+/*
+ * Feed a detection taken at time_ms. Events are raised from within the
+ * call, at most one per frame.
+ */
+void hvc_presence_update(struct hvc_presence* presence, const struct hvc_execution_response* res, int64_t time_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,140 @@
+#ifndef HVC_QUEUE_H
+#define HVC_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hvc.h"
+#include "hvc_async.h"
+
+/*
+ * Commands waiting or in flight per queue
+ */
+#define HVC_QUEUE_SIZE 4
+
+/*
+ * Largest request the queue keeps a copy of (HVC_CMD_SET_DETECTION_SIZE)
+ */
+#define HVC_QUEUE_DATA_SIZE HVC_DETECTION_LIMITS_SIZE
+
+/*
+ * Request states
+ */
+#define HVC_QUEUE_FREE    0
+#define HVC_QUEUE_WAITING 1
+#define HVC_QUEUE_SENT    2
+
+struct hvc_queue;
+struct hvc_queue_request;
+
+/*
+ * Completion callback, called exactly once per request. On HVC_OK the
+ * response payload is in queue->payload, decode it with the hvc_parse_*
+ * functions before returning. Executions whose image failed keep their
+ * detections there too (see hvc_async_cb). HVC_ERR_CANCELLED and HVC_ERR_TIMEOUT are
+ * reported as soon as they happen, a command that was already sent has
+ * its response drained before the next one goes out.
+ */
+typedef void (*hvc_queue_cb)(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx);
+
+struct hvc_queue_request
+{
+  int state;
+  int id;
+
+  char cmd;
+  char data[HVC_QUEUE_DATA_SIZE];
+  int data_size;
+
+  // Execution flags, for decoding the result
+  int function;
+  int image;
+
+  // Deadline in ms from submission, 0 leaves it to the engine, and the
+  // time spent so far
+  int timeout_ms;
+  int age_ms;
+
+  // Reported already, the response is still drained if it was sent
+  bool done;
+
+  // Transport clock when the command went out and ms from there to the
+  // drained response, -1 without a clock
+  int64_t sent;
+  int latency_ms;
+
+  hvc_queue_cb cb;
+  void* ctx;
+};
+
+/*
+ * Command queue on top of the asynchronous engine. The sensor answers
+ * one command at a time, so the queue sends the next command the moment
+ * the previous response is drained and only then runs that response's
+ * callback. Decoding and dispatching a detection result overlaps the
+ * sensor computing the next one, as long as the next execution is
+ * queued before the current one completes. Drive it with
+ * hvc_queue_poll/hvc_queue_feed and hvc_queue_tick.
+ */
+struct hvc_queue
+{
+  struct hvc_async async;
+
+  // Submission order, a ring over the requests
+  struct hvc_queue_request requests[HVC_QUEUE_SIZE];
+  int head;
+  int count;
+  int next_id;
+
+  // Payload of the completed command, valid during its callback
+  const char* payload;
+  int payload_length;
+
+  // Statistics
+  uint32_t completed;
+  uint32_t cancelled;
+  uint32_t timeouts;
+};
+
+void hvc_queue_init(struct hvc_queue* queue, struct hvc_device* dev);
+
+/*
+ * Queue a command, timeout_ms limits the time from submission to the
+ * response (0 for the command's own timeout). Returns the request id
+ * (positive) or HVC_ERR_BUSY when the queue is full.
+ */
+int hvc_queue_submit(struct hvc_queue* queue, char cmd, const char* data, int data_size, int timeout_ms, hvc_queue_cb cb, void* ctx);
+
+int hvc_queue_execute(struct hvc_queue* queue, int function, int image, int timeout_ms, hvc_queue_cb cb, void* ctx);
+
+/*
+ * Report a request as HVC_ERR_CANCELLED. Returns HVC_ERR_ARGS if it was
+ * reported already.
+ */
+int hvc_queue_cancel(struct hvc_queue* queue, int id);
+
+void hvc_queue_cancel_all(struct hvc_queue* queue);
+
+/*
+ * Requests not yet reported
+ */
+int hvc_queue_pending(struct hvc_queue* queue);
+
+int hvc_queue_feed(struct hvc_queue* queue, const char* data, int length);
+
+void hvc_queue_poll(struct hvc_queue* queue);
+
+/*
+ * Advance the clock, reports requests past their deadline and fails the
+ * command in flight if the engine times out
+ */
+void hvc_queue_tick(struct hvc_queue* queue, int elapsed_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
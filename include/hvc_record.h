@@ -0,0 +1,73 @@
+#ifndef HVC_RECORD_H
+#define HVC_RECORD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "hvc.h"
+
+/*
+ * Recording file layout, all fields little endian. A header of
+ * HVC_RECORD_FILE_HEADER bytes: the magic, version (uint16) and record
+ * header size (uint16). Then one record per transport call: type (uint8),
+ * data length (uint16), microseconds since the previous record (uint32)
+ * followed by the data. Reads longer than 64k are split over records.
+ *
+ * RX        bytes returned by a read, stamped when the read returned
+ * TX        bytes handed to a write
+ * BAUDRATE  the host rate changed, the data is the rate (uint32)
+ */
+#define HVC_RECORD_MAGIC         "HVCR"
+#define HVC_RECORD_VERSION       1
+#define HVC_RECORD_FILE_HEADER   8
+#define HVC_RECORD_HEADER        7
+#define HVC_RECORD_MAX_DATA      0xFFFF
+
+#define HVC_RECORD_RX       1
+#define HVC_RECORD_TX       2
+#define HVC_RECORD_BAUDRATE 3
+
+/*
+ * Transport shim that passes every call through to an inner transport
+ * and appends the raw traffic to a file. Bytes pushed straight into the
+ * asynchronous engine with hvc_async_feed bypass the transport and are
+ * not recorded.
+ */
+struct hvc_recorder
+{
+  struct hvc_transport inner;
+  FILE* fp;
+  int64_t last_time;
+
+  // Bytes written to the file, recording stops at max_bytes (0 no limit)
+  uint32_t bytes;
+  uint32_t max_bytes;
+  uint32_t records;
+  bool truncated;
+
+  // Set from another task to finish the file at the next transport call
+  volatile bool stop;
+};
+
+/*
+ * Start recording the traffic of inner to path and fill in the
+ * transport to hand to hvc_device_init. Returns HVC_OK or HVC_ERR_SINK,
+ * transport is left alone on failure.
+ */
+int hvc_recorder_open(struct hvc_recorder* rec, const char* path, uint32_t max_bytes,
+  const struct hvc_transport* inner, struct hvc_transport* transport);
+
+/*
+ * Finish the file, the transport keeps passing calls through
+ */
+void hvc_recorder_close(struct hvc_recorder* rec);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -48,11 +48,112 @@ struct hvc_get_face_angle_response
   char roll;
 };
 
+struct hvc_get_user_data_response
+{
+  // Bit n is set when data ID n is registered
+  uint16_t data;
+};
+
+/*
+ * Maximum number of detections the HVC-P reports per category
+ */
+#define HVC_MAX_BODIES 35
+#define HVC_MAX_HANDS  35
+#define HVC_MAX_FACES  35
+
+/*
+ * Value reported for estimations that could not be made, and
+ * estimation specific values
+ */
+#define HVC_EST_NOT_POSSIBLE    -128
+#define HVC_GENDER_FEMALE       0
+#define HVC_GENDER_MALE         1
+#define HVC_USER_NOT_RECOGNIZED -1
+
+struct hvc_detection
+{
+  int16_t x;
+  int16_t y;
+  int16_t size;
+  int16_t confidence;
+};
+
+struct hvc_face_direction
+{
+  int16_t yaw;
+  int16_t pitch;
+  int16_t roll;
+  int16_t confidence;
+};
+
+struct hvc_face_age
+{
+  int8_t age;
+  int16_t confidence;
+};
+
+struct hvc_face_gender
+{
+  int8_t gender;
+  int16_t confidence;
+};
+
+struct hvc_face_gaze
+{
+  int8_t yaw;
+  int8_t pitch;
+};
+
+struct hvc_face_blink
+{
+  int16_t left;
+  int16_t right;
+};
+
+struct hvc_face_expression
+{
+  uint8_t neutral;
+  uint8_t happiness;
+  uint8_t surprise;
+  uint8_t anger;
+  uint8_t sadness;
+  int8_t degree;
+};
+
+struct hvc_face_recognition
+{
+  int16_t user_id;
+  int16_t score;
+};
+
+/*
+ * Face detection result. Only the estimations requested through
+ * the HVC_EX_* execution flags are filled in.
+ */
+struct hvc_face
+{
+  struct hvc_detection detection;
+  struct hvc_face_direction direction;
+  struct hvc_face_age age;
+  struct hvc_face_gender gender;
+  struct hvc_face_gaze gaze;
+  struct hvc_face_blink blink;
+  struct hvc_face_expression expression;
+  struct hvc_face_recognition recognition;
+};
+
 struct hvc_execution_response
 {
+  // HVC_EX_* flags the response was decoded with
+  int function;
+
   uint8_t body_count;
   uint8_t hand_count;
   uint8_t face_count;
+
+  struct hvc_detection bodies[HVC_MAX_BODIES];
+  struct hvc_detection hands[HVC_MAX_HANDS];
+  struct hvc_face faces[HVC_MAX_FACES];
 };
 
 #ifdef __cplusplus
@@ -0,0 +1,91 @@
+#ifndef HVC_SCHEDULER_H
+#define HVC_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include "hvc_response.h"
+
+/*
+ * Weight of the newest sample in the latency averages, 1/N
+ */
+#define HVC_SCHEDULER_LATENCY_WEIGHT 8
+
+/*
+ * While estimations are dropped for being too slow, retry them every
+ * N active frames to see if the latency recovered
+ */
+#define HVC_SCHEDULER_PROBE_FRAMES 50
+
+struct hvc_scheduler_config
+{
+  // Frame period (ms) while the scene is empty and while someone is present
+  int idle_interval;
+  int active_interval;
+
+  // Consecutive empty frames before falling back to idle
+  int idle_after;
+
+  // Longest idle period (ms). While idle the period doubles with every
+  // empty frame from idle_interval up to this, 0 keeps idle_interval.
+  int max_idle_interval;
+
+  // Execution flags for both states
+  int idle_function;
+  int active_function;
+
+  // Maximum percentage of time the sensor may spend executing (1-100)
+  int duty_cycle;
+
+  // Average latency (ms) above which the active estimations are dropped,
+  // 0 disables
+  int latency_target;
+};
+
+/*
+ * Adaptive detection scheduler. Polls slowly with a cheap function mask
+ * while the scene is empty, speeds up and enables the active estimations
+ * once someone is seen and keeps the frame period and duty cycle in line
+ * with the measured command latency. A scene that stays empty is polled
+ * less and less often, down to one frame per max_idle_interval.
+ */
+struct hvc_scheduler
+{
+  struct hvc_scheduler_config config;
+
+  bool active;
+  int empty_frames;
+
+  // Current idle period, stretched towards max_idle_interval
+  int idle_period;
+
+  // Averages over all frames and over frames with the full active mask
+  int latency;
+  int active_latency;
+
+  bool degraded;
+  int degraded_frames;
+
+  int function;
+};
+
+void hvc_scheduler_init(struct hvc_scheduler* scheduler, const struct hvc_scheduler_config* config);
+
+/*
+ * Execution flags for the next detection
+ */
+int hvc_scheduler_function(struct hvc_scheduler* scheduler);
+
+/*
+ * Feed the result of the last detection (NULL if it failed) and how long
+ * it took. Returns the delay in ms before the next detection.
+ */
+int hvc_scheduler_update(struct hvc_scheduler* scheduler, const struct hvc_execution_response* res, int latency_ms);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,74 @@
+#ifndef HVC_TRACE_H
+#define HVC_TRACE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+
+/*
+ * Trace events and their arguments
+ *
+ * SEND     command, data length
+ * HEADER   response code, payload length
+ * DONE     command, status
+ * RESYNC   command, bytes discarded
+ * IMAGE    status, image bytes missing
+ *
+ * Applications can record their own events from HVC_TRACE_USER up.
+ */
+#define HVC_TRACE_SEND    1
+#define HVC_TRACE_HEADER  2
+#define HVC_TRACE_DONE    3
+#define HVC_TRACE_RESYNC  4
+#define HVC_TRACE_IMAGE   5
+#define HVC_TRACE_USER    0x100
+
+/*
+ * Trace file layout, all fields little endian. A header of
+ * HVC_TRACE_FILE_HEADER bytes: the magic, version (uint16), record size
+ * (uint16), record count (uint32) and records lost to wrapping (uint32).
+ * Then the records, oldest first: time in microseconds (uint32, wraps),
+ * event (uint16), arg0 (uint16), arg1 (int32).
+ */
+#define HVC_TRACE_MAGIC       "HVCT"
+#define HVC_TRACE_VERSION     1
+#define HVC_TRACE_RECORD_SIZE 12
+#define HVC_TRACE_FILE_HEADER 16
+
+struct hvc_trace_record
+{
+  uint32_t time;
+  uint16_t event;
+  uint16_t arg0;
+  int32_t arg1;
+};
+
+/*
+ * Ring of the last size records, size must be a power of two. Written by
+ * the task driving the device without locking, save it from that task or
+ * accept the odd torn record.
+ */
+struct hvc_trace
+{
+  struct hvc_trace_record* records;
+  uint32_t size;
+  uint32_t head;
+};
+
+void hvc_trace_init(struct hvc_trace* trace, struct hvc_trace_record* records, uint32_t size);
+
+void hvc_trace_record(struct hvc_trace* trace, uint32_t time, int event, int arg0, int arg1);
+
+/*
+ * Write the ring to path in the trace file layout, returns the number of
+ * records written or HVC_ERR_SINK
+ */
+int hvc_trace_save_file(const struct hvc_trace* trace, const char* path);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
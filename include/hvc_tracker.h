@@ -0,0 +1,125 @@
+#ifndef HVC_TRACKER_H
+#define HVC_TRACKER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include "hvc_response.h"
+
+/*
+ * Tracks kept per tracker. Room for a full frame of detections plus
+ * tracks coasting through missed frames.
+ */
+#define HVC_TRACKER_MAX_TRACKS 48
+
+/*
+ * Overlap scores are intersection over union scaled to 0-255
+ */
+#define HVC_TRACKER_SCORE_MAX 255
+
+/*
+ * What a tracker follows
+ */
+#define HVC_TRACK_BODIES 0
+#define HVC_TRACK_FACES  1
+
+/*
+ * Track events. ENTER once a track is confirmed, UPDATE every frame it
+ * is seen afterwards and LEAVE when it has been missed for too long.
+ */
+#define HVC_TRACK_ENTER  0
+#define HVC_TRACK_UPDATE 1
+#define HVC_TRACK_LEAVE  2
+
+struct hvc_tracker_config
+{
+  // HVC_TRACK_BODIES or HVC_TRACK_FACES
+  int kind;
+
+  // Minimum overlap score for a detection to continue a track
+  int min_overlap;
+
+  // Frames a new track must be seen before it enters, and frames it may
+  // be missed before it leaves
+  int confirm_frames;
+  int leave_frames;
+};
+
+struct hvc_track
+{
+  // Stable for the life of the track, never reused
+  uint32_t id;
+
+  // Latest position, the velocity is per frame in 1/16 pixels
+  struct hvc_detection detection;
+  int16_t vx;
+  int16_t vy;
+
+  // Recognised user of a face track or HVC_USER_NOT_RECOGNIZED
+  int16_t user_id;
+
+  int hits;
+  int misses;
+  bool confirmed;
+
+  // Milliseconds, dwell time is last_seen - first_seen
+  int64_t first_seen;
+  int64_t last_seen;
+};
+
+struct hvc_tracker;
+
+/*
+ * Track event callback, raised from within hvc_tracker_update
+ */
+typedef void (*hvc_tracker_cb)(struct hvc_tracker* tracker, int event, const struct hvc_track* track, void* ctx);
+
+/*
+ * Associates per frame detections into tracks with stable IDs by box
+ * overlap, greedily from the best overlapping pair down. No allocation,
+ * the work per frame is bounded by tracks x detections x detections.
+ */
+struct hvc_tracker
+{
+  struct hvc_tracker_config config;
+
+  struct hvc_track tracks[HVC_TRACKER_MAX_TRACKS];
+  int track_count;
+  uint32_t next_id;
+
+  // Detections dropped because every track slot was taken
+  uint32_t overflow;
+
+  // Overlap of every track with every detection of the current frame
+  uint8_t scores[HVC_TRACKER_MAX_TRACKS][HVC_MAX_BODIES];
+
+  hvc_tracker_cb cb;
+  void* ctx;
+};
+
+void hvc_tracker_init(struct hvc_tracker* tracker, const struct hvc_tracker_config* config, hvc_tracker_cb cb, void* ctx);
+
+/*
+ * Feed the bodies or faces of a detection taken at time_ms. Events are
+ * raised from within the call.
+ */
+void hvc_tracker_update(struct hvc_tracker* tracker, const struct hvc_execution_response* res, int64_t time_ms);
+
+/*
+ * Confirmed tracks, the current occupancy
+ */
+int hvc_tracker_count(const struct hvc_tracker* tracker);
+
+/*
+ * Drop every track, confirmed ones leave first
+ */
+void hvc_tracker_reset(struct hvc_tracker* tracker);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -5,8 +5,6 @@
 extern "C" {
 #endif /* __cplusplus */
 
-char* util_terminate_string(char* arr, int arr_size);
-
 void util_slice(char* arr, char* dest, int start, int offset);
 
 int util_bytes_to_int(char lsb, char msb);
@@ -6,6 +6,17 @@ extern "C" {
 #endif /* __cplusplus */
 
 #include "mgos.h"
+#include "hvc_frames.h"
+#include "hvc_metrics.h"
+#include "hvc_presence.h"
+#include "hvc_response.h"
+#include "hvc_tracker.h"
+
+/*
+ * Number of sensors that can be attached. The ESP32 has three UARTs,
+ * the first one is taken by the console.
+ */
+#define MGOS_HVC_MAX_SENSORS 2
 
 /*
  * Define the RX buffer.
@@ -14,16 +25,66 @@ extern "C" {
 #define HVC_UART_BUFFER_SIZE 4096
 
 /*
- * Define how often we will attempt to detect humans
+ * Number of UART driver events we queue up. The events are only used
+ * to wake up a task waiting for response bytes.
+ */
+#define HVC_UART_QUEUE_SIZE 16
+
+/*
+ * Delay before the first detection, after that the scheduler
+ * (hvc.scheduler.*) decides how often we attempt to detect humans
  */
 #define HVC_EXECUTION_INTERVAL 100
 
 /*
- * Proxy log buffer size. Messages can't exceed this
- * length or the will miss characters.
+ * How often the asynchronous engine is polled from the Mongoose OS
+ * event loop when hvc.async is enabled
+ */
+#define HVC_ASYNC_POLL_INTERVAL 10
+
+/*
+ * How often a sensor that was just powered on is asked whether it is up
+ */
+#define HVC_POWER_POLL_INTERVAL 50
+
+/*
+ * Detection frames kept per sensor for consumers reading at their own pace
+ */
+#define MGOS_HVC_FRAME_RING_SIZE 4
+
+/*
+ * Where debug images are written, one file per sensor
+ */
+#define HVC_DEBUG_IMAGE_PATH   "/debug.img"
+#define HVC_DEBUG_IMAGE_PATH_2 "/debug2.img"
+
+/*
+ * Debug images are captured as QVGA_HALF
+ */
+#define MGOS_HVC_DEBUG_IMAGE_WIDTH  160
+#define MGOS_HVC_DEBUG_IMAGE_HEIGHT 120
+
+/*
+ * HVC.Trace saves the trace ring of a sensor here, %d is the sensor
+ */
+#define MGOS_HVC_TRACE_PATH "/hvc_trace%d.bin"
+
+/*
+ * hvc.record captures the raw UART traffic of a sensor here, %d is the
+ * sensor
+ */
+#define MGOS_HVC_RECORD_PATH "/hvc_record%d.bin"
+
+/*
+ * Proxy log buffer size. Longer messages are truncated.
  */
 #define MGOS_HVC_LOG_BUFFER 100
 
+/*
+ * Retries per setting before init gives up and restarts
+ */
+#define MGOS_HVC_CONFIG_RETRY 3
+
 /*
  * Macro to check if HVC SET calls succeeded or not
  */
@@ -43,7 +104,61 @@ extern "C" {
 
 enum {
   MGOS_HVC_EVENT_DETECTION = MGOS_HVC_EVENT_BASE,
-  MGOS_HVC_EVENT_INIT
+  MGOS_HVC_EVENT_INIT,
+  MGOS_HVC_EVENT_TRACK,
+  MGOS_HVC_EVENT_PRESENCE
+};
+
+/*
+ * Event data. sensor is 0 for the hvc.* sensor and 1 for hvc.sensor2,
+ * the response is only valid for the duration of the event dispatch.
+ */
+struct mgos_hvc_detection_event
+{
+  int sensor;
+  struct hvc_execution_response* res;
+};
+
+struct mgos_hvc_init_event
+{
+  int sensor;
+  struct hvc_get_version_response* version;
+
+  // Milliseconds from the start of init until the sensor was configured
+  int time_to_ready;
+};
+
+/*
+ * A body or face track entered, moved or left. count is the number of
+ * confirmed tracks of that kind after the event, the track is only valid
+ * for the duration of the event dispatch.
+ */
+struct mgos_hvc_track_event
+{
+  int sensor;
+
+  // HVC_TRACK_BODIES or HVC_TRACK_FACES
+  int kind;
+
+  // HVC_TRACK_ENTER, HVC_TRACK_UPDATE or HVC_TRACK_LEAVE
+  int event;
+  int count;
+  const struct hvc_track* track;
+};
+
+/*
+ * The scene became occupied or vacant, or the number of people changed.
+ * count is the number of people after the event, duration the
+ * milliseconds the previous occupied or vacant period lasted.
+ */
+struct mgos_hvc_presence_event
+{
+  int sensor;
+
+  // HVC_PRESENCE_OCCUPIED, HVC_PRESENCE_VACANT or HVC_PRESENCE_COUNT
+  int event;
+  int count;
+  int duration;
 };
 
 /*
@@ -52,6 +167,18 @@ enum {
  */
 void mgos_hvc_init();
 
+/*
+ * Frame ring of a sensor, attach a reader with hvc_frame_reader_init.
+ * NULL if the sensor is not enabled.
+ */
+struct hvc_frame_ring* mgos_hvc_get_frames(int sensor);
+
+/*
+ * Latency and error counters of a sensor, also served over RPC as
+ * HVC.Metrics. NULL if the sensor is not enabled.
+ */
+struct hvc_metrics* mgos_hvc_get_metrics(int sensor);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
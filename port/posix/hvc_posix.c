@@ -0,0 +1,391 @@
+/**
+ * POSIX implementation of the HVC transport. Allows the library to
+ * run on Linux against a serial device or a simulated sensor.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/serial.h>
+#endif
+#include "hvc.h"
+#include "hvc_posix.h"
+
+static int hvc_posix_log_level = HVC_POSIX_LOG_INFO;
+
+static long _hvc_posix_now_ms()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int64_t _hvc_posix_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t _hvc_posix_clock(void* ctx)
+{
+  (void) ctx;
+
+  return _hvc_posix_now_us();
+}
+
+static void _hvc_posix_log(int level, const char* prefix, const char* format, va_list ap)
+{
+  if (level > hvc_posix_log_level) return;
+
+  fprintf(stderr, "%s ", prefix);
+  vfprintf(stderr, format, ap);
+  fprintf(stderr, "\n");
+}
+
+/*
+ * Pull whatever the descriptor has into the staging buffer, waiting at
+ * most timeout_ms for something to arrive. Returns the number of bytes
+ * added to the buffer.
+ */
+static int _hvc_posix_fill(struct hvc_posix* port, int timeout_ms)
+{
+  // Compact the buffer so we always have room at the end
+  if (port->rx_start > 0)
+  {
+    memmove(port->rx_buffer, port->rx_buffer + port->rx_start, port->rx_end - port->rx_start);
+    port->rx_end -= port->rx_start;
+    port->rx_start = 0;
+  }
+
+  if (port->rx_end == sizeof(port->rx_buffer)) return 0;
+
+  struct pollfd pfd = { .fd = port->fd, .events = POLLIN };
+
+  if (poll(&pfd, 1, timeout_ms) <= 0) return 0;
+
+  int received = read(port->fd, port->rx_buffer + port->rx_end, sizeof(port->rx_buffer) - port->rx_end);
+
+  if (received < 0)
+  {
+    if (errno != EAGAIN && errno != EINTR)
+    {
+      HVC_LOG_ERROR("Unable to read from descriptor: %s", strerror(errno));
+    }
+
+    return 0;
+  }
+
+  port->rx_end += received;
+  return received;
+}
+
+void hvc_posix_set_log_level(int level)
+{
+  hvc_posix_log_level = level;
+  hvc_log_set_level(level);
+}
+
+void hvc_log_debug(const char* format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  _hvc_posix_log(HVC_POSIX_LOG_DEBUG, "[hvc debug]", format, ap);
+  va_end(ap);
+}
+
+void hvc_log_info(const char* format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  _hvc_posix_log(HVC_POSIX_LOG_INFO, "[hvc info]", format, ap);
+  va_end(ap);
+}
+
+void hvc_log_error(const char* format, ...)
+{
+  va_list ap;
+  va_start(ap, format);
+  _hvc_posix_log(HVC_POSIX_LOG_ERROR, "[hvc error]", format, ap);
+  va_end(ap);
+}
+
+static int _hvc_posix_available(void* ctx)
+{
+  struct hvc_posix* port = (struct hvc_posix*) ctx;
+
+  // Non blocking, just collect what the kernel already has
+  _hvc_posix_fill(port, 0);
+
+  return port->rx_end - port->rx_start;
+}
+
+static int _hvc_posix_wait(void* ctx, int length, int timeout_ms)
+{
+  struct hvc_posix* port = (struct hvc_posix*) ctx;
+  long deadline = _hvc_posix_now_ms() + timeout_ms;
+
+  while (_hvc_posix_available(port) < length)
+  {
+    // Staging buffer is full, nothing more will fit
+    if (port->rx_end - port->rx_start == HVC_POSIX_RX_BUFFER_SIZE) break;
+
+    long remaining = deadline - _hvc_posix_now_ms();
+
+    if (remaining <= 0) break;
+
+    _hvc_posix_fill(port, remaining);
+  }
+
+  return port->rx_end - port->rx_start;
+}
+
+static void _hvc_posix_sleep(void* ctx, int ms)
+{
+  (void) ctx;
+
+  struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (ms % 1000) * 1000000L };
+  nanosleep(&ts, NULL);
+}
+
+static speed_t _hvc_posix_speed(int baudrate)
+{
+  switch (baudrate)
+  {
+    case 9600: return B9600;
+    case 38400: return B38400;
+    case 115200: return B115200;
+    case 230400: return B230400;
+#ifdef B460800
+    case 460800: return B460800;
+#endif
+#ifdef B921600
+    case 921600: return B921600;
+#endif
+    default: return B0;
+  }
+}
+
+static bool _hvc_posix_set_baudrate(void* ctx, int baudrate)
+{
+  struct hvc_posix* port = (struct hvc_posix*) ctx;
+  struct termios tty;
+
+  // Not a terminal (socketpair, pipe), there is no rate to change
+  if (tcgetattr(port->fd, &tty) < 0) return true;
+
+  speed_t speed = _hvc_posix_speed(baudrate);
+
+  if (speed == B0)
+  {
+    HVC_LOG_ERROR("Unsupported baudrate %d", baudrate);
+    return false;
+  }
+
+  // Let pending writes go out at the old rate
+  tcdrain(port->fd);
+
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+
+  if (tcsetattr(port->fd, TCSANOW, &tty) < 0)
+  {
+    HVC_LOG_ERROR("Unable to set baudrate %d: %s", baudrate, strerror(errno));
+    return false;
+  }
+
+  // Anything received so far was at the wrong rate
+  tcflush(port->fd, TCIFLUSH);
+  port->rx_start = 0;
+  port->rx_end = 0;
+
+  return true;
+}
+
+static int _hvc_posix_read(void* ctx, char* data, int length, int timeout_ms)
+{
+  struct hvc_posix* port = (struct hvc_posix*) ctx;
+  long deadline = _hvc_posix_now_ms() + timeout_ms;
+  int read = 0;
+
+  while (read < length)
+  {
+    if (port->rx_end == port->rx_start)
+    {
+      long remaining = deadline - _hvc_posix_now_ms();
+
+      if (remaining <= 0 || !_hvc_posix_fill(port, remaining)) break;
+    }
+
+    int chunk = port->rx_end - port->rx_start;
+
+    if (chunk > length - read) chunk = length - read;
+
+    memcpy(data + read, port->rx_buffer + port->rx_start, chunk);
+    port->rx_start += chunk;
+    read += chunk;
+  }
+
+  if (read != length)
+  {
+    HVC_LOG_ERROR("Could not read requested bytes %d/%d", read, length);
+  }
+
+  return read;
+}
+
+static int _hvc_posix_write(void* ctx, const char* data, int length)
+{
+  struct hvc_posix* port = (struct hvc_posix*) ctx;
+  int written = 0;
+
+  while (written < length)
+  {
+    int res = write(port->fd, data + written, length - written);
+
+    if (res < 0)
+    {
+      if (errno == EINTR) continue;
+
+      // Non blocking descriptor with a full transmit buffer
+      if (errno == EAGAIN)
+      {
+        struct pollfd pfd = { .fd = port->fd, .events = POLLOUT };
+
+        if (poll(&pfd, 1, HVC_RESPONSE_TIMEOUT) > 0) continue;
+      }
+
+      break;
+    }
+
+    written += res;
+  }
+
+  if (written != length)
+  {
+    HVC_LOG_ERROR("Unable to write requested bytes %d/%d", written, length);
+  }
+
+  return written;
+}
+
+void hvc_posix_init(struct hvc_posix* port, int fd, struct hvc_transport* transport)
+{
+  port->fd = fd;
+  port->rx_start = 0;
+  port->rx_end = 0;
+
+  transport->read = _hvc_posix_read;
+  transport->write = _hvc_posix_write;
+  transport->available = _hvc_posix_available;
+  transport->wait = _hvc_posix_wait;
+  transport->sleep = _hvc_posix_sleep;
+  transport->set_baudrate = _hvc_posix_set_baudrate;
+  transport->clock = _hvc_posix_clock;
+  transport->ctx = port;
+
+  hvc_log_set_clock(_hvc_posix_now_us);
+}
+
+/*
+ * Ask the driver to hand over received bytes right away. Only serial
+ * drivers support it, a pty or a driver without the flag keeps its
+ * default timing.
+ */
+static void _hvc_posix_low_latency(struct hvc_posix* port)
+{
+#if defined(__linux__) && defined(TIOCGSERIAL)
+  struct serial_struct serial;
+
+  if (ioctl(port->fd, TIOCGSERIAL, &serial) < 0) return;
+
+  serial.flags |= ASYNC_LOW_LATENCY;
+
+  if (ioctl(port->fd, TIOCSSERIAL, &serial) < 0)
+  {
+    HVC_LOG_DEBUG("Low latency mode not supported: %s", strerror(errno));
+  }
+#endif
+}
+
+int hvc_posix_open(struct hvc_posix* port, const char* path, int baudrate, struct hvc_transport* transport)
+{
+  struct termios tty;
+  speed_t speed = _hvc_posix_speed(baudrate);
+
+  if (speed == B0)
+  {
+    HVC_LOG_ERROR("Unsupported baudrate %d", baudrate);
+    return HVC_ERR_ARGS;
+  }
+
+  int fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+
+  if (fd < 0)
+  {
+    HVC_LOG_ERROR("Unable to open %s: %s", path, strerror(errno));
+    return HVC_ERR_ARGS;
+  }
+
+  if (tcgetattr(fd, &tty) < 0)
+  {
+    HVC_LOG_ERROR("%s is not a terminal: %s", path, strerror(errno));
+    close(fd);
+    return HVC_ERR_ARGS;
+  }
+
+  // A second process on the link would steal responses
+  ioctl(fd, TIOCEXCL);
+
+  // Raw 8N1 without flow control, modem lines ignored
+  cfmakeraw(&tty);
+  tty.c_cflag |= CLOCAL | CREAD;
+  tty.c_cflag &= ~(CSTOPB | CSIZE);
+  tty.c_cflag |= CS8;
+#ifdef CRTSCTS
+  tty.c_cflag &= ~CRTSCTS;
+#endif
+
+  // Reads return what is there, the deadline is kept by poll()
+  tty.c_cc[VMIN] = 0;
+  tty.c_cc[VTIME] = 0;
+
+  cfsetispeed(&tty, speed);
+  cfsetospeed(&tty, speed);
+
+  if (tcsetattr(fd, TCSANOW, &tty) < 0)
+  {
+    HVC_LOG_ERROR("Unable to configure %s: %s", path, strerror(errno));
+    close(fd);
+    return HVC_ERR_ARGS;
+  }
+
+  // Drop whatever was received before the port was set up
+  tcflush(fd, TCIOFLUSH);
+
+  hvc_posix_init(port, fd, transport);
+  _hvc_posix_low_latency(port);
+
+  HVC_LOG_INFO("Opened %s at %d baud", path, baudrate);
+
+  return HVC_OK;
+}
+
+void hvc_posix_close(struct hvc_posix* port)
+{
+  if (port->fd < 0) return;
+
+  close(port->fd);
+  port->fd = -1;
+  port->rx_start = 0;
+  port->rx_end = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef HVC_POSIX_H
+#define HVC_POSIX_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include "hvc.h"
+
+/*
+ * Receive staging buffer. Bytes are pulled off the file descriptor
+ * into this buffer while waiting so poll() only wakes on new data.
+ */
+#define HVC_POSIX_RX_BUFFER_SIZE 4096
+
+/*
+ * Log levels, messages above the configured level are dropped
+ */
+#define HVC_POSIX_LOG_ERROR 0
+#define HVC_POSIX_LOG_INFO  1
+#define HVC_POSIX_LOG_DEBUG 2
+
+/*
+ * One serial link. Bytes are staged in [rx_start, rx_end) of rx_buffer.
+ */
+struct hvc_posix
+{
+  int fd;
+  char rx_buffer[HVC_POSIX_RX_BUFFER_SIZE];
+  int rx_start;
+  int rx_end;
+};
+
+/*
+ * Attach a link to an open file descriptor and fill in the transport
+ * for hvc_device_init. The descriptor can be a serial device, a pty or
+ * one end of a socketpair driven by a simulator. Register port->fd with
+ * an epoll/poll loop to drive the asynchronous engine.
+ */
+void hvc_posix_init(struct hvc_posix* port, int fd, struct hvc_transport* transport);
+
+/*
+ * Open a serial device (/dev/ttyUSB0, /dev/ttyAMA0, ...) in raw 8N1
+ * mode at baudrate and attach it like hvc_posix_init. The device is
+ * opened non blocking with VMIN = VTIME = 0, reads never wait in the
+ * driver and all waiting happens in poll() with the library deadline.
+ * On Linux the low latency flag is requested as well, USB adapters
+ * otherwise hold received bytes for up to 16 ms. Returns HVC_OK or
+ * HVC_ERR_ARGS if the device can't be opened or configured.
+ */
+int hvc_posix_open(struct hvc_posix* port, const char* path, int baudrate, struct hvc_transport* transport);
+
+void hvc_posix_close(struct hvc_posix* port);
+
+void hvc_posix_set_log_level(int level);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
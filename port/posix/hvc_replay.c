@@ -0,0 +1,340 @@
+/**
+ * Replay transport, feeds a recorded UART session back to the library
+ * at the recorded pace, scaled or as fast as the parser goes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "hvc.h"
+#include "hvc_posix.h"
+#include "hvc_replay.h"
+
+static int64_t _hvc_replay_now_us()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t _hvc_replay_get_u32(const char* in)
+{
+  return (uint8_t) in[0] | ((uint8_t) in[1] << 8) | ((uint8_t) in[2] << 16) | ((uint32_t) (uint8_t) in[3] << 24);
+}
+
+static int _hvc_replay_get_u16(const char* in)
+{
+  return (uint8_t) in[0] | ((uint8_t) in[1] << 8);
+}
+
+/*
+ * Decode the record at pos, false past the end of the recording
+ */
+static bool _hvc_replay_record(const struct hvc_replay* replay, int pos, int* type, int* length, uint32_t* delta)
+{
+  if (pos + HVC_RECORD_HEADER > replay->size) return false;
+
+  const char* header = replay->data + pos;
+
+  *type = (uint8_t) header[0];
+  *length = _hvc_replay_get_u16(header + 1);
+  *delta = _hvc_replay_get_u32(header + 3);
+
+  return true;
+}
+
+/*
+ * Move the cursor to the next record
+ */
+static void _hvc_replay_advance(struct hvc_replay* replay)
+{
+  int type, length;
+  uint32_t delta;
+
+  if (!_hvc_replay_record(replay, replay->pos, &type, &length, &delta)) return;
+
+  replay->pos += HVC_RECORD_HEADER + length;
+  replay->consumed = 0;
+
+  if (_hvc_replay_record(replay, replay->pos, &type, &length, &delta)) replay->time += delta;
+}
+
+/*
+ * Recorded time the session has reached
+ */
+static int64_t _hvc_replay_session(const struct hvc_replay* replay)
+{
+  if (replay->speed == HVC_REPLAY_MAX_SPEED) return INT64_MAX;
+
+  return replay->base_record + (_hvc_replay_now_us() - replay->base_real) * replay->speed / 100;
+}
+
+/*
+ * Received bytes that are due, up to length. Copies them to data and
+ * moves the cursor past them unless data is NULL. next is set to the
+ * recorded time of the first received bytes that aren't due yet, or -1
+ * if nothing more arrives before the next command.
+ */
+static int _hvc_replay_rx(struct hvc_replay* replay, char* data, int length, int64_t* next)
+{
+  int64_t now = _hvc_replay_session(replay);
+  int pos = replay->pos;
+  int consumed = replay->consumed;
+  int64_t time = replay->time;
+  int total = 0;
+  int type, record_length;
+  uint32_t delta;
+
+  *next = -1;
+
+  while (total < length && _hvc_replay_record(replay, pos, &type, &record_length, &delta) && type == HVC_RECORD_RX)
+  {
+    if (time > now)
+    {
+      *next = time;
+      break;
+    }
+
+    int chunk = record_length - consumed;
+
+    if (chunk > length - total) chunk = length - total;
+
+    if (data)
+    {
+      memcpy(data + total, replay->data + pos + HVC_RECORD_HEADER + consumed, chunk);
+      replay->consumed += chunk;
+
+      if (replay->consumed == record_length) _hvc_replay_advance(replay);
+    }
+
+    total += chunk;
+    consumed += chunk;
+
+    if (consumed < record_length) break;
+
+    pos += HVC_RECORD_HEADER + record_length;
+    consumed = 0;
+
+    if (_hvc_replay_record(replay, pos, &type, &record_length, &delta)) time += delta;
+  }
+
+  return total;
+}
+
+static int _hvc_replay_available(void* ctx)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+  int64_t next;
+
+  return _hvc_replay_rx(replay, NULL, INT32_MAX, &next);
+}
+
+static int _hvc_replay_wait(void* ctx, int length, int timeout_ms)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+  int64_t deadline = _hvc_replay_now_us() + (int64_t) timeout_ms * 1000;
+  int64_t next;
+
+  for (;;)
+  {
+    int available = _hvc_replay_rx(replay, NULL, INT32_MAX, &next);
+
+    // Nothing more arrives before the next command, waiting won't help
+    if (available >= length || next < 0) return available;
+
+    int64_t due = replay->base_real + (next - replay->base_record) * 100 / replay->speed;
+    int64_t now = _hvc_replay_now_us();
+
+    if (now >= deadline) return available;
+
+    int64_t sleep = (due < deadline ? due : deadline) - now;
+
+    if (sleep > 0)
+    {
+      struct timespec ts = { .tv_sec = sleep / 1000000, .tv_nsec = (sleep % 1000000) * 1000 };
+      nanosleep(&ts, NULL);
+    }
+  }
+}
+
+static int _hvc_replay_read(void* ctx, char* data, int length, int timeout_ms)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+  int64_t next;
+
+  _hvc_replay_wait(replay, length, timeout_ms);
+
+  int read = _hvc_replay_rx(replay, data, length, &next);
+
+  if (read != length)
+  {
+    HVC_LOG_ERROR("Could not read requested bytes %d/%d", read, length);
+  }
+
+  return read;
+}
+
+static int _hvc_replay_write(void* ctx, const char* data, int length)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+  int type, record_length = 0;
+  uint32_t delta;
+
+  replay->commands++;
+
+  // Whatever the library didn't read before this command was lost
+  while (_hvc_replay_record(replay, replay->pos, &type, &record_length, &delta) && type != HVC_RECORD_TX)
+  {
+    if (type == HVC_RECORD_RX) replay->skipped += record_length - replay->consumed;
+
+    _hvc_replay_advance(replay);
+  }
+
+  if (replay->pos >= replay->size)
+  {
+    HVC_LOG_ERROR("Recording ended before command %02x", length > 1 ? (uint8_t) data[1] : 0);
+    replay->mismatches++;
+    return length;
+  }
+
+  const char* recorded = replay->data + replay->pos + HVC_RECORD_HEADER;
+
+  if (record_length != length || memcmp(recorded, data, length) != 0)
+  {
+    HVC_LOG_ERROR("Command %02x differs from the recorded %02x",
+      length > 1 ? (uint8_t) data[1] : 0, record_length > 1 ? (uint8_t) recorded[1] : 0);
+    replay->mismatches++;
+  }
+
+  // The response timing counts from the command
+  replay->base_record = replay->time;
+  replay->base_real = _hvc_replay_now_us();
+
+  _hvc_replay_advance(replay);
+
+  return length;
+}
+
+static void _hvc_replay_sleep(void* ctx, int ms)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+
+  if (replay->speed == HVC_REPLAY_MAX_SPEED) return;
+
+  int64_t us = (int64_t) ms * 1000 * 100 / replay->speed;
+  struct timespec ts = { .tv_sec = us / 1000000, .tv_nsec = (us % 1000000) * 1000 };
+  nanosleep(&ts, NULL);
+}
+
+static bool _hvc_replay_set_baudrate(void* ctx, int baudrate)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+  int type, length;
+  uint32_t delta;
+
+  // The recorded rate change is replayed as is, the rate itself doesn't
+  // matter without a line
+  (void) baudrate;
+
+  if (_hvc_replay_record(replay, replay->pos, &type, &length, &delta) && type == HVC_RECORD_BAUDRATE)
+  {
+    _hvc_replay_advance(replay);
+  }
+
+  return true;
+}
+
+static int64_t _hvc_replay_clock(void* ctx)
+{
+  struct hvc_replay* replay = (struct hvc_replay*) ctx;
+
+  // Flat out the recorded timeline is the only clock that makes sense
+  if (replay->speed == HVC_REPLAY_MAX_SPEED) return replay->time;
+
+  return _hvc_replay_session(replay);
+}
+
+int hvc_replay_open(struct hvc_replay* replay, const char* path, int speed, struct hvc_transport* transport)
+{
+  memset(replay, 0, sizeof(struct hvc_replay));
+
+  FILE* fp = fopen(path, "rb");
+
+  if (!fp)
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", path);
+    return HVC_ERR_ARGS;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  long size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  char* data = size > 0 ? malloc(size) : NULL;
+
+  if (!data || fread(data, 1, size, fp) != (size_t) size)
+  {
+    HVC_LOG_ERROR("Unable to read recording %s", path);
+    fclose(fp);
+    free(data);
+    return HVC_ERR_ARGS;
+  }
+
+  fclose(fp);
+
+  if (size < HVC_RECORD_FILE_HEADER || memcmp(data, HVC_RECORD_MAGIC, 4) != 0 ||
+      _hvc_replay_get_u16(data + 4) != HVC_RECORD_VERSION || _hvc_replay_get_u16(data + 6) != HVC_RECORD_HEADER)
+  {
+    HVC_LOG_ERROR("%s is not a recording", path);
+    free(data);
+    return HVC_ERR_PAYLOAD;
+  }
+
+  replay->data = data;
+  replay->size = size;
+  replay->speed = speed < 0 ? HVC_REPLAY_MAX_SPEED : speed;
+
+  // A recording cut off mid record (power loss, full flash) plays up to
+  // its last complete record
+  int pos = HVC_RECORD_FILE_HEADER;
+  int type, length;
+  uint32_t delta;
+
+  while (_hvc_replay_record(replay, pos, &type, &length, &delta) && pos + HVC_RECORD_HEADER + length <= size)
+  {
+    pos += HVC_RECORD_HEADER + length;
+  }
+
+  if (pos != size) HVC_LOG_INFO("Recording %s truncated after %d bytes", path, pos);
+
+  replay->size = pos;
+  replay->pos = HVC_RECORD_FILE_HEADER;
+
+  if (_hvc_replay_record(replay, replay->pos, &type, &length, &delta)) replay->time = delta;
+
+  replay->base_real = _hvc_replay_now_us();
+
+  transport->read = _hvc_replay_read;
+  transport->write = _hvc_replay_write;
+  transport->available = _hvc_replay_available;
+  transport->wait = _hvc_replay_wait;
+  transport->sleep = _hvc_replay_sleep;
+  transport->set_baudrate = _hvc_replay_set_baudrate;
+  transport->clock = _hvc_replay_clock;
+  transport->ctx = replay;
+
+  return HVC_OK;
+}
+
+bool hvc_replay_done(const struct hvc_replay* replay)
+{
+  return replay->pos >= replay->size;
+}
+
+void hvc_replay_close(struct hvc_replay* replay)
+{
+  free(replay->data);
+  replay->data = NULL;
+  replay->size = 0;
+}
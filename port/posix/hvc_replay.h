@@ -0,0 +1,67 @@
+#ifndef HVC_REPLAY_H
+#define HVC_REPLAY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "hvc.h"
+#include "hvc_record.h"
+
+/*
+ * Replay speeds in percent of the recorded timing. At maximum speed every
+ * response is available as soon as its command is written.
+ */
+#define HVC_REPLAY_ORIGINAL_SPEED 100
+#define HVC_REPLAY_MAX_SPEED      0
+
+/*
+ * Transport that plays a recording made with hvc_recorder_open back to
+ * the library. Each write moves the replay to the next recorded command,
+ * the bytes received after it become readable as their recorded time
+ * comes up, measured from the write. Reads never cross into the next
+ * command's traffic.
+ */
+struct hvc_replay
+{
+  char* data;
+  int size;
+
+  // Record under the cursor, bytes of it already read and its recorded
+  // time in microseconds since the recording started
+  int pos;
+  int consumed;
+  int64_t time;
+
+  // Recorded time that lined up with the monotonic clock at the last write
+  int speed;
+  int64_t base_record;
+  int64_t base_real;
+
+  // Statistics, commands that differ from the recording and received
+  // bytes the library never read
+  int commands;
+  int mismatches;
+  int skipped;
+};
+
+/*
+ * Load the recording at path and fill in the transport for
+ * hvc_device_init. Returns HVC_OK, HVC_ERR_ARGS if the file can't be read
+ * or HVC_ERR_PAYLOAD if it isn't a recording.
+ */
+int hvc_replay_open(struct hvc_replay* replay, const char* path, int speed, struct hvc_transport* transport);
+
+/*
+ * Every recorded record has been played
+ */
+bool hvc_replay_done(const struct hvc_replay* replay);
+
+void hvc_replay_close(struct hvc_replay* replay);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
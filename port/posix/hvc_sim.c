@@ -0,0 +1,558 @@
+/**
+ * Simulated HVC-P (B5T-007001) for exercising the library on Linux. Speaks
+ * the real wire format over a socketpair, with configurable detections,
+ * timing and injected faults.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include "hvc.h"
+#include "hvc_sim.h"
+#include "hvc_util.h"
+
+/*
+ * Bytes sent between two byte_delay_us sleeps
+ */
+#define HVC_SIM_WRITE_CHUNK 64
+
+/*
+ * A host that stops the simulator mid response must not kill the process
+ */
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+static const char hvc_sim_version[HVC_VERSION_SIZE] = {
+  'B', '5', 'T', '-', '0', '0', '7', '0', '0', '1', ' ', ' ',
+  1, 2, 0,
+  0, 0, 0, 0
+};
+
+
+static bool _hvc_sim_read(struct hvc_sim* sim, char* data, int length)
+{
+  int read_bytes = 0;
+
+  while (read_bytes < length)
+  {
+    int res = read(sim->fd, data + read_bytes, length - read_bytes);
+
+    if (res <= 0) return false;
+
+    read_bytes += res;
+  }
+
+  return true;
+}
+
+static void _hvc_sim_sleep_ns(long ns)
+{
+  struct timespec ts = { .tv_sec = ns / 1000000000L, .tv_nsec = ns % 1000000000L };
+  nanosleep(&ts, NULL);
+}
+
+static void _hvc_sim_write(struct hvc_sim* sim, const char* data, int length)
+{
+  long byte_ns = sim->config.emulate_baudrate
+    ? 10000000000L / hvc_baudrate_value(sim->baudrate)
+    : sim->config.byte_delay_us * 1000L;
+
+  int chunk = byte_ns ? HVC_SIM_WRITE_CHUNK : length;
+
+  for (int offset = 0; offset < length; offset += chunk)
+  {
+    int size = length - offset < chunk ? length - offset : chunk;
+
+    if (send(sim->fd, data + offset, size, MSG_NOSIGNAL) != size) return;
+
+    if (byte_ns) _hvc_sim_sleep_ns(size * byte_ns);
+  }
+}
+
+static int _hvc_sim_rand(struct hvc_sim* sim, int max)
+{
+  return rand_r(&sim->config.seed) % max;
+}
+
+static char* _hvc_sim_int16(char* out, int value)
+{
+  util_int_into_lsb_msb(out, 0, value);
+  return out + 2;
+}
+
+static char* _hvc_sim_detection(struct hvc_sim* sim, char* out)
+{
+  out = _hvc_sim_int16(out, 40 + _hvc_sim_rand(sim, 1520));
+  out = _hvc_sim_int16(out, 40 + _hvc_sim_rand(sim, 1120));
+  out = _hvc_sim_int16(out, 60 + _hvc_sim_rand(sim, 400));
+  out = _hvc_sim_int16(out, 500 + _hvc_sim_rand(sim, 500));
+
+  return out;
+}
+
+static char* _hvc_sim_face(struct hvc_sim* sim, char* out, int function)
+{
+  out = _hvc_sim_detection(sim, out);
+
+  if (function & HVC_EX_FACE_DIRECTION)
+  {
+    out = _hvc_sim_int16(out, _hvc_sim_rand(sim, 60) - 30);
+    out = _hvc_sim_int16(out, _hvc_sim_rand(sim, 40) - 20);
+    out = _hvc_sim_int16(out, _hvc_sim_rand(sim, 30) - 15);
+    out = _hvc_sim_int16(out, 500 + _hvc_sim_rand(sim, 500));
+  }
+
+  if (function & HVC_EX_AGE_ESTIMATION)
+  {
+    *out++ = 18 + _hvc_sim_rand(sim, 50);
+    out = _hvc_sim_int16(out, 500 + _hvc_sim_rand(sim, 500));
+  }
+
+  if (function & HVC_EX_GENDER_ESTIMATION)
+  {
+    *out++ = _hvc_sim_rand(sim, 2);
+    out = _hvc_sim_int16(out, 500 + _hvc_sim_rand(sim, 500));
+  }
+
+  if (function & HVC_EX_GAZE_ESTIMATION)
+  {
+    *out++ = _hvc_sim_rand(sim, 20) - 10;
+    *out++ = _hvc_sim_rand(sim, 20) - 10;
+  }
+
+  if (function & HVC_EX_BLINK_ESTIMATION)
+  {
+    out = _hvc_sim_int16(out, 1 + _hvc_sim_rand(sim, 1000));
+    out = _hvc_sim_int16(out, 1 + _hvc_sim_rand(sim, 1000));
+  }
+
+  if (function & HVC_EX_EXPRESSION_ESTIMATION)
+  {
+    int left = 100;
+
+    for (int i = 0; i < 4; i++)
+    {
+      int score = _hvc_sim_rand(sim, left + 1);
+      *out++ = score;
+      left -= score;
+    }
+
+    *out++ = left;
+    *out++ = _hvc_sim_rand(sim, 200) - 100;
+  }
+
+  if (function & HVC_EX_FACE_RECOGNITION)
+  {
+    out = _hvc_sim_int16(out, HVC_USER_NOT_RECOGNIZED);
+    out = _hvc_sim_int16(out, 0);
+  }
+
+  return out;
+}
+
+static int _hvc_sim_clamp(int value)
+{
+  if (value < 0) return 0;
+  if (value > HVC_MAX_FACES) return HVC_MAX_FACES;
+
+  return value;
+}
+
+/*
+ * Build the execution payload into out, returns its length
+ */
+static int _hvc_sim_execute(struct hvc_sim* sim, const char* data, char* out)
+{
+  int function = util_bytes_to_int(data[0], data[1]);
+  int image = data[2];
+
+  if (sim->config.compute_delay_ms) _hvc_sim_sleep_ns(sim->config.compute_delay_ms * 1000000L);
+
+  int bodies = (function & HVC_EX_BODY_DETECTION) ? _hvc_sim_clamp(sim->config.bodies) : 0;
+  int hands = (function & HVC_EX_HAND_DETECTION) ? _hvc_sim_clamp(sim->config.hands) : 0;
+  int faces = (function & (HVC_EX_FACE_DETECTION | HVC_EX_FACE_DIRECTION | HVC_EX_AGE_ESTIMATION |
+    HVC_EX_GENDER_ESTIMATION | HVC_EX_GAZE_ESTIMATION | HVC_EX_BLINK_ESTIMATION |
+    HVC_EX_EXPRESSION_ESTIMATION | HVC_EX_FACE_RECOGNITION)) ? _hvc_sim_clamp(sim->config.faces) : 0;
+
+  char* start = out;
+
+  *out++ = bodies;
+  *out++ = hands;
+  *out++ = faces;
+  *out++ = 0;
+
+  for (int i = 0; i < bodies; i++) out = _hvc_sim_detection(sim, out);
+  for (int i = 0; i < hands; i++) out = _hvc_sim_detection(sim, out);
+  for (int i = 0; i < faces; i++) out = _hvc_sim_face(sim, out, function);
+
+  if (image == HVC_EX_IMAGE_QVGA || image == HVC_EX_IMAGE_QVGA_HALF)
+  {
+    int scale = image == HVC_EX_IMAGE_QVGA ? 1 : 2;
+    int width = HVC_SIM_QVGA_WIDTH / scale;
+    int height = HVC_SIM_QVGA_HEIGHT / scale;
+
+    out = _hvc_sim_int16(out, width);
+    out = _hvc_sim_int16(out, height);
+
+    // Gradient with some noise, enough structure for image processing
+    for (int y = 0; y < height; y++)
+    {
+      for (int x = 0; x < width; x++)
+      {
+        *out++ = (x + y) + _hvc_sim_rand(sim, 8);
+      }
+    }
+  }
+
+  return out - start;
+}
+
+/*
+ * Build the 64x64 face image a registration answers with
+ */
+static int _hvc_sim_register(struct hvc_sim* sim, char* out)
+{
+  char* start = out;
+
+  out = _hvc_sim_int16(out, HVC_SIM_FACE_SIZE);
+  out = _hvc_sim_int16(out, HVC_SIM_FACE_SIZE);
+
+  for (int i = 0; i < HVC_SIM_FACE_SIZE * HVC_SIM_FACE_SIZE; i++) *out++ = _hvc_sim_rand(sim, 256);
+
+  return out - start;
+}
+
+static int _hvc_sim_save_album(struct hvc_sim* sim, char* out)
+{
+  int count = 0;
+
+  memset(out, 0, HVC_ALBUM_SIZE_MIN);
+
+  for (int user = 0; user < HVC_ALBUM_MAX_USERS; user++)
+  {
+    if (!sim->users[user]) continue;
+
+    char* record = out + HVC_ALBUM_SIZE_MIN + count++ * HVC_SIM_ALBUM_USER_SIZE;
+
+    util_int_into_lsb_msb(record, 0, user);
+    util_int_into_lsb_msb(record, 2, sim->users[user]);
+
+    // Stand in for the face features
+    for (int i = 4; i < HVC_SIM_ALBUM_USER_SIZE; i++) record[i] = user + i;
+  }
+
+  util_int_into_lsb_msb(out, 0, count);
+  return HVC_ALBUM_SIZE_MIN + count * HVC_SIM_ALBUM_USER_SIZE;
+}
+
+/*
+ * The album follows the load command, read it in and replace the users
+ */
+static int _hvc_sim_load_album(struct hvc_sim* sim, const char* data, int data_size, char* album)
+{
+  if (data_size != 4) return HVC_SIM_CODE_INVALID;
+
+  int size = util_bytes_to_int(data[0], data[1]) + (util_bytes_to_int(data[2], data[3]) << 16);
+
+  if (size < HVC_ALBUM_SIZE_MIN || size > HVC_ALBUM_SIZE_MAX) return HVC_SIM_CODE_INVALID;
+
+  if (!_hvc_sim_read(sim, album, size)) return HVC_SIM_CODE_INTERNAL_ERROR;
+
+  int count = util_bytes_to_int(album[0], album[1]);
+
+  if (count > HVC_ALBUM_MAX_USERS || size != HVC_ALBUM_SIZE_MIN + count * HVC_SIM_ALBUM_USER_SIZE) return HVC_SIM_CODE_INVALID;
+
+  memset(sim->users, 0, sizeof(sim->users));
+
+  for (int i = 0; i < count; i++)
+  {
+    const char* record = album + HVC_ALBUM_SIZE_MIN + i * HVC_SIM_ALBUM_USER_SIZE;
+    int user = util_bytes_to_int(record[0], record[1]);
+
+    if (user < HVC_ALBUM_MAX_USERS) sim->users[user] = util_bytes_to_int(record[2], record[3]);
+  }
+
+  return HVC_SIM_CODE_OK;
+}
+
+/*
+ * Run a command against the device state. Fills the payload and
+ * returns the response code.
+ */
+static int _hvc_sim_command(struct hvc_sim* sim, char cmd, const char* data, int data_size, char* out, int* length)
+{
+  *length = 0;
+
+  switch (cmd)
+  {
+    case HVC_CMD_GET_VERSION:
+      memcpy(out, hvc_sim_version, sizeof(hvc_sim_version));
+      *length = sizeof(hvc_sim_version);
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SET_CAMERA_ANGLE:
+      if (data_size != 1 || data[0] > HVC_CAMERA_ANGLE_270) return HVC_SIM_CODE_INVALID;
+
+      sim->camera_angle = data[0];
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_GET_CAMERA_ANGLE:
+      out[0] = sim->camera_angle;
+      *length = 1;
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_EXECUTE:
+      if (data_size != 3) return HVC_SIM_CODE_INVALID;
+
+      *length = _hvc_sim_execute(sim, data, out);
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SET_THRESHOLD_VALUES:
+      if (data_size != 8) return HVC_SIM_CODE_INVALID;
+
+      for (int i = 0; i < 4; i++) sim->thresholds[i] = util_bytes_to_int(data[i * 2], data[i * 2 + 1]);
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_GET_THRESHOLD_VALUES:
+      for (int i = 0; i < 4; i++) util_int_into_lsb_msb(out, i * 2, sim->thresholds[i]);
+      *length = 8;
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SET_DETECTION_SIZE:
+      if (data_size != 12) return HVC_SIM_CODE_INVALID;
+
+      for (int i = 0; i < 6; i++) sim->detection_size[i] = util_bytes_to_int(data[i * 2], data[i * 2 + 1]);
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_GET_DETECTION_SIZE:
+      for (int i = 0; i < 6; i++) util_int_into_lsb_msb(out, i * 2, sim->detection_size[i]);
+      *length = 12;
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SET_FACE_ANGLE:
+      if (data_size != 2) return HVC_SIM_CODE_INVALID;
+
+      sim->face_angle[0] = data[0];
+      sim->face_angle[1] = data[1];
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_GET_FACE_ANGLE:
+      out[0] = sim->face_angle[0];
+      out[1] = sim->face_angle[1];
+      *length = 2;
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SET_BAUDRATE:
+      if (data_size != 1 || data[0] < 0 || data[0] >= HVC_BAUD_COUNT) return HVC_SIM_CODE_INVALID;
+
+      // Switched once the acknowledgement went out at the old rate
+      sim->next_baudrate = data[0];
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_REGISTER_DATA:
+    case HVC_CMD_DELETE_DATA:
+    {
+      if (data_size != 3) return HVC_SIM_CODE_INVALID;
+
+      int user = util_bytes_to_int(data[0], data[1]);
+      int data_id = data[2];
+
+      if (user >= HVC_ALBUM_MAX_USERS || data_id < 0 || data_id >= HVC_ALBUM_MAX_DATA) return HVC_SIM_CODE_INVALID;
+
+      if (cmd == HVC_CMD_DELETE_DATA)
+      {
+        sim->users[user] &= ~(1 << data_id);
+        return HVC_SIM_CODE_OK;
+      }
+
+      if (sim->config.compute_delay_ms) _hvc_sim_sleep_ns(sim->config.compute_delay_ms * 1000000L);
+
+      sim->users[user] |= 1 << data_id;
+      *length = _hvc_sim_register(sim, out);
+      return HVC_SIM_CODE_OK;
+    }
+
+    case HVC_CMD_DELETE_USER:
+    case HVC_CMD_GET_USER_DATA:
+    {
+      if (data_size != 2) return HVC_SIM_CODE_INVALID;
+
+      int user = util_bytes_to_int(data[0], data[1]);
+
+      if (user >= HVC_ALBUM_MAX_USERS) return HVC_SIM_CODE_INVALID;
+
+      if (cmd == HVC_CMD_DELETE_USER)
+      {
+        sim->users[user] = 0;
+        return HVC_SIM_CODE_OK;
+      }
+
+      util_int_into_lsb_msb(out, 0, sim->users[user]);
+      *length = 2;
+      return HVC_SIM_CODE_OK;
+    }
+
+    case HVC_CMD_DELETE_ALL_DATA:
+    case HVC_CMD_REFORMAT_FLASH:
+      memset(sim->users, 0, sizeof(sim->users));
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_SAVE_ALBUM:
+      *length = _hvc_sim_save_album(sim, out);
+      return HVC_SIM_CODE_OK;
+
+    case HVC_CMD_LOAD_ALBUM:
+      return _hvc_sim_load_album(sim, data, data_size, out);
+
+    case HVC_CMD_WRITE_ALBUM:
+      return HVC_SIM_CODE_OK;
+
+    default:
+      return HVC_SIM_CODE_UNKNOWN;
+  }
+}
+
+/*
+ * Pick a fault for the next response, 0 for none
+ */
+static int _hvc_sim_fault(struct hvc_sim* sim)
+{
+  if (!sim->config.fault_mask || _hvc_sim_rand(sim, 1000) >= sim->config.fault_rate) return 0;
+
+  // Pick one of the enabled faults at random
+  int fault;
+
+  do
+  {
+    fault = 1 << _hvc_sim_rand(sim, 5);
+  }
+  while (!(fault & sim->config.fault_mask));
+
+  sim->faults++;
+  return fault;
+}
+
+static void _hvc_sim_respond(struct hvc_sim* sim, int code, int length)
+{
+  char* response = sim->response;
+  int fault = _hvc_sim_fault(sim);
+
+  if (fault == HVC_SIM_FAULT_SILENT) return;
+
+  if (fault == HVC_SIM_FAULT_RESPONSE)
+  {
+    code = HVC_SIM_CODE_INTERNAL_ERROR;
+    length = 0;
+  }
+
+  response[0] = fault == HVC_SIM_FAULT_SYNC ? 0xEF : HVC_SYNC_CODE;
+  response[1] = code;
+  response[2] = length & 0xFF;
+  response[3] = (length >> 8) & 0xFF;
+  response[4] = (length >> 16) & 0xFF;
+  response[5] = (length >> 24) & 0xFF;
+
+  int total = HVC_HEADER_SIZE + length;
+
+  if (fault == HVC_SIM_FAULT_TRUNCATE) total = 1 + _hvc_sim_rand(sim, total);
+
+  if (fault == HVC_SIM_FAULT_NOISE)
+  {
+    char noise[8];
+    int count = 1 + _hvc_sim_rand(sim, sizeof(noise));
+
+    for (int i = 0; i < count; i++) noise[i] = _hvc_sim_rand(sim, 256);
+
+    _hvc_sim_write(sim, noise, count);
+  }
+
+  _hvc_sim_write(sim, response, total);
+}
+
+static void* _hvc_sim_run(void* arg)
+{
+  struct hvc_sim* sim = (struct hvc_sim*) arg;
+  char header[CMD_SIZE];
+  char data[SEND_BUFFER_SIZE];
+
+  while (sim->running && _hvc_sim_read(sim, header, sizeof(header)))
+  {
+    int data_size = util_bytes_to_int(header[2], header[3]);
+
+    // The device has no way to recover from an oversized command either,
+    // drop the connection.
+    if ((uint8_t) header[0] != HVC_SYNC_CODE || data_size > (int) sizeof(data)) break;
+
+    if (data_size && !_hvc_sim_read(sim, data, data_size)) break;
+
+    sim->commands++;
+
+    int length;
+    int code = _hvc_sim_command(sim, header[1], data, data_size, sim->response + HVC_HEADER_SIZE, &length);
+
+    _hvc_sim_respond(sim, code, length);
+
+    sim->baudrate = sim->next_baudrate;
+  }
+
+  return NULL;
+}
+
+void hvc_sim_default_config(struct hvc_sim_config* config)
+{
+  memset(config, 0, sizeof(struct hvc_sim_config));
+
+  config->bodies = 1;
+  config->faces = 1;
+  config->compute_delay_ms = 20;
+  config->seed = 1;
+}
+
+int hvc_sim_start(struct hvc_sim* sim, const struct hvc_sim_config* config)
+{
+  int fds[2];
+
+  memset(sim, 0, sizeof(struct hvc_sim));
+  sim->config = *config;
+
+  if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) return -1;
+
+  if (!(sim->response = malloc(HVC_SIM_RESPONSE_SIZE)))
+  {
+    close(fds[0]);
+    close(fds[1]);
+    return -1;
+  }
+
+  sim->host_fd = fds[0];
+  sim->fd = fds[1];
+  sim->running = true;
+
+  if (pthread_create(&sim->thread, NULL, _hvc_sim_run, sim) != 0)
+  {
+    sim->running = false;
+    hvc_sim_stop(sim);
+    return -1;
+  }
+
+  return sim->host_fd;
+}
+
+void hvc_sim_stop(struct hvc_sim* sim)
+{
+  if (sim->running)
+  {
+    sim->running = false;
+
+    // Unblock the device thread
+    shutdown(sim->fd, SHUT_RDWR);
+    pthread_join(sim->thread, NULL);
+  }
+
+  close(sim->fd);
+  close(sim->host_fd);
+  free(sim->response);
+  sim->response = NULL;
+}
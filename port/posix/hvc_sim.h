@@ -0,0 +1,121 @@
+#ifndef HVC_SIM_H
+#define HVC_SIM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "hvc.h"
+
+/*
+ * Response codes the simulated device returns on bad commands
+ */
+#define HVC_SIM_CODE_OK             0x00
+#define HVC_SIM_CODE_INVALID        0xFD
+#define HVC_SIM_CODE_INTERNAL_ERROR 0xFE
+#define HVC_SIM_CODE_UNKNOWN        0xFF
+
+/*
+ * Injectable faults, combine into hvc_sim_config.fault_mask
+ */
+#define HVC_SIM_FAULT_NOISE     0x01  // stray bytes before the response
+#define HVC_SIM_FAULT_SYNC      0x02  // corrupted sync code
+#define HVC_SIM_FAULT_RESPONSE  0x04  // non-zero response code, no payload
+#define HVC_SIM_FAULT_TRUNCATE  0x08  // response cut short
+#define HVC_SIM_FAULT_SILENT    0x10  // no response at all
+
+/*
+ * Image sizes the HVC-P returns
+ */
+#define HVC_SIM_QVGA_WIDTH  320
+#define HVC_SIM_QVGA_HEIGHT 240
+
+/*
+ * Registered faces are returned as a 64x64 image
+ */
+#define HVC_SIM_FACE_SIZE 64
+
+/*
+ * Simulated album layout: a HVC_ALBUM_SIZE_MIN byte header holding the
+ * user count, followed by one record per registered user. The real album
+ * is opaque, only its size bounds are known.
+ */
+#define HVC_SIM_ALBUM_USER_SIZE ((HVC_ALBUM_SIZE_MAX - HVC_ALBUM_SIZE_MIN) / HVC_ALBUM_MAX_USERS)
+
+/*
+ * Largest response the simulator builds, a full album
+ */
+#define HVC_SIM_RESPONSE_SIZE (HVC_HEADER_SIZE + HVC_ALBUM_SIZE_MAX)
+
+struct hvc_sim_config
+{
+  // Detections reported by every execution, capped at 35
+  int bodies;
+  int hands;
+  int faces;
+
+  // Time the sensor spends detecting before it answers an execution
+  int compute_delay_ms;
+
+  // Delay per transmitted byte, 0 sends as fast as the socket allows.
+  // 1042 approximates 9600 baud.
+  int byte_delay_us;
+
+  // Derive the byte delay from the rate set with HVC_CMD_SET_BAUDRATE
+  // (10 bits per byte) instead of byte_delay_us
+  bool emulate_baudrate;
+
+  // Faults out of fault_mask are injected into fault_rate per mille responses
+  int fault_rate;
+  int fault_mask;
+
+  unsigned int seed;
+};
+
+/*
+ * Simulated B5T-007001 behind one end of a socketpair. Settings written
+ * with the SET commands are kept and returned by the GET commands.
+ */
+struct hvc_sim
+{
+  struct hvc_sim_config config;
+
+  int fd;
+  int host_fd;
+  char* response;
+  pthread_t thread;
+  volatile bool running;
+
+  char camera_angle;
+  int thresholds[4];
+  int detection_size[6];
+  char face_angle[2];
+  int baudrate;
+  int next_baudrate;
+
+  // Registered data IDs per user, bit n for data ID n
+  uint16_t users[HVC_ALBUM_MAX_USERS];
+
+  // Statistics
+  int commands;
+  int faults;
+};
+
+void hvc_sim_default_config(struct hvc_sim_config* config);
+
+/*
+ * Start the device thread. Returns the host side descriptor (pass it
+ * to hvc_posix_init) or -1 on failure.
+ */
+int hvc_sim_start(struct hvc_sim* sim, const struct hvc_sim_config* config);
+
+void hvc_sim_stop(struct hvc_sim* sim);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
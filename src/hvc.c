@@ -1,5 +1,5 @@
-#include <FreeRTOS.h>
-#include <task.h>
+#include <stdlib.h>
+#include <string.h>
 #include "hvc.h"
 #include "hvc_util.h"
 
@@ -16,333 +16,1223 @@
  * 6: GND
  */
 
-// Default to 5 retries
-int hvc_read_retry = HVC_DEFAULT_READ_RETRY;
+// Bits per second for every HVC_BAUD_* rate
+static const int hvc_baudrates[HVC_BAUD_COUNT] = { 9600, 38400, 115200, 230400, 460800, 921600 };
 
-int last_response_length = 0;
+void hvc_device_init(struct hvc_device* dev, const struct hvc_transport* transport)
+{
+  dev->transport = *transport;
+  dev->read_retry = HVC_DEFAULT_READ_RETRY;
+  dev->last_response_length = 0;
+  dev->image_sink = NULL;
+  dev->command = -1;
+  dev->command_start = -1;
+  dev->trace = NULL;
+
+  hvc_metrics_reset(&dev->metrics);
+}
+
+int hvc_read_bytes(struct hvc_device* dev, char* data, int length)
+{
+  int read = dev->transport.read(dev->transport.ctx, data, length, HVC_READ_TIMEOUT(length));
+
+  if (read > 0) dev->metrics.bytes_rx += read;
+
+  return read;
+}
+
+int hvc_write_bytes(struct hvc_device* dev, char* data, int length)
+{
+  int written = dev->transport.write(dev->transport.ctx, data, length);
+
+  if (written > 0) dev->metrics.bytes_tx += written;
+
+  return written;
+}
+
+int hvc_read_bytes_available(struct hvc_device* dev)
+{
+  return dev->transport.available(dev->transport.ctx);
+}
+
+int hvc_wait_bytes_available(struct hvc_device* dev, int length, int timeout_ms)
+{
+  return dev->transport.wait(dev->transport.ctx, length, timeout_ms);
+}
+
+void hvc_sleep(struct hvc_device* dev, int ms)
+{
+  dev->transport.sleep(dev->transport.ctx, ms);
+}
+
+bool hvc_set_host_baudrate(struct hvc_device* dev, int baudrate)
+{
+  // Transports without a configurable rate (sockets, pipes) accept any
+  if (!dev->transport.set_baudrate) return true;
+
+  return dev->transport.set_baudrate(dev->transport.ctx, baudrate);
+}
+
+int64_t hvc_clock(struct hvc_device* dev)
+{
+  if (!dev->transport.clock) return -1;
+
+  return dev->transport.clock(dev->transport.ctx);
+}
+
+struct hvc_metrics* hvc_get_metrics(struct hvc_device* dev)
+{
+  return &dev->metrics;
+}
+
+void hvc_command_done(struct hvc_device* dev, int status)
+{
+  int64_t now = hvc_clock(dev);
+  int elapsed = now >= 0 && dev->command_start >= 0 ? (int) (now - dev->command_start) : -1;
+
+  hvc_metrics_command(&dev->metrics, dev->command, status, elapsed);
+  hvc_metrics_error(&dev->metrics, status);
+  hvc_trace_event(dev, HVC_TRACE_DONE, dev->command, status);
+}
+
+void hvc_count_resync(struct hvc_device* dev, int discarded)
+{
+  if (discarded <= 0) return;
+
+  hvc_metrics_resync(&dev->metrics, discarded);
+  hvc_trace_event(dev, HVC_TRACE_RESYNC, dev->command, discarded);
+}
+
+void hvc_set_trace(struct hvc_device* dev, struct hvc_trace* trace)
+{
+  dev->trace = trace;
+}
+
+void hvc_trace_event(struct hvc_device* dev, int event, int arg0, int arg1)
+{
+  if (dev->trace) hvc_trace_record(dev->trace, (uint32_t) hvc_clock(dev), event, arg0, arg1);
+}
+
+/*
+ * Count a failure that happened after the response arrived
+ */
+static int _hvc_check(struct hvc_device* dev, int status)
+{
+  hvc_metrics_error(&dev->metrics, status);
+  return status;
+}
+
+/*
+ * Whether a successful response to cmd can carry length payload bytes
+ */
+static bool _hvc_response_length_valid(int cmd, int length)
+{
+  if (cmd == -1) return length >= 0;
+
+  const struct hvc_command* command = hvc_command_find(cmd);
+
+  // Commands we don't know can only be acknowledged
+  if (!command) return length == 0;
+
+  return length >= command->response_min && length <= command->response_max;
+}
+
+int hvc_check_header(const char* header, int cmd, int* length)
+{
+  uint8_t response_code = header[1];
 
-static bool _hvc_run_command(char cmd, int data_size, char *data)
+  *length =
+    (uint8_t) header[2] +
+    ((uint8_t) header[3] << 8) +
+    ((uint8_t) header[4] << 16) +
+    ((uint8_t) header[5] << 24);
+
+  if ((uint8_t) header[0] != HVC_SYNC_CODE) return HVC_ERR_SYNC;
+
+  // Error responses never carry a payload
+  if (response_code != 0x00) return *length == 0 ? HVC_ERR_RESPONSE : HVC_ERR_SYNC;
+
+  return _hvc_response_length_valid(cmd, *length) ? HVC_OK : HVC_ERR_SYNC;
+}
+
+int hvc_resync_offset(const char* data, int length)
+{
+  int offset = 1;
+
+  while (offset < length && (uint8_t) data[offset] != HVC_SYNC_CODE) offset++;
+
+  return offset;
+}
+
+int hvc_flush(struct hvc_device* dev)
+{
+  int discarded = 0;
+  int available;
+
+  while ((available = hvc_read_bytes_available(dev)) > 0)
+  {
+    if (available > RECV_BUFFER_SIZE) available = RECV_BUFFER_SIZE;
+
+    int read = hvc_read_bytes(dev, dev->recv_buffer, available);
+
+    if (read <= 0) break;
+
+    discarded += read;
+  }
+
+  if (discarded > 0)
+  {
+    HVC_LOG_ERROR("Discarded %d stale bytes", discarded);
+    hvc_count_resync(dev, discarded);
+  }
+
+  return discarded;
+}
+
+int hvc_send_command(struct hvc_device* dev, char cmd, int data_size, const char* data)
 {
   char send_data[SEND_BUFFER_SIZE];
 
+  if (CMD_SIZE + data_size > SEND_BUFFER_SIZE)
+  {
+    HVC_LOG_ERROR("Command data too large: %d", data_size);
+    return HVC_ERR_ARGS;
+  }
+
   send_data[0] = HVC_SYNC_CODE;
   send_data[1] = cmd;
   send_data[2] = util_lsb(data_size);
   send_data[3] = util_msb(data_size);
 
-  hvc_log_debug("Executing command (first 4 bytes): %02x%02x%02x%02x", send_data[0], send_data[1], send_data[2], send_data[3]);
+  HVC_LOG_DEBUG("Executing command (first 4 bytes): %02x%02x%02x%02x", (uint8_t) send_data[0], (uint8_t) send_data[1], (uint8_t) send_data[2], (uint8_t) send_data[3]);
 
   for (int i = 0; i < data_size; i++)
   {
     send_data[4 + i] = data[i];
   }
 
+  // Late responses to commands that timed out would be taken for the
+  // answer to this one
+  hvc_flush(dev);
+
+  dev->command = (uint8_t) cmd;
+  dev->command_start = hvc_clock(dev);
+  hvc_trace_event(dev, HVC_TRACE_SEND, dev->command, data_size);
+
   // Execute the command
-  hvc_write_bytes(send_data, CMD_SIZE + data_size);
+  if (hvc_write_bytes(dev, send_data, CMD_SIZE + data_size) != CMD_SIZE + data_size)
+  {
+    hvc_command_done(dev, HVC_ERR_WRITE);
+    return HVC_ERR_WRITE;
+  }
 
-  // Sleep briefly to let data arrive
-  vTaskDelay(100 / portTICK_RATE_MS);
+  return HVC_OK;
+}
 
-  int sleep = 0;
-  int avail = 0;
+static int _hvc_wait_response(struct hvc_device* dev, int base_timeout)
+{
+  // Allow the base response time plus one retry period per configured retry
+  // for the header to arrive. The port wakes us as soon as it's there.
+  int timeout = base_timeout + dev->read_retry * HVC_READ_RETRY_SLEEP;
+
+  HVC_LOG_DEBUG("Waiting for response header...");
+
+  char header[HVC_HEADER_SIZE];
+  int header_length = 0;
+  int discarded = 0;
+  int status;
+
+  // Noise keeps waking us up while we resynchronise, hold the header to
+  // one deadline when the transport can tell the time
+  int64_t deadline = hvc_clock(dev);
 
-  // Sleep for max X seconds waiting for data.
-  while (!(avail = hvc_read_bytes_available()) && sleep < hvc_read_retry)
+  if (deadline >= 0) deadline += (int64_t) timeout * 1000;
+
+  for (;;)
   {
-    hvc_log_debug("Sleeping HVC thread until data arrives...");
-    sleep++;
+    int missing = HVC_HEADER_SIZE - header_length;
+    int wait = timeout;
+
+    if (deadline >= 0 && discarded > 0)
+    {
+      wait = (int) ((deadline - hvc_clock(dev)) / 1000);
+
+      if (wait < 0) wait = 0;
+    }
+
+    // Read buffer has nothing for us, this is unexpected. The HVC
+    // might be unavailable at this point.
+    if (hvc_wait_bytes_available(dev, missing, wait) < missing)
+    {
+      HVC_LOG_ERROR("Unable to find response header in the read buffer.");
+      hvc_count_resync(dev, discarded);
+      return HVC_ERR_TIMEOUT;
+    }
+
+    // Read response headers
+    HVC_LOG_DEBUG("Reading response header...");
+
+    if (hvc_read_bytes(dev, header + header_length, missing) != missing)
+    {
+      hvc_count_resync(dev, discarded);
+      return HVC_ERR_SHORT_READ;
+    }
+
+    status = hvc_check_header(header, dev->command, &dev->last_response_length);
+
+    if (status != HVC_ERR_SYNC) break;
+
+    // Not a response to our command, skip to the next sync code and
+    // complete the header from there
+    int offset = hvc_resync_offset(header, HVC_HEADER_SIZE);
 
-    vTaskDelay(HVC_READ_RETRY_SLEEP / portTICK_RATE_MS);
+    HVC_LOG_DEBUG("Header invalid for command %02x: %02x %02x, length %d",
+      dev->command, (uint8_t) header[0], (uint8_t) header[1], dev->last_response_length);
+
+    memmove(header, header + offset, HVC_HEADER_SIZE - offset);
+    header_length = HVC_HEADER_SIZE - offset;
+    discarded += offset;
+
+    if (discarded >= HVC_RESYNC_MAX)
+    {
+      HVC_LOG_ERROR("No response header in %d bytes", discarded);
+      hvc_count_resync(dev, discarded);
+      return HVC_ERR_SYNC;
+    }
   }
 
-  // Read buffer has nothing for us, this is unexpected. The HVC
-  // might be unavailable at this point.
-  if (!avail)
+  if (discarded > 0)
   {
-    hvc_log_error("Unable to find any data in the read buffer.");
-    return false;
+    HVC_LOG_ERROR("Resynchronised after discarding %d bytes", discarded);
+    hvc_count_resync(dev, discarded);
   }
 
-  // Read response headers
-  hvc_log_debug("Reading response header...");
+  hvc_trace_event(dev, HVC_TRACE_HEADER, (uint8_t) header[1], dev->last_response_length);
 
-  char sync_code;
-  char response_code;
-  char data_length_bytes[4];
+  HVC_LOG_DEBUG("Header response_code: %02x", (uint8_t) header[1]);
+  HVC_LOG_DEBUG("Header data length: %d", dev->last_response_length);
 
-  hvc_read_bytes(&sync_code, 1);
-  hvc_read_bytes(&response_code, 1);
+  if (status == HVC_ERR_RESPONSE)
+  {
+    HVC_LOG_ERROR("Header response code invalid: %02x", (uint8_t) header[1]);
+    return HVC_ERR_RESPONSE;
+  }
 
-  // Not used at this point
-  hvc_read_bytes(data_length_bytes, 4);
+  // Wait for the payload. Long payloads (images) only wait for the first
+  // chunk, the remainder is streamed by the caller.
+  int expected = dev->last_response_length;
 
-  // Set the last response length
-  last_response_length =
-    data_length_bytes[0] +
-    (data_length_bytes[1] << 8) +
-    (data_length_bytes[2] << 16) +
-    (data_length_bytes[3] << 24);
+  if (expected > HVC_RESPONSE_WAIT_MAX)
+  {
+    expected = HVC_RESPONSE_WAIT_MAX;
+  }
 
-  hvc_log_debug("Header sync_code: %02x", sync_code);
-  hvc_log_debug("Header response_code: %02x", response_code);
-  hvc_log_debug("Header data length: %d", last_response_length);
+  timeout += (expected * HVC_BYTE_TIMEOUT_US) / 1000;
 
-  if (sync_code != HVC_SYNC_CODE) {
-    hvc_log_error("Header sync code invalid: %02x", sync_code);
-    return false;
+  if (expected > 0 && hvc_wait_bytes_available(dev, expected, timeout) < expected)
+  {
+    HVC_LOG_ERROR("Response payload incomplete, expected %d bytes", expected);
+    return HVC_ERR_TIMEOUT;
   }
 
-  if (response_code != 0x00) {
-    hvc_log_error("Header response code invalid: %02x", response_code);
-    return false;
+  return HVC_OK;
+}
+
+/*
+ * Wait for a response and read its header. base_timeout is the time the
+ * HVC needs to process the command.
+ */
+static int _hvc_receive_response(struct hvc_device* dev, int base_timeout)
+{
+  int status = _hvc_wait_response(dev, base_timeout);
+
+  hvc_command_done(dev, status);
+  return status;
+}
+
+/*
+ * Encode and send a request, then wait as long as the command's
+ * descriptor allows for the response header
+ */
+static int _hvc_request(struct hvc_device* dev, int cmd, const void* request)
+{
+  const struct hvc_command* command = hvc_command_find(cmd);
+  char data[SEND_BUFFER_SIZE - CMD_SIZE];
+
+  if (!command) return HVC_ERR_ARGS;
+
+  if (command->encode) command->encode(data, request);
+
+  int status = hvc_send_command(dev, cmd, command->request_size, data);
+
+  if (status != HVC_OK) return status;
+
+  return _hvc_receive_response(dev, command->timeout);
+}
+
+/*
+ * Read the payload of the last response into the receive buffer with a
+ * single transport call, the parsers decode it from there.
+ */
+static int _hvc_read_payload(struct hvc_device* dev, int length)
+{
+  if (length > RECV_BUFFER_SIZE)
+  {
+    HVC_LOG_ERROR("Response payload too large: %d", length);
+    return _hvc_check(dev, HVC_ERR_PAYLOAD);
   }
 
-  return true;
+  if (length > 0 && hvc_read_bytes(dev, dev->recv_buffer, length) != length)
+  {
+    HVC_LOG_ERROR("Unable to read response payload (%d)", length);
+    return _hvc_check(dev, HVC_ERR_SHORT_READ);
+  }
+
+  return HVC_OK;
 }
 
-void hvc_set_retry(int retry)
+int hvc_command_run(struct hvc_device* dev, int cmd, const void* request, void* response)
 {
-  hvc_read_retry = retry;
+  int status = _hvc_request(dev, cmd, request);
+
+  if (status != HVC_OK || !response) return status;
+
+  status = _hvc_read_payload(dev, dev->last_response_length);
+
+  if (status != HVC_OK) return status;
+
+  return _hvc_check(dev, hvc_command_decode(cmd, dev->recv_buffer, dev->last_response_length, response));
 }
 
-struct hvc_get_version_response* hvc_get_version()
+void hvc_set_retry(struct hvc_device* dev, int retry)
 {
-  if (!_hvc_run_command(HVC_CMD_GET_VERSION, 0, NULL)) return NULL;
+  dev->read_retry = retry;
+}
 
-  // Now parse
+struct hvc_get_version_response* hvc_get_version(struct hvc_device* dev)
+{
   struct hvc_get_version_response* res = (struct hvc_get_version_response*) malloc(sizeof(struct hvc_get_version_response));
 
-  hvc_read_bytes(res->model, 12);
-  hvc_read_bytes((char *) &res->major_version, 1);
-  hvc_read_bytes((char *) &res->minor_version, 1);
-  hvc_read_bytes((char *) &res->release_version, 1);
-  hvc_read_bytes(res->revision, 4);
+  if (res && hvc_get_version_r(dev, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
 
   return res;
 }
 
-bool hvc_set_camera_angle(char angle)
+int hvc_get_version_r(struct hvc_device* dev, struct hvc_get_version_response* res)
+{
+  return hvc_command_run(dev, HVC_CMD_GET_VERSION, NULL, res);
+}
+
+bool hvc_set_camera_angle(struct hvc_device* dev, char angle)
 {
   // Do some validation, ensure camera angle within bounds
   if (angle > HVC_CAMERA_ANGLE_270)
   {
-    hvc_log_debug("Angle out of range, setting to 0 degrees. (%d)", angle);
+    HVC_LOG_DEBUG("Angle out of range, setting to 0 degrees. (%d)", angle);
     angle = HVC_CAMERA_ANGLE_0;
   }
 
-  hvc_log_info("Setting HVC camera angle -> %d", angle);
+  HVC_LOG_INFO("Setting HVC camera angle -> %d", angle);
+
+  struct hvc_get_camera_angle_response req = { .angle = angle };
 
-  char data[] = { angle };
-  return _hvc_run_command(HVC_CMD_SET_CAMERA_ANGLE, sizeof(data), data);
+  return hvc_command_run(dev, HVC_CMD_SET_CAMERA_ANGLE, &req, NULL) == HVC_OK;
 }
 
-struct hvc_get_camera_angle_response* hvc_get_camera_angle()
+struct hvc_get_camera_angle_response* hvc_get_camera_angle(struct hvc_device* dev)
 {
-  if (!_hvc_run_command(HVC_CMD_GET_CAMERA_ANGLE, 0, NULL)) return NULL;
-
   struct hvc_get_camera_angle_response* res = (struct hvc_get_camera_angle_response*) malloc(sizeof(struct hvc_get_camera_angle_response));
 
-  hvc_read_bytes(&res->angle, 1);
+  if (res && hvc_get_camera_angle_r(dev, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
+
   return res;
 }
 
-bool hvc_set_threshold_values(int body, int hand, int face, int recognition)
+int hvc_get_camera_angle_r(struct hvc_device* dev, struct hvc_get_camera_angle_response* res)
+{
+  return hvc_command_run(dev, HVC_CMD_GET_CAMERA_ANGLE, NULL, res);
+}
+
+bool hvc_set_threshold_values(struct hvc_device* dev, int body, int hand, int face, int recognition)
 {
-  hvc_log_info("Setting HVC threshold values -> %d/%d/%d/%d", body, hand, face, recognition);
+  HVC_LOG_INFO("Setting HVC threshold values -> %d/%d/%d/%d", body, hand, face, recognition);
 
-  char data[8];
-  util_int_into_lsb_msb(data, 0, body);
-  util_int_into_lsb_msb(data, 2, hand);
-  util_int_into_lsb_msb(data, 4, face);
-  util_int_into_lsb_msb(data, 6, recognition);
+  struct hvc_get_threshold_values_response req = {
+    .body = body, .hand = hand, .face = face, .recognition = recognition
+  };
 
-  return _hvc_run_command(HVC_CMD_SET_THRESHOLD_VALUES, sizeof(data), data);
+  return hvc_command_run(dev, HVC_CMD_SET_THRESHOLD_VALUES, &req, NULL) == HVC_OK;
 }
 
-struct hvc_get_threshold_values_response* hvc_get_threshold_values()
+struct hvc_get_threshold_values_response* hvc_get_threshold_values(struct hvc_device* dev)
 {
-  if (!_hvc_run_command(HVC_CMD_GET_THRESHOLD_VALUES, 0, NULL)) return NULL;
-
   struct hvc_get_threshold_values_response* res = (struct hvc_get_threshold_values_response*) malloc(sizeof(struct hvc_get_threshold_values_response));
 
-  char bytes[8];
-  hvc_read_bytes(bytes, sizeof(bytes));
-
-  res->hand = util_bytes_to_int(bytes[0], bytes[1]);
-  res->body = util_bytes_to_int(bytes[2], bytes[3]);
-  res->face = util_bytes_to_int(bytes[4], bytes[5]);
-  res->recognition = util_bytes_to_int(bytes[6], bytes[7]);
+  if (res && hvc_get_threshold_values_r(dev, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
 
   return res;
 }
 
-bool hvc_set_detection_size(int min_body, int max_body, int min_hand, int max_hand, int min_face, int max_face)
+int hvc_get_threshold_values_r(struct hvc_device* dev, struct hvc_get_threshold_values_response* res)
 {
-  hvc_log_info("Setting HVC detection size -> %d-%d/%d-%d/%d-%d", min_body, max_body, min_hand, max_hand, min_face, max_face);
+  return hvc_command_run(dev, HVC_CMD_GET_THRESHOLD_VALUES, NULL, res);
+}
 
-  char data[12];
+bool hvc_set_detection_size(struct hvc_device* dev, int min_body, int max_body, int min_hand, int max_hand, int min_face, int max_face)
+{
+  HVC_LOG_INFO("Setting HVC detection size -> %d-%d/%d-%d/%d-%d", min_body, max_body, min_hand, max_hand, min_face, max_face);
 
-  util_int_into_lsb_msb(data, 0, min_body);
-  util_int_into_lsb_msb(data, 2, max_body);
-  util_int_into_lsb_msb(data, 4, min_hand);
-  util_int_into_lsb_msb(data, 6, max_hand);
-  util_int_into_lsb_msb(data, 8, min_face);
-  util_int_into_lsb_msb(data, 10, max_face);
+  struct hvc_get_detection_size_response req = {
+    .min_body = min_body, .max_body = max_body,
+    .min_hand = min_hand, .max_hand = max_hand,
+    .min_face = min_face, .max_face = max_face
+  };
 
-  return _hvc_run_command(HVC_CMD_SET_DETECTION_SIZE, sizeof(data), data);
+  return hvc_command_run(dev, HVC_CMD_SET_DETECTION_SIZE, &req, NULL) == HVC_OK;
 }
 
-struct hvc_get_detection_size_response* hvc_get_detection_size()
+struct hvc_get_detection_size_response* hvc_get_detection_size(struct hvc_device* dev)
 {
-  if (!_hvc_run_command(HVC_CMD_GET_DETECTION_SIZE, 0, NULL)) return NULL;
-
   struct hvc_get_detection_size_response* res = (struct hvc_get_detection_size_response*) malloc(sizeof(struct hvc_get_detection_size_response));
 
-  char bytes[12];
-  hvc_read_bytes(bytes, sizeof(bytes));
-
-  res->min_body = util_bytes_to_int(bytes[0], bytes[1]);
-  res->max_body = util_bytes_to_int(bytes[2], bytes[3]);
-  res->min_hand = util_bytes_to_int(bytes[4], bytes[5]);
-  res->max_hand = util_bytes_to_int(bytes[6], bytes[7]);
-  res->min_face = util_bytes_to_int(bytes[8], bytes[9]);
-  res->max_face = util_bytes_to_int(bytes[10], bytes[11]);
+  if (res && hvc_get_detection_size_r(dev, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
 
   return res;
 }
 
-bool hvc_set_face_angle(char yaw, char roll)
+int hvc_get_detection_size_r(struct hvc_device* dev, struct hvc_get_detection_size_response* res)
 {
-  hvc_log_info("Setting HVC face angles -> yaw:%d roll:%d", yaw, roll);
+  return hvc_command_run(dev, HVC_CMD_GET_DETECTION_SIZE, NULL, res);
+}
 
-  char data[2];
-  data[0] = yaw;
-  data[1] = roll;
+bool hvc_set_face_angle(struct hvc_device* dev, char yaw, char roll)
+{
+  HVC_LOG_INFO("Setting HVC face angles -> yaw:%d roll:%d", yaw, roll);
 
-  return _hvc_run_command(HVC_CMD_SET_FACE_ANGLE, sizeof(data), data);
+  struct hvc_get_face_angle_response req = { .yaw = yaw, .roll = roll };
+
+  return hvc_command_run(dev, HVC_CMD_SET_FACE_ANGLE, &req, NULL) == HVC_OK;
 }
 
-struct hvc_get_face_angle_response* hvc_get_face_angle()
+struct hvc_get_face_angle_response* hvc_get_face_angle(struct hvc_device* dev)
 {
-  if (!_hvc_run_command(HVC_CMD_GET_FACE_ANGLE, 0, NULL)) return NULL;
-
   struct hvc_get_face_angle_response* res = (struct hvc_get_face_angle_response*) malloc(sizeof(struct hvc_get_face_angle_response));
 
-  hvc_read_bytes(&res->yaw, 1);
-  hvc_read_bytes(&res->roll, 1);
+  if (res && hvc_get_face_angle_r(dev, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
 
   return res;
 }
 
-struct hvc_execution_response* hvc_execution(int function, int image)
+int hvc_get_face_angle_r(struct hvc_device* dev, struct hvc_get_face_angle_response* res)
 {
-  char data[3];
-  data[0] = (function & 0xFF);
-  data[1] = ((function >> 8) & 0xFF);
-  data[2] = (image & 0xFF);
+  return hvc_command_run(dev, HVC_CMD_GET_FACE_ANGLE, NULL, res);
+}
 
-  if (!_hvc_run_command(HVC_CMD_EXECUTE, sizeof(data), data)) return NULL;
+/*
+ * Drop whatever is left of a failed burst so the next command starts on
+ * a clean boundary.
+ */
+static void _hvc_drain(struct hvc_device* dev)
+{
+  hvc_sleep(dev, HVC_RESPONSE_TIMEOUT);
+  hvc_flush(dev);
+}
 
-  struct hvc_execution_response* res = (struct hvc_execution_response*) malloc(sizeof(struct hvc_execution_response));
+int hvc_get_config_r(struct hvc_device* dev, struct hvc_config* res)
+{
+  static const char commands[] = {
+    HVC_CMD_GET_CAMERA_ANGLE,
+    HVC_CMD_GET_THRESHOLD_VALUES,
+    HVC_CMD_GET_DETECTION_SIZE,
+    HVC_CMD_GET_FACE_ANGLE
+  };
 
-  // Size declaration
-  int size = last_response_length;
+  void* targets[] = { &res->camera_angle, &res->thresholds, &res->detection_size, &res->face_angle };
+
+  // Send every query at once, the HVC answers them in order
+  char burst[sizeof(commands) * CMD_SIZE];
+
+  for (int i = 0; i < (int) sizeof(commands); i++)
+  {
+    burst[i * CMD_SIZE] = HVC_SYNC_CODE;
+    burst[i * CMD_SIZE + 1] = commands[i];
+    burst[i * CMD_SIZE + 2] = 0;
+    burst[i * CMD_SIZE + 3] = 0;
+  }
+
+  hvc_flush(dev);
+  dev->command_start = hvc_clock(dev);
+
+  if (hvc_write_bytes(dev, burst, sizeof(burst)) != sizeof(burst)) return _hvc_check(dev, HVC_ERR_WRITE);
 
-  char header[4];
-  size -= hvc_read_bytes(header, sizeof(header));
+  for (int i = 0; i < (int) sizeof(commands); i++) hvc_trace_event(dev, HVC_TRACE_SEND, commands[i], 0);
 
-  res->body_count = header[0];
-  res->hand_count = header[1];
-  res->face_count = header[2];
-  // header[3] reserved and unused
+  int status = HVC_OK;
 
-  // Dud char for empty reading
-  char c;
+  for (int i = 0; i < (int) sizeof(commands) && status == HVC_OK; i++)
+  {
+    // Round trips are measured from the burst
+    dev->command = commands[i];
+    status = _hvc_receive_response(dev, HVC_RESPONSE_TIMEOUT);
+
+    if (status == HVC_OK) status = _hvc_read_payload(dev, dev->last_response_length);
+
+    if (status != HVC_OK) break;
+
+    status = _hvc_check(dev, hvc_command_decode(commands[i], dev->recv_buffer, dev->last_response_length, targets[i]));
+  }
+
+  if (status != HVC_OK) _hvc_drain(dev);
+
+  return status;
+}
+
+/*
+ * Settings of config that differ from current
+ */
+static int _hvc_config_diff(const struct hvc_config* current, const struct hvc_config* config)
+{
+  int changed = 0;
+
+  if (current->camera_angle.angle != config->camera_angle.angle)
+  {
+    changed |= HVC_CONFIG_CAMERA_ANGLE;
+  }
 
-  for (int i = 0; i < res->body_count * (sizeof(uint8_t) * 8); i++)
+  if (memcmp(&current->thresholds, &config->thresholds, sizeof(config->thresholds)))
   {
-    hvc_read_bytes(&c, 1); // Read into the void
-    size--;
+    changed |= HVC_CONFIG_THRESHOLDS;
   }
 
-  for (int i = 0; i < res->hand_count * (sizeof(uint8_t) * 8); i++)
+  if (memcmp(&current->detection_size, &config->detection_size, sizeof(config->detection_size)))
   {
-    hvc_read_bytes(&c, 1); // Read into the void
-    size--;
+    changed |= HVC_CONFIG_DETECTION_SIZE;
   }
 
-  // TODO only face detection supported for now...
-  for (int i = 0; i < res->face_count * (sizeof(uint8_t) * 8); i++)
+  if (current->face_angle.yaw != config->face_angle.yaw || current->face_angle.roll != config->face_angle.roll)
   {
-    hvc_read_bytes(&c, 1); // Read into the void
-    size--;
+    changed |= HVC_CONFIG_FACE_ANGLE;
   }
 
-  // Check if image was requested, if yes...save the
-  // raw image bytes to a file for external processing.
-  if (image != HVC_EX_IMAGE_NONE)
+  return changed;
+}
+
+static bool _hvc_config_write(struct hvc_device* dev, int setting, const struct hvc_config* config)
+{
+  const struct hvc_get_threshold_values_response* t = &config->thresholds;
+  const struct hvc_get_detection_size_response* d = &config->detection_size;
+
+  switch (setting)
   {
-    char xy[4];
+    case HVC_CONFIG_CAMERA_ANGLE:
+      return hvc_set_camera_angle(dev, config->camera_angle.angle);
 
-    // Read the XY values, first 4 bytes of the image response
-    size -= hvc_read_bytes(xy, 4);
+    case HVC_CONFIG_THRESHOLDS:
+      return hvc_set_threshold_values(dev, t->body, t->hand, t->face, t->recognition);
 
-    int width = util_bytes_to_int(xy[0], xy[1]);
-    int height = util_bytes_to_int(xy[2], xy[3]);
-    int image_size = width * height;
+    case HVC_CONFIG_DETECTION_SIZE:
+      return hvc_set_detection_size(dev, d->min_body, d->max_body, d->min_hand, d->max_hand, d->min_face, d->max_face);
 
-    hvc_log_info("Image Detected: %d X %d (bytes: %d)", width, height, image_size);
+    case HVC_CONFIG_FACE_ANGLE:
+      return hvc_set_face_angle(dev, config->face_angle.yaw, config->face_angle.roll);
 
-    // Save image to file
-    const char* filepath = "/debug.img";
+    default:
+      return false;
+  }
+}
 
-    FILE *fp;
-    if (!(fp = fopen(filepath, "wb")))
-    {
-      hvc_log_error("Unable to open file path: %d", filepath);
-    }
+int hvc_apply_config(struct hvc_device* dev, const struct hvc_config* config, int retries)
+{
+  struct hvc_config current;
+  int changed = HVC_CONFIG_ALL;
+
+  // If the HVC can't tell us its settings we write all of them
+  if (hvc_get_config_r(dev, &current) == HVC_OK)
+  {
+    changed = _hvc_config_diff(&current, config);
+  }
+  else
+  {
+    HVC_LOG_ERROR("Unable to read HVC config, writing all settings");
+  }
+
+  HVC_LOG_INFO("HVC config changes: %02x", changed);
 
-    // Write dimensions as first 4 bytes
-    if (fp) fwrite(xy, 1, sizeof(xy), fp);
+  for (int setting = 1; setting <= HVC_CONFIG_ALL; setting <<= 1)
+  {
+    if (!(changed & setting)) continue;
 
-    // Set up image buffer
-    int available = 0;
-    int retry = 0;
-    char c[HVC_IMAGE_READ_BUFFER];
+    int attempt = 0;
 
-    // Drain the rest of the buffer and save image
-    while (size > 0 && retry < hvc_read_retry)
+    while (!_hvc_config_write(dev, setting, config))
     {
-      // Wait for HVC to send more data, retry a few times before
-      // we decide it's pointless and just give up.
-      if (!(available = hvc_read_bytes_available()))
+      if (attempt++ == retries)
       {
-        retry++;
-        continue;
+        HVC_LOG_ERROR("Unable to write HVC setting %02x", setting);
+        return HVC_ERR_RESPONSE;
       }
 
-      // Reset the retry
-      retry = 0;
+      HVC_LOG_ERROR("Writing HVC setting %02x failed, retry %d/%d", setting, attempt, retries);
+      _hvc_drain(dev);
+    }
+  }
+
+  return changed;
+}
+
+int hvc_restore_config(struct hvc_device* dev, const struct hvc_config* config, int retries)
+{
+  static const char commands[] = {
+    HVC_CMD_SET_CAMERA_ANGLE,
+    HVC_CMD_SET_THRESHOLD_VALUES,
+    HVC_CMD_SET_DETECTION_SIZE,
+    HVC_CMD_SET_FACE_ANGLE
+  };
+
+  const void* sources[] = { &config->camera_angle, &config->thresholds, &config->detection_size, &config->face_angle };
+
+  // Send every write at once, the HVC acknowledges them in order
+  char burst[sizeof(commands) * CMD_SIZE + HVC_CAMERA_ANGLE_SIZE + HVC_THRESHOLDS_SIZE +
+    HVC_DETECTION_LIMITS_SIZE + HVC_FACE_ANGLE_SIZE];
+  int length = 0;
+
+  for (int i = 0; i < (int) sizeof(commands); i++)
+  {
+    int size = hvc_command_encode(commands[i], sources[i], burst + length + CMD_SIZE);
+
+    burst[length] = HVC_SYNC_CODE;
+    burst[length + 1] = commands[i];
+    burst[length + 2] = util_lsb(size);
+    burst[length + 3] = util_msb(size);
+    length += CMD_SIZE + size;
+  }
+
+  hvc_flush(dev);
+  dev->command_start = hvc_clock(dev);
+
+  if (hvc_write_bytes(dev, burst, length) != length) return _hvc_check(dev, HVC_ERR_WRITE);
 
-      hvc_log_info("Reading available image data: %d", available);
-      int image_read = hvc_read_bytes(c, HVC_IMAGE_READ_BUFFER);
-      size -= image_read;
+  for (int i = 0; i < (int) sizeof(commands); i++) hvc_trace_event(dev, HVC_TRACE_SEND, commands[i], 0);
 
-      // Flush to file if we managed to open it.
-      if (fp) fwrite(c, 1, HVC_IMAGE_READ_BUFFER, fp);
+  int status = HVC_OK;
 
-      vTaskDelay(HVC_IMAGE_READ_SLEEP_MS / portTICK_RATE_MS);
+  for (int i = 0; i < (int) sizeof(commands) && status == HVC_OK; i++)
+  {
+    dev->command = commands[i];
+    status = _hvc_receive_response(dev, HVC_RESPONSE_TIMEOUT);
+  }
+
+  if (status == HVC_OK) return HVC_CONFIG_ALL;
+
+  // Find out what did stick and write the rest one by one
+  HVC_LOG_ERROR("Restoring HVC config failed (%d), applying it", status);
+  _hvc_drain(dev);
+
+  return hvc_apply_config(dev, config, retries);
+}
+
+bool hvc_set_baudrate(struct hvc_device* dev, int rate)
+{
+  if (rate < 0 || rate >= HVC_BAUD_COUNT)
+  {
+    HVC_LOG_ERROR("Baudrate out of range: %d", rate);
+    return false;
+  }
+
+  HVC_LOG_INFO("Setting HVC baudrate -> %d", hvc_baudrates[rate]);
+
+  struct hvc_baudrate_request req = { .rate = rate };
+
+  return hvc_command_run(dev, HVC_CMD_SET_BAUDRATE, &req, NULL) == HVC_OK;
+}
+
+int hvc_baudrate_value(int rate)
+{
+  if (rate < 0 || rate >= HVC_BAUD_COUNT) return 0;
+
+  return hvc_baudrates[rate];
+}
+
+/*
+ * Move the host to the given rate and check the HVC answers there
+ */
+static bool _hvc_verify_baudrate(struct hvc_device* dev, int rate)
+{
+  struct hvc_get_version_response version;
+
+  if (!hvc_set_host_baudrate(dev, hvc_baudrates[rate])) return false;
+
+  return hvc_get_version_r(dev, &version) == HVC_OK;
+}
+
+/*
+ * Find the rate the HVC talks at. Try the power-on default first, the
+ * HVC keeps a faster rate across a host reboot though.
+ */
+static int _hvc_probe_baudrate(struct hvc_device* dev)
+{
+  if (_hvc_verify_baudrate(dev, HVC_BAUD_9600)) return HVC_BAUD_9600;
+
+  for (int rate = HVC_BAUD_COUNT - 1; rate > HVC_BAUD_9600; rate--)
+  {
+    if (_hvc_verify_baudrate(dev, rate)) return rate;
+  }
+
+  HVC_LOG_ERROR("Unable to reach HVC at any baudrate");
+  return HVC_ERR_TIMEOUT;
+}
+
+/*
+ * Move the link from current to target, returns the rate it ends up at
+ */
+static int _hvc_switch_baudrate(struct hvc_device* dev, int current, int target)
+{
+  if (!hvc_set_baudrate(dev, target))
+  {
+    // The acknowledgement might have been lost after the HVC switched
+    return _hvc_verify_baudrate(dev, current) ? current : _hvc_probe_baudrate(dev);
+  }
+
+  hvc_sleep(dev, HVC_BAUDRATE_SETTLE_MS);
+
+  if (_hvc_verify_baudrate(dev, target)) return target;
+
+  HVC_LOG_ERROR("Baudrate %d unstable, falling back", hvc_baudrates[target]);
+
+  // The HVC might still understand us well enough to switch back
+  hvc_set_baudrate(dev, current);
+  hvc_sleep(dev, HVC_BAUDRATE_SETTLE_MS);
+
+  return _hvc_verify_baudrate(dev, current) ? current : _hvc_probe_baudrate(dev);
+}
+
+int hvc_negotiate_baudrate(struct hvc_device* dev, int max_baudrate)
+{
+  if (max_baudrate < hvc_baudrates[0])
+  {
+    HVC_LOG_ERROR("Baudrate limit %d below the slowest rate", max_baudrate);
+    return HVC_ERR_ARGS;
+  }
+
+  int current = _hvc_probe_baudrate(dev);
+
+  if (current < 0) return current;
+
+  // Walk down from the fastest allowed rate until one sticks. The HVC
+  // may have kept a rate above the limit, that one is always left.
+  for (int target = HVC_BAUD_COUNT - 1; target >= 0; target--)
+  {
+    if (hvc_baudrates[target] > max_baudrate) continue;
+
+    if (target == current) break;
+
+    current = _hvc_switch_baudrate(dev, current, target);
+
+    if (current < 0 || current == target) break;
+  }
+
+  if (current < 0) return current;
+
+  if (hvc_baudrates[current] > max_baudrate)
+  {
+    HVC_LOG_ERROR("HVC stuck at %d baud, above the limit of %d", hvc_baudrates[current], max_baudrate);
+    return HVC_ERR_RESPONSE;
+  }
+
+  HVC_LOG_INFO("HVC link running at %d baud", hvc_baudrates[current]);
+  return hvc_baudrates[current];
+}
+
+void hvc_set_image_sink(struct hvc_device* dev, struct hvc_image_sink* sink)
+{
+  dev->image_sink = sink;
+}
+
+struct hvc_image_sink* hvc_get_image_sink(struct hvc_device* dev)
+{
+  return dev->image_sink;
+}
+
+/*
+ * Hand a chunk to the image sink. Retries while the sink applies
+ * backpressure, gives up once the retries run out.
+ */
+static int _hvc_sink_write(struct hvc_device* dev, const char* data, int length)
+{
+  struct hvc_image_sink* sink = dev->image_sink;
+  int written = 0;
+  int retry = 0;
+
+  while (written < length)
+  {
+    int res = sink->write(sink->ctx, data + written, length - written);
+
+    if (res < 0) return HVC_ERR_SINK;
+
+    if (res == 0)
+    {
+      if (++retry > HVC_IMAGE_SINK_RETRY) return HVC_ERR_SINK;
+
+      hvc_sleep(dev, HVC_IMAGE_SINK_SLEEP);
+      continue;
     }
 
-    // Check for missing bytes, this could've happened because of buffer overflow
-    // or just slow processing.
-    if (size > 0)
+    retry = 0;
+    written += res;
+  }
+
+  return HVC_OK;
+}
+
+/*
+ * Stream the image part of an execution response to the image sink,
+ * in exact length chunks as soon as they arrive. The image is always
+ * fully drained from the transport, even if the sink gives up, so the
+ * next response starts on a clean boundary.
+ */
+static int _hvc_read_image(struct hvc_device* dev, int size)
+{
+  char xy[HVC_IMAGE_HEADER_SIZE];
+
+  // Read the XY values, first 4 bytes of the image response
+  if (size < HVC_IMAGE_HEADER_SIZE || hvc_read_bytes(dev, xy, sizeof(xy)) != sizeof(xy))
+  {
+    HVC_LOG_ERROR("Image header missing from response");
+    return _hvc_check(dev, HVC_ERR_SHORT_READ);
+  }
+
+  size -= sizeof(xy);
+
+  int width = util_bytes_to_int(xy[0], xy[1]);
+  int height = util_bytes_to_int(xy[2], xy[3]);
+
+  HVC_LOG_INFO("Image Detected: %d X %d (bytes: %d)", width, height, width * height);
+
+  // Without a sink (or if the sink declines) the image is read into the void
+  struct hvc_image_sink* sink = dev->image_sink;
+  int status = HVC_OK;
+  bool streaming = sink && sink->begin(sink->ctx, width, height);
+  bool began = streaming;
+
+  char chunk[HVC_IMAGE_READ_BUFFER];
+
+  while (size > 0)
+  {
+    // Wait for the HVC to send more data, give up if nothing arrives before the deadline
+    int available = hvc_wait_bytes_available(dev, 1, HVC_RESPONSE_TIMEOUT);
+
+    if (!available) break;
+
+    if (available > size) available = size;
+    if (available > (int) sizeof(chunk)) available = sizeof(chunk);
+
+    int read = hvc_read_bytes(dev, chunk, available);
+
+    if (read <= 0) break;
+
+    size -= read;
+
+    if (streaming && (status = _hvc_sink_write(dev, chunk, read)) != HVC_OK)
     {
-      hvc_log_error("Missing bytes from response (%d)", size);
+      HVC_LOG_ERROR("Image sink aborted, draining remaining %d bytes", size);
+      streaming = false;
     }
+  }
+
+  // Check for missing bytes, this could've happened because of buffer overflow
+  // or just slow processing.
+  if (size > 0)
+  {
+    HVC_LOG_ERROR("Missing bytes from response (%d)", size);
+    dev->metrics.image_missing += size;
+    hvc_trace_event(dev, HVC_TRACE_IMAGE, status, size);
 
-    if (fp) fclose(fp);
+    if (status == HVC_OK) status = HVC_ERR_SHORT_READ;
+  }
+
+  if (began && sink->end) sink->end(sink->ctx, status);
+
+  return _hvc_check(dev, status);
+}
+
+struct hvc_execution_response* hvc_execution(struct hvc_device* dev, int function, int image)
+{
+  struct hvc_execution_response* res = (struct hvc_execution_response*) malloc(sizeof(struct hvc_execution_response));
+
+  if (res && hvc_execution_r(dev, function, image, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
   }
 
   return res;
-}
\ No newline at end of file
+}
+
+int hvc_execution_r(struct hvc_device* dev, int function, int image, struct hvc_execution_response* res)
+{
+  struct hvc_execute_request req = { .function = function, .image = image };
+
+  int status = _hvc_request(dev, HVC_CMD_EXECUTE, &req);
+
+  if (status != HVC_OK) return status;
+
+  // Size declaration
+  int size = dev->last_response_length;
+
+  // Without an image the whole payload is read in one go
+  if (image == HVC_EX_IMAGE_NONE)
+  {
+    status = _hvc_read_payload(dev, size);
+
+    if (status != HVC_OK) return status;
+
+    return _hvc_check(dev, hvc_parse_execution(dev->recv_buffer, size, function, res));
+  }
+
+  // Read the counts first, they tell us how many record bytes follow
+  if (size < HVC_EXECUTION_HEADER_SIZE || hvc_read_bytes(dev, dev->recv_buffer, HVC_EXECUTION_HEADER_SIZE) != HVC_EXECUTION_HEADER_SIZE)
+  {
+    HVC_LOG_ERROR("Unable to read detection header");
+    return _hvc_check(dev, HVC_ERR_SHORT_READ);
+  }
+
+  int payload_size = hvc_execution_payload_size(dev->recv_buffer, function);
+
+  if (payload_size < 0 || payload_size > size)
+  {
+    HVC_LOG_ERROR("Detection records exceed response (%d/%d)", payload_size, size);
+    return _hvc_check(dev, HVC_ERR_PAYLOAD);
+  }
+
+  // Read all detection records in one go, then decode them from memory
+  int records = payload_size - HVC_EXECUTION_HEADER_SIZE;
+
+  if (records > 0 && hvc_read_bytes(dev, dev->recv_buffer + HVC_EXECUTION_HEADER_SIZE, records) != records)
+  {
+    HVC_LOG_ERROR("Unable to read detection records (%d)", records);
+    return _hvc_check(dev, HVC_ERR_SHORT_READ);
+  }
+
+  size -= payload_size;
+
+  status = hvc_parse_execution(dev->recv_buffer, payload_size, function, res);
+
+  if (status != HVC_OK) return _hvc_check(dev, status);
+
+  // Stream the raw image bytes to the registered sink, the detections
+  // are decoded already but a lost image still fails the execution
+  return _hvc_read_image(dev, size);
+}
+
+
+static bool _hvc_valid_user(int user_id, int data_id)
+{
+  if (user_id < 0 || user_id >= HVC_ALBUM_MAX_USERS || data_id < 0 || data_id >= HVC_ALBUM_MAX_DATA)
+  {
+    HVC_LOG_ERROR("User %d data %d out of range", user_id, data_id);
+    return false;
+  }
+
+  return true;
+}
+
+int hvc_register_data(struct hvc_device* dev, int user_id, int data_id)
+{
+  if (!_hvc_valid_user(user_id, data_id)) return HVC_ERR_ARGS;
+
+  HVC_LOG_INFO("Registering HVC user %d data %d", user_id, data_id);
+
+  struct hvc_user_request req = { .user_id = user_id, .data_id = data_id };
+
+  int status = _hvc_request(dev, HVC_CMD_REGISTER_DATA, &req);
+
+  if (status != HVC_OK) return status;
+
+  // The registered face comes back as an image
+  return _hvc_read_image(dev, dev->last_response_length);
+}
+
+int hvc_delete_data(struct hvc_device* dev, int user_id, int data_id)
+{
+  if (!_hvc_valid_user(user_id, data_id)) return HVC_ERR_ARGS;
+
+  HVC_LOG_INFO("Deleting HVC user %d data %d", user_id, data_id);
+
+  struct hvc_user_request req = { .user_id = user_id, .data_id = data_id };
+
+  return hvc_command_run(dev, HVC_CMD_DELETE_DATA, &req, NULL);
+}
+
+int hvc_delete_user(struct hvc_device* dev, int user_id)
+{
+  if (!_hvc_valid_user(user_id, 0)) return HVC_ERR_ARGS;
+
+  HVC_LOG_INFO("Deleting HVC user %d", user_id);
+
+  struct hvc_user_request req = { .user_id = user_id };
+
+  return hvc_command_run(dev, HVC_CMD_DELETE_USER, &req, NULL);
+}
+
+int hvc_delete_all_data(struct hvc_device* dev)
+{
+  HVC_LOG_INFO("Deleting all HVC users");
+
+  return hvc_command_run(dev, HVC_CMD_DELETE_ALL_DATA, NULL, NULL);
+}
+
+struct hvc_get_user_data_response* hvc_get_user_data(struct hvc_device* dev, int user_id)
+{
+  struct hvc_get_user_data_response* res = (struct hvc_get_user_data_response*) malloc(sizeof(struct hvc_get_user_data_response));
+
+  if (res && hvc_get_user_data_r(dev, user_id, res) != HVC_OK)
+  {
+    free(res);
+    return NULL;
+  }
+
+  return res;
+}
+
+int hvc_get_user_data_r(struct hvc_device* dev, int user_id, struct hvc_get_user_data_response* res)
+{
+  if (!_hvc_valid_user(user_id, 0)) return HVC_ERR_ARGS;
+
+  struct hvc_user_request req = { .user_id = user_id };
+
+  return hvc_command_run(dev, HVC_CMD_GET_USER_DATA, &req, res);
+}
+
+int hvc_save_album(struct hvc_device* dev, hvc_album_cb write, void* ctx)
+{
+  int status = _hvc_request(dev, HVC_CMD_SAVE_ALBUM, NULL);
+
+  if (status != HVC_OK) return status;
+
+  int size = dev->last_response_length;
+  int remaining = size;
+
+  if (size < HVC_ALBUM_SIZE_MIN || size > HVC_ALBUM_SIZE_MAX)
+  {
+    HVC_LOG_ERROR("Album size invalid: %d", size);
+    status = HVC_ERR_PAYLOAD;
+  }
+
+  HVC_LOG_INFO("Saving HVC album (bytes: %d)", size);
+
+  // Like images the album is always drained, even once the callback gave up
+  while (remaining > 0)
+  {
+    int available = hvc_wait_bytes_available(dev, 1, HVC_RESPONSE_TIMEOUT);
+
+    if (!available) break;
+
+    if (available > remaining) available = remaining;
+    if (available > HVC_ALBUM_CHUNK) available = HVC_ALBUM_CHUNK;
+
+    int read = hvc_read_bytes(dev, dev->recv_buffer, available);
+
+    if (read <= 0) break;
+
+    remaining -= read;
+
+    if (status == HVC_OK && write(ctx, dev->recv_buffer, read) != read)
+    {
+      HVC_LOG_ERROR("Album write aborted, draining remaining %d bytes", remaining);
+      status = HVC_ERR_SINK;
+    }
+  }
+
+  if (remaining > 0)
+  {
+    HVC_LOG_ERROR("Missing bytes from album (%d)", remaining);
+
+    if (status == HVC_OK) status = HVC_ERR_SHORT_READ;
+  }
+
+  return status == HVC_OK ? size : _hvc_check(dev, status);
+}
+
+int hvc_load_album(struct hvc_device* dev, int size, hvc_album_cb read, void* ctx)
+{
+  if (size < HVC_ALBUM_SIZE_MIN || size > HVC_ALBUM_SIZE_MAX)
+  {
+    HVC_LOG_ERROR("Album size invalid: %d", size);
+    return HVC_ERR_ARGS;
+  }
+
+  HVC_LOG_INFO("Loading HVC album (bytes: %d)", size);
+
+  // The command only carries the album size, the album follows it
+  const struct hvc_command* command = hvc_command_find(HVC_CMD_LOAD_ALBUM);
+  struct hvc_album_size_request req = { .size = size };
+  char data[SEND_BUFFER_SIZE - CMD_SIZE];
+
+  command->encode(data, &req);
+
+  int status = hvc_send_command(dev, HVC_CMD_LOAD_ALBUM, command->request_size, data);
+
+  if (status != HVC_OK) return status;
+
+  int remaining = size;
+
+  while (remaining > 0)
+  {
+    int chunk = remaining < HVC_ALBUM_CHUNK ? remaining : HVC_ALBUM_CHUNK;
+    int filled = read(ctx, dev->recv_buffer, chunk);
+
+    // The HVC is waiting for the rest of the album now, there is no way to
+    // cancel. Pad it out, the HVC will reject the album. A callback that
+    // claims more than it was asked for is treated the same, the HVC was
+    // announced size bytes.
+    if (filled <= 0 || filled > chunk)
+    {
+      HVC_LOG_ERROR("Album read aborted, padding remaining %d bytes", remaining);
+      memset(dev->recv_buffer, 0, chunk);
+      filled = chunk;
+      status = HVC_ERR_SINK;
+    }
+
+    if (hvc_write_bytes(dev, dev->recv_buffer, filled) != filled) return _hvc_check(dev, HVC_ERR_WRITE);
+
+    remaining -= filled;
+  }
+
+  int response = _hvc_receive_response(dev, command->timeout);
+
+  return status == HVC_OK ? response : _hvc_check(dev, status);
+}
+
+int hvc_write_album(struct hvc_device* dev)
+{
+  HVC_LOG_INFO("Writing HVC album to flash");
+
+  return hvc_command_run(dev, HVC_CMD_WRITE_ALBUM, NULL, NULL);
+}
+
+int hvc_reformat_flash(struct hvc_device* dev)
+{
+  HVC_LOG_INFO("Reformatting HVC flash");
+
+  return hvc_command_run(dev, HVC_CMD_REFORMAT_FLASH, NULL, NULL);
+}
@@ -0,0 +1,73 @@
+/**
+ * File backed album cache for the face recognition album.
+ */
+#include <stdio.h>
+#include "hvc.h"
+#include "hvc_album.h"
+
+static int _hvc_album_file_write(void* ctx, char* data, int length)
+{
+  FILE* fp = (FILE*) ctx;
+
+  if (fwrite(data, 1, length, fp) != (size_t) length) return -1;
+
+  return length;
+}
+
+static int _hvc_album_file_read(void* ctx, char* data, int length)
+{
+  FILE* fp = (FILE*) ctx;
+
+  return fread(data, 1, length, fp);
+}
+
+int hvc_album_save_file(struct hvc_device* dev, const char* path)
+{
+  FILE* fp = fopen(path, "wb");
+
+  if (!fp)
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", path);
+    return HVC_ERR_SINK;
+  }
+
+  int size = hvc_save_album(dev, _hvc_album_file_write, fp);
+
+  if (fclose(fp) != 0 && size >= 0) size = HVC_ERR_SINK;
+
+  // Never leave a partial album behind, it would be restored later on
+  if (size < 0)
+  {
+    HVC_LOG_ERROR("Unable to save album to %s (%d)", path, size);
+    remove(path);
+  }
+
+  return size;
+}
+
+int hvc_album_load_file(struct hvc_device* dev, const char* path)
+{
+  FILE* fp = fopen(path, "rb");
+
+  if (!fp)
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", path);
+    return HVC_ERR_ARGS;
+  }
+
+  fseek(fp, 0, SEEK_END);
+  int size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+
+  int status = hvc_load_album(dev, size, _hvc_album_file_read, fp);
+
+  fclose(fp);
+
+  if (status != HVC_OK)
+  {
+    HVC_LOG_ERROR("Unable to load album from %s (%d)", path, status);
+    return status;
+  }
+
+  return hvc_write_album(dev);
+}
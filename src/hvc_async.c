@@ -0,0 +1,455 @@
+/**
+ * Non-blocking HVC command engine. Frames responses with a state machine
+ * fed from whatever delivers UART bytes (driver events, a poll hook or an
+ * epoll loop), instead of blocking the calling task for the round trip.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_async.h"
+#include "hvc_command.h"
+#include "hvc_util.h"
+
+static void _hvc_async_complete(struct hvc_async* async, int status)
+{
+  async->state = HVC_ASYNC_IDLE;
+
+  hvc_command_done(async->dev, status);
+
+  if (async->cb) async->cb(async, status, async->ctx);
+}
+
+/*
+ * Finish the image and complete the command with the image status, the
+ * detections are decoded already like they are for the blocking API.
+ */
+static void _hvc_async_image_done(struct hvc_async* async, int status)
+{
+  struct hvc_image_sink* sink = hvc_get_image_sink(async->dev);
+
+  if (async->streaming && sink->end) sink->end(sink->ctx, status);
+
+  async->streaming = false;
+  _hvc_async_complete(async, async->status != HVC_OK ? async->status : status);
+}
+
+/*
+ * The rest of the response can't be what the command returns, drop it
+ */
+static void _hvc_async_discard(struct hvc_async* async, int status)
+{
+  async->status = status;
+  async->state = HVC_ASYNC_DISCARD;
+
+  if (async->remaining == 0) _hvc_async_complete(async, status);
+}
+
+/*
+ * Offer the parked chunk to the sink again. Returns false while the
+ * sink is still applying backpressure.
+ */
+static bool _hvc_async_flush_pending(struct hvc_async* async)
+{
+  struct hvc_image_sink* sink = hvc_get_image_sink(async->dev);
+
+  while (async->pending_offset < async->pending_length)
+  {
+    int res = sink->write(sink->ctx, async->pending + async->pending_offset, async->pending_length - async->pending_offset);
+
+    if (res == 0) return false;
+
+    if (res < 0)
+    {
+      HVC_LOG_ERROR("Image sink aborted, draining remaining %d bytes", async->remaining);
+      async->image_status = HVC_ERR_SINK;
+      async->streaming = false;
+      break;
+    }
+
+    async->pending_offset += res;
+    async->idle_ms = 0;
+  }
+
+  async->pending_offset = 0;
+  async->pending_length = 0;
+
+  // The chunk might have been the last one
+  if (async->state == HVC_ASYNC_IMAGE && async->remaining == 0)
+  {
+    _hvc_async_image_done(async, async->image_status);
+  }
+
+  return true;
+}
+
+void hvc_async_init(struct hvc_async* async, struct hvc_device* dev)
+{
+  memset(async, 0, sizeof(struct hvc_async));
+  async->dev = dev;
+  async->state = HVC_ASYNC_IDLE;
+}
+
+bool hvc_async_idle(struct hvc_async* async)
+{
+  return async->state == HVC_ASYNC_IDLE;
+}
+
+int hvc_async_submit(struct hvc_async* async, char cmd, const char* data, int data_size, hvc_async_cb cb, void* ctx)
+{
+  if (async->state != HVC_ASYNC_IDLE) return HVC_ERR_BUSY;
+
+  async->cmd = cmd;
+  async->cb = cb;
+  async->ctx = ctx;
+  async->header_length = 0;
+  async->discarded = 0;
+  async->payload_length = 0;
+  async->idle_ms = 0;
+  async->state = HVC_ASYNC_HEADER;
+
+  int status = hvc_send_command(async->dev, cmd, data_size, data);
+
+  if (status != HVC_OK) async->state = HVC_ASYNC_IDLE;
+
+  return status;
+}
+
+int hvc_async_execute(struct hvc_async* async, int function, int image, hvc_async_cb cb, void* ctx)
+{
+  if (async->state != HVC_ASYNC_IDLE) return HVC_ERR_BUSY;
+
+  struct hvc_execute_request req = { function, image };
+  char data[SEND_BUFFER_SIZE - CMD_SIZE];
+  int size = hvc_command_encode(HVC_CMD_EXECUTE, &req, data);
+
+  if (size < 0) return size;
+
+  async->function = function;
+  async->image = image;
+
+  return hvc_async_submit(async, HVC_CMD_EXECUTE, data, size, cb, ctx);
+}
+
+int hvc_async_want(struct hvc_async* async)
+{
+  int want;
+
+  switch (async->state)
+  {
+    case HVC_ASYNC_HEADER:
+      return HVC_HEADER_SIZE - async->header_length;
+
+    case HVC_ASYNC_PAYLOAD:
+      want = async->payload_target - async->payload_length;
+      break;
+
+    case HVC_ASYNC_IMAGE_HEADER:
+      want = HVC_IMAGE_HEADER_SIZE - async->image_header_length;
+      break;
+
+    case HVC_ASYNC_IMAGE:
+      if (async->pending_length) return 0;
+
+      want = HVC_IMAGE_READ_BUFFER;
+      break;
+
+    case HVC_ASYNC_DISCARD:
+      want = async->remaining;
+      break;
+
+    default:
+      // Idle, anything arriving now is line noise
+      return HVC_IMAGE_READ_BUFFER;
+  }
+
+  // Never read past the response, the next one may follow right behind
+  if (want > async->remaining) want = async->remaining;
+
+  return want > 0 ? want : 0;
+}
+
+/*
+ * Header complete, decide how the payload is received
+ */
+static void _hvc_async_header(struct hvc_async* async)
+{
+  uint8_t response_code = async->header[1];
+  int status = hvc_check_header(async->header, (uint8_t) async->cmd, &async->remaining);
+
+  if (status == HVC_ERR_SYNC)
+  {
+    // Line noise or a stale response, keep looking from the next sync code
+    int offset = hvc_resync_offset(async->header, HVC_HEADER_SIZE);
+
+    memmove(async->header, async->header + offset, HVC_HEADER_SIZE - offset);
+    async->header_length = HVC_HEADER_SIZE - offset;
+    async->discarded += offset;
+
+    if (async->discarded >= HVC_RESYNC_MAX)
+    {
+      HVC_LOG_ERROR("No response header in %d bytes", async->discarded);
+      hvc_count_resync(async->dev, async->discarded);
+      _hvc_async_complete(async, HVC_ERR_SYNC);
+    }
+
+    return;
+  }
+
+  if (async->discarded > 0)
+  {
+    HVC_LOG_ERROR("Resynchronised after discarding %d bytes", async->discarded);
+    hvc_count_resync(async->dev, async->discarded);
+    async->discarded = 0;
+  }
+
+  async->status = HVC_OK;
+  async->payload_length = 0;
+  async->idle_ms = 0;
+
+  if (response_code != 0x00)
+  {
+    HVC_LOG_ERROR("Header response code invalid: %02x", response_code);
+    _hvc_async_discard(async, HVC_ERR_RESPONSE);
+    return;
+  }
+  else if (async->cmd == HVC_CMD_EXECUTE)
+  {
+    // The detection counts tell us how many record bytes follow
+    async->payload_target = HVC_EXECUTION_HEADER_SIZE;
+    async->state = HVC_ASYNC_PAYLOAD;
+  }
+  else if (async->remaining > RECV_BUFFER_SIZE)
+  {
+    HVC_LOG_ERROR("Response payload too large: %d", async->remaining);
+    _hvc_async_discard(async, HVC_ERR_PAYLOAD);
+    return;
+  }
+  else
+  {
+    async->payload_target = async->remaining;
+    async->state = HVC_ASYNC_PAYLOAD;
+  }
+
+  if (async->remaining == 0) _hvc_async_complete(async, async->status);
+}
+
+/*
+ * Payload target reached, either grow it (execution records) or move
+ * on to the image or completion.
+ */
+static void _hvc_async_payload(struct hvc_async* async)
+{
+  if (async->cmd == HVC_CMD_EXECUTE && async->payload_target == HVC_EXECUTION_HEADER_SIZE)
+  {
+    int size = hvc_execution_payload_size(async->payload, async->function);
+
+    if (size < 0 || size - HVC_EXECUTION_HEADER_SIZE > async->remaining)
+    {
+      _hvc_async_discard(async, HVC_ERR_PAYLOAD);
+      return;
+    }
+
+    async->payload_target = size;
+
+    if (size > async->payload_length) return;
+  }
+
+  if (async->remaining == 0)
+  {
+    _hvc_async_complete(async, async->status);
+  }
+  else if (async->cmd == HVC_CMD_EXECUTE && async->image != HVC_EX_IMAGE_NONE)
+  {
+    if (async->remaining < HVC_IMAGE_HEADER_SIZE)
+    {
+      HVC_LOG_ERROR("Image header missing from response");
+      _hvc_async_discard(async, HVC_ERR_PAYLOAD);
+      return;
+    }
+
+    async->image_header_length = 0;
+    async->state = HVC_ASYNC_IMAGE_HEADER;
+  }
+  else
+  {
+    // More data than the command should return, drop it
+    async->state = HVC_ASYNC_DISCARD;
+  }
+}
+
+static void _hvc_async_image_header(struct hvc_async* async)
+{
+  struct hvc_image_sink* sink = hvc_get_image_sink(async->dev);
+
+  int width = util_bytes_to_int(async->image_header[0], async->image_header[1]);
+  int height = util_bytes_to_int(async->image_header[2], async->image_header[3]);
+
+  HVC_LOG_INFO("Image Detected: %d X %d (bytes: %d)", width, height, width * height);
+
+  // The sink is promised exactly width x height bytes
+  if (width * height != async->remaining)
+  {
+    HVC_LOG_ERROR("Image size does not match response (%d/%d)", width * height, async->remaining);
+    _hvc_async_discard(async, HVC_ERR_PAYLOAD);
+    return;
+  }
+
+  async->streaming = sink && sink->begin(sink->ctx, width, height);
+  async->image_status = HVC_OK;
+  async->pending_offset = 0;
+  async->pending_length = 0;
+  async->state = HVC_ASYNC_IMAGE;
+
+  if (async->remaining == 0) _hvc_async_image_done(async, HVC_OK);
+}
+
+static void _hvc_async_image(struct hvc_async* async, const char* data, int length)
+{
+  struct hvc_image_sink* sink = hvc_get_image_sink(async->dev);
+
+  if (async->streaming)
+  {
+    int res = sink->write(sink->ctx, data, length);
+
+    if (res < 0)
+    {
+      HVC_LOG_ERROR("Image sink aborted, draining remaining %d bytes", async->remaining);
+      async->image_status = HVC_ERR_SINK;
+      async->streaming = false;
+    }
+    else if (res < length)
+    {
+      // Backpressure, park the rest until the sink catches up
+      memcpy(async->pending, data + res, length - res);
+      async->pending_offset = 0;
+      async->pending_length = length - res;
+      return;
+    }
+  }
+
+  if (async->remaining == 0) _hvc_async_image_done(async, async->image_status);
+}
+
+int hvc_async_feed(struct hvc_async* async, const char* data, int length)
+{
+  int consumed = 0;
+
+  if (async->pending_length && !_hvc_async_flush_pending(async)) return 0;
+
+  while (consumed < length)
+  {
+    int want = hvc_async_want(async);
+
+    if (want <= 0) break;
+
+    int chunk = length - consumed;
+
+    if (chunk > want) chunk = want;
+
+    const char* bytes = data + consumed;
+    consumed += chunk;
+
+    // The header deadline runs from submission, noise doesn't extend it
+    if (async->state != HVC_ASYNC_HEADER) async->idle_ms = 0;
+
+    switch (async->state)
+    {
+      case HVC_ASYNC_HEADER:
+        memcpy(async->header + async->header_length, bytes, chunk);
+        async->header_length += chunk;
+
+        if (async->header_length == HVC_HEADER_SIZE) _hvc_async_header(async);
+        break;
+
+      case HVC_ASYNC_PAYLOAD:
+        memcpy(async->payload + async->payload_length, bytes, chunk);
+        async->payload_length += chunk;
+        async->remaining -= chunk;
+
+        if (async->payload_length == async->payload_target) _hvc_async_payload(async);
+        break;
+
+      case HVC_ASYNC_IMAGE_HEADER:
+        memcpy(async->image_header + async->image_header_length, bytes, chunk);
+        async->image_header_length += chunk;
+        async->remaining -= chunk;
+
+        if (async->image_header_length == HVC_IMAGE_HEADER_SIZE) _hvc_async_image_header(async);
+        break;
+
+      case HVC_ASYNC_IMAGE:
+        async->remaining -= chunk;
+        _hvc_async_image(async, bytes, chunk);
+        break;
+
+      case HVC_ASYNC_DISCARD:
+        async->remaining -= chunk;
+
+        if (async->remaining == 0) _hvc_async_complete(async, async->status);
+        break;
+
+      default:
+        HVC_LOG_DEBUG("Discarding %d unexpected bytes", chunk);
+        break;
+    }
+  }
+
+  return consumed;
+}
+
+void hvc_async_poll(struct hvc_async* async)
+{
+  char buffer[HVC_IMAGE_READ_BUFFER];
+
+  if (async->pending_length && !_hvc_async_flush_pending(async)) return;
+
+  int want;
+  int available;
+
+  while ((want = hvc_async_want(async)) > 0 && (available = hvc_read_bytes_available(async->dev)) > 0)
+  {
+    if (want > available) want = available;
+    if (want > (int) sizeof(buffer)) want = sizeof(buffer);
+
+    int read = hvc_read_bytes(async->dev, buffer, want);
+
+    if (read <= 0) break;
+
+    hvc_async_feed(async, buffer, read);
+  }
+}
+
+void hvc_async_tick(struct hvc_async* async, int elapsed_ms)
+{
+  if (async->state == HVC_ASYNC_IDLE) return;
+
+  async->idle_ms += elapsed_ms;
+
+  // The header may take a while (detection runs on the sensor), once the
+  // response is flowing only short gaps are allowed.
+  int timeout = HVC_RESPONSE_TIMEOUT;
+
+  if (async->state == HVC_ASYNC_HEADER)
+  {
+    const struct hvc_command* command = hvc_command_find((uint8_t) async->cmd);
+
+    if (command) timeout = command->timeout;
+
+    timeout += async->dev->read_retry * HVC_READ_RETRY_SLEEP;
+  }
+
+  if (async->idle_ms <= timeout) return;
+
+  HVC_LOG_ERROR("Response timed out in state %d", async->state);
+
+  if (async->state == HVC_ASYNC_IMAGE)
+  {
+    struct hvc_image_sink* sink = hvc_get_image_sink(async->dev);
+
+    if (async->streaming && sink->end) sink->end(sink->ctx, HVC_ERR_TIMEOUT);
+
+    async->streaming = false;
+  }
+
+  async->pending_length = 0;
+  _hvc_async_complete(async, HVC_ERR_TIMEOUT);
+}
@@ -0,0 +1,183 @@
+/**
+ * Command descriptors. Every command the library speaks is described
+ * once, request and response layouts, payload lengths and timeout, and
+ * encoded and decoded by the generic codecs generated from its layouts.
+ */
+#include "hvc.h"
+#include "hvc_command.h"
+
+/*
+ * Codecs behind the descriptors, typed on the inside and void on the
+ * outside so every command fits the same table.
+ */
+#define HVC_DEFINE_COMMAND_DECODER(name, type, LAYOUT) \
+  HVC_DEFINE_DECODER(name##_fields, type, LAYOUT) \
+  static const char* name(const char* payload, void* response) \
+  { \
+    return name##_fields(payload, (type*) response); \
+  }
+
+#define HVC_DEFINE_COMMAND_ENCODER(name, type, LAYOUT) \
+  HVC_DEFINE_ENCODER(name##_fields, type, LAYOUT) \
+  static char* name(char* data, const void* request) \
+  { \
+    return name##_fields(data, (const type*) request); \
+  }
+
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_version, struct hvc_get_version_response, HVC_LAYOUT_VERSION)
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_camera_angle, struct hvc_get_camera_angle_response, HVC_LAYOUT_CAMERA_ANGLE)
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_thresholds, struct hvc_get_threshold_values_response, HVC_LAYOUT_THRESHOLDS)
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_detection_size, struct hvc_get_detection_size_response, HVC_LAYOUT_DETECTION_SIZE)
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_face_angle, struct hvc_get_face_angle_response, HVC_LAYOUT_FACE_ANGLE)
+HVC_DEFINE_COMMAND_DECODER(_hvc_decode_user_data, struct hvc_get_user_data_response, HVC_LAYOUT_USER_DATA)
+
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_camera_angle, struct hvc_get_camera_angle_response, HVC_LAYOUT_CAMERA_ANGLE)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_thresholds, struct hvc_get_threshold_values_response, HVC_LAYOUT_THRESHOLDS)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_detection_size, struct hvc_get_detection_size_response, HVC_LAYOUT_DETECTION_SIZE)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_face_angle, struct hvc_get_face_angle_response, HVC_LAYOUT_FACE_ANGLE)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_execute, struct hvc_execute_request, HVC_LAYOUT_EXECUTE)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_baudrate, struct hvc_baudrate_request, HVC_LAYOUT_BAUDRATE)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_user, struct hvc_user_request, HVC_LAYOUT_USER)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_user_id, struct hvc_user_request, HVC_LAYOUT_USER_ID)
+HVC_DEFINE_COMMAND_ENCODER(_hvc_encode_album_size, struct hvc_album_size_request, HVC_LAYOUT_ALBUM_SIZE)
+
+/*
+ * The layouts have to add up to the sizes the protocol defines
+ */
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_VERSION) == HVC_VERSION_SIZE, "version layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_CAMERA_ANGLE) == HVC_CAMERA_ANGLE_SIZE, "camera angle layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_THRESHOLDS) == HVC_THRESHOLDS_SIZE, "thresholds layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_DETECTION_SIZE) == HVC_DETECTION_LIMITS_SIZE, "detection size layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_ANGLE) == HVC_FACE_ANGLE_SIZE, "face angle layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_USER_DATA) == HVC_USER_DATA_SIZE, "user data layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_DETECTION) == HVC_DETECTION_SIZE, "detection layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_DIRECTION) == HVC_FACE_DIRECTION_SIZE, "face direction layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_AGE) == HVC_FACE_AGE_SIZE, "face age layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_GENDER) == HVC_FACE_GENDER_SIZE, "face gender layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_GAZE) == HVC_FACE_GAZE_SIZE, "face gaze layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_BLINK) == HVC_FACE_BLINK_SIZE, "face blink layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_EXPRESSION) == HVC_FACE_EXPRESSION_SIZE, "face expression layout");
+_Static_assert(HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_RECOGNITION) == HVC_FACE_RECOGNITION_SIZE, "face recognition layout");
+
+/*
+ * The largest request has to fit the send buffer behind the command header
+ */
+_Static_assert(CMD_SIZE + HVC_LAYOUT_SIZE(HVC_LAYOUT_DETECTION_SIZE) <= SEND_BUFFER_SIZE, "request exceeds send buffer");
+
+#define HVC_COMMAND_COUNT (HVC_CMD_REFORMAT_FLASH + 1)
+
+static const struct hvc_command hvc_commands[HVC_COMMAND_COUNT] = {
+  [HVC_CMD_GET_VERSION] = {
+    "get_version", 0, HVC_VERSION_SIZE, HVC_VERSION_SIZE,
+    HVC_RESPONSE_TIMEOUT, NULL, _hvc_decode_version
+  },
+  [HVC_CMD_SET_CAMERA_ANGLE] = {
+    "set_camera_angle", HVC_LAYOUT_SIZE(HVC_LAYOUT_CAMERA_ANGLE), 0, 0,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_camera_angle, NULL
+  },
+  [HVC_CMD_GET_CAMERA_ANGLE] = {
+    "get_camera_angle", 0, HVC_CAMERA_ANGLE_SIZE, HVC_CAMERA_ANGLE_SIZE,
+    HVC_RESPONSE_TIMEOUT, NULL, _hvc_decode_camera_angle
+  },
+  [HVC_CMD_EXECUTE] = {
+    "execute", HVC_LAYOUT_SIZE(HVC_LAYOUT_EXECUTE), HVC_EXECUTION_HEADER_SIZE, RECV_BUFFER_SIZE + HVC_IMAGE_MAX_SIZE,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_execute, NULL
+  },
+  [HVC_CMD_SET_THRESHOLD_VALUES] = {
+    "set_threshold_values", HVC_LAYOUT_SIZE(HVC_LAYOUT_THRESHOLDS), 0, 0,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_thresholds, NULL
+  },
+  [HVC_CMD_GET_THRESHOLD_VALUES] = {
+    "get_threshold_values", 0, HVC_THRESHOLDS_SIZE, HVC_THRESHOLDS_SIZE,
+    HVC_RESPONSE_TIMEOUT, NULL, _hvc_decode_thresholds
+  },
+  [HVC_CMD_SET_DETECTION_SIZE] = {
+    "set_detection_size", HVC_LAYOUT_SIZE(HVC_LAYOUT_DETECTION_SIZE), 0, 0,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_detection_size, NULL
+  },
+  [HVC_CMD_GET_DETECTION_SIZE] = {
+    "get_detection_size", 0, HVC_DETECTION_LIMITS_SIZE, HVC_DETECTION_LIMITS_SIZE,
+    HVC_RESPONSE_TIMEOUT, NULL, _hvc_decode_detection_size
+  },
+  [HVC_CMD_SET_FACE_ANGLE] = {
+    "set_face_angle", HVC_LAYOUT_SIZE(HVC_LAYOUT_FACE_ANGLE), 0, 0,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_face_angle, NULL
+  },
+  [HVC_CMD_GET_FACE_ANGLE] = {
+    "get_face_angle", 0, HVC_FACE_ANGLE_SIZE, HVC_FACE_ANGLE_SIZE,
+    HVC_RESPONSE_TIMEOUT, NULL, _hvc_decode_face_angle
+  },
+  [HVC_CMD_SET_BAUDRATE] = {
+    "set_baudrate", HVC_LAYOUT_SIZE(HVC_LAYOUT_BAUDRATE), 0, 0,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_baudrate, NULL
+  },
+
+  // Album commands give the HVC time to detect a face or write its flash
+  [HVC_CMD_REGISTER_DATA] = {
+    "register_data", HVC_LAYOUT_SIZE(HVC_LAYOUT_USER), HVC_REGISTER_IMAGE_SIZE, HVC_REGISTER_IMAGE_SIZE,
+    HVC_ALBUM_TIMEOUT, _hvc_encode_user, NULL
+  },
+  [HVC_CMD_DELETE_DATA] = {
+    "delete_data", HVC_LAYOUT_SIZE(HVC_LAYOUT_USER), 0, 0,
+    HVC_ALBUM_TIMEOUT, _hvc_encode_user, NULL
+  },
+  [HVC_CMD_DELETE_USER] = {
+    "delete_user", HVC_LAYOUT_SIZE(HVC_LAYOUT_USER_ID), 0, 0,
+    HVC_ALBUM_TIMEOUT, _hvc_encode_user_id, NULL
+  },
+  [HVC_CMD_DELETE_ALL_DATA] = {
+    "delete_all_data", 0, 0, 0,
+    HVC_ALBUM_TIMEOUT, NULL, NULL
+  },
+  [HVC_CMD_GET_USER_DATA] = {
+    "get_user_data", HVC_LAYOUT_SIZE(HVC_LAYOUT_USER_ID), HVC_USER_DATA_SIZE, HVC_USER_DATA_SIZE,
+    HVC_RESPONSE_TIMEOUT, _hvc_encode_user_id, _hvc_decode_user_data
+  },
+  [HVC_CMD_SAVE_ALBUM] = {
+    "save_album", 0, HVC_ALBUM_SIZE_MIN, HVC_ALBUM_SIZE_MAX,
+    HVC_ALBUM_TIMEOUT, NULL, NULL
+  },
+  [HVC_CMD_LOAD_ALBUM] = {
+    "load_album", HVC_LAYOUT_SIZE(HVC_LAYOUT_ALBUM_SIZE), 0, 0,
+    HVC_ALBUM_TIMEOUT, _hvc_encode_album_size, NULL
+  },
+  [HVC_CMD_WRITE_ALBUM] = {
+    "write_album", 0, 0, 0,
+    HVC_ALBUM_TIMEOUT, NULL, NULL
+  },
+  [HVC_CMD_REFORMAT_FLASH] = {
+    "reformat_flash", 0, 0, 0,
+    HVC_ALBUM_TIMEOUT, NULL, NULL
+  }
+};
+
+const struct hvc_command* hvc_command_find(int cmd)
+{
+  if (cmd < 0 || cmd >= HVC_COMMAND_COUNT || !hvc_commands[cmd].name) return NULL;
+
+  return &hvc_commands[cmd];
+}
+
+int hvc_command_encode(int cmd, const void* request, char* data)
+{
+  const struct hvc_command* command = hvc_command_find(cmd);
+
+  if (!command) return HVC_ERR_ARGS;
+
+  if (command->encode) command->encode(data, request);
+
+  return command->request_size;
+}
+
+int hvc_command_decode(int cmd, const char* payload, int length, void* response)
+{
+  const struct hvc_command* command = hvc_command_find(cmd);
+
+  if (!command || !command->decode) return HVC_ERR_ARGS;
+
+  if (length < command->response_min) return HVC_ERR_PAYLOAD;
+
+  command->decode(payload, response);
+
+  return HVC_OK;
+}
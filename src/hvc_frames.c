@@ -0,0 +1,85 @@
+/**
+ * Lock-free ring of detection frames, lets any number of consumers read
+ * results at their own pace without holding up the sensor task.
+ */
+#include <string.h>
+#include "hvc_frames.h"
+
+void hvc_frame_ring_init(struct hvc_frame_ring* ring, struct hvc_frame_slot* slots, int size)
+{
+  memset(slots, 0, sizeof(struct hvc_frame_slot) * size);
+
+  ring->slots = slots;
+  ring->size = size;
+  ring->head = 0;
+}
+
+void hvc_frame_ring_publish(struct hvc_frame_ring* ring, int64_t timestamp, const struct hvc_execution_response* res)
+{
+  uint32_t sequence = ring->head;
+  struct hvc_frame_slot* slot = &ring->slots[sequence % ring->size];
+  uint32_t seq = slot->seq;
+
+  // Mark the slot as being written before touching the frame
+  __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+
+  slot->frame.timestamp = timestamp;
+  slot->frame.sequence = sequence;
+  memcpy(&slot->frame.res, res, sizeof(struct hvc_execution_response));
+
+  __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+  __atomic_store_n(&ring->head, sequence + 1, __ATOMIC_RELEASE);
+}
+
+void hvc_frame_reader_init(struct hvc_frame_reader* reader, struct hvc_frame_ring* ring)
+{
+  reader->ring = ring;
+  reader->next = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  reader->dropped = 0;
+}
+
+bool hvc_frame_reader_read(struct hvc_frame_reader* reader, struct hvc_frame* frame)
+{
+  struct hvc_frame_ring* ring = reader->ring;
+
+  while (1)
+  {
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+    if (head == reader->next) return false;
+
+    // Everything older than one lap has been overwritten
+    if (head - reader->next > (uint32_t) ring->size)
+    {
+      reader->dropped += head - reader->next - ring->size;
+      reader->next = head - ring->size;
+    }
+
+    struct hvc_frame_slot* slot = &ring->slots[reader->next % ring->size];
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    // The producer is overwriting this frame right now. Skip it rather
+    // than wait, the producer may not run until we give up the CPU.
+    if (seq & 1)
+    {
+      reader->dropped++;
+      reader->next++;
+      continue;
+    }
+
+    memcpy(frame, &slot->frame, sizeof(struct hvc_frame));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    // Overwritten while we copied it, or before we got to it
+    if (__atomic_load_n(&slot->seq, __ATOMIC_RELAXED) != seq || frame->sequence != reader->next)
+    {
+      reader->dropped++;
+      reader->next++;
+      continue;
+    }
+
+    reader->next++;
+    return true;
+  }
+}
@@ -0,0 +1,559 @@
+/**
+ * Image sinks for the images streamed by hvc_execution.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "hvc.h"
+#include "hvc_image.h"
+#include "hvc_util.h"
+
+static bool _hvc_image_file_begin(void* ctx, int width, int height)
+{
+  struct hvc_image_file* file = (struct hvc_image_file*) ctx;
+
+  if (!(file->fp = fopen(file->path, file->append ? "ab" : "wb")))
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", file->path);
+    return false;
+  }
+
+  // Write dimensions as first 4 bytes
+  char xy[HVC_IMAGE_HEADER_SIZE];
+  util_int_into_lsb_msb(xy, 0, width);
+  util_int_into_lsb_msb(xy, 2, height);
+
+  fwrite(xy, 1, sizeof(xy), file->fp);
+  return true;
+}
+
+static int _hvc_image_file_write(void* ctx, const char* data, int length)
+{
+  struct hvc_image_file* file = (struct hvc_image_file*) ctx;
+
+  if (fwrite(data, 1, length, file->fp) != (size_t) length)
+  {
+    HVC_LOG_ERROR("Unable to write image data to %s", file->path);
+    return -1;
+  }
+
+  return length;
+}
+
+static void _hvc_image_file_end(void* ctx, int status)
+{
+  struct hvc_image_file* file = (struct hvc_image_file*) ctx;
+
+  fclose(file->fp);
+  file->fp = NULL;
+
+  if (status != HVC_OK)
+  {
+    HVC_LOG_ERROR("Image capture to %s incomplete (%d)", file->path, status);
+  }
+}
+
+void hvc_image_file_sink_init(struct hvc_image_sink* sink, struct hvc_image_file* file, const char* path)
+{
+  file->path = path;
+  file->fp = NULL;
+  file->append = false;
+
+  sink->begin = _hvc_image_file_begin;
+  sink->write = _hvc_image_file_write;
+  sink->end = _hvc_image_file_end;
+  sink->ctx = file;
+}
+
+/*
+ * Free space behind the frame in progress. One byte is kept free to
+ * tell a full ring from an empty one.
+ */
+static int _hvc_image_ring_space(struct hvc_image_ring* ring)
+{
+  int tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  return (tail - ring->cursor - 1 + ring->size) % ring->size;
+}
+
+/*
+ * Add bytes to the frame in progress, the consumer doesn't see them
+ * until the frame is published
+ */
+static int _hvc_image_ring_push(struct hvc_image_ring* ring, const char* data, int length)
+{
+  int space = _hvc_image_ring_space(ring);
+
+  if (length > space) length = space;
+
+  int cursor = ring->cursor;
+  int first = ring->size - cursor;
+
+  if (first > length) first = length;
+
+  memcpy(ring->buffer + cursor, data, first);
+  memcpy(ring->buffer, data + first, length - first);
+
+  ring->cursor = (cursor + length) % ring->size;
+  return length;
+}
+
+static bool _hvc_image_ring_begin(void* ctx, int width, int height)
+{
+  struct hvc_image_ring* ring = (struct hvc_image_ring*) ctx;
+
+  char xy[HVC_IMAGE_HEADER_SIZE];
+  util_int_into_lsb_msb(xy, 0, width);
+  util_int_into_lsb_msb(xy, 2, height);
+
+  // Frames are only published whole, one that can never fit is skipped
+  // rather than held up until the capture times out
+  if ((int) sizeof(xy) + width * height > ring->size - 1)
+  {
+    HVC_LOG_ERROR("Image ring of %d bytes can't hold a %d x %d image", ring->size, width, height);
+    return false;
+  }
+
+  // Start over from the last published frame
+  ring->cursor = ring->head;
+
+  // Only start a frame if its header fits, the consumer relies on it
+  if (_hvc_image_ring_space(ring) < (int) sizeof(xy))
+  {
+    HVC_LOG_ERROR("Image ring full, skipping image");
+    return false;
+  }
+
+  _hvc_image_ring_push(ring, xy, sizeof(xy));
+  return true;
+}
+
+static int _hvc_image_ring_write(void* ctx, const char* data, int length)
+{
+  return _hvc_image_ring_push((struct hvc_image_ring*) ctx, data, length);
+}
+
+static void _hvc_image_ring_end(void* ctx, int status)
+{
+  struct hvc_image_ring* ring = (struct hvc_image_ring*) ctx;
+
+  if (status != HVC_OK)
+  {
+    // Drop the partial frame, the consumer never saw any of it
+    ring->cursor = ring->head;
+    return;
+  }
+
+  __atomic_store_n(&ring->head, ring->cursor, __ATOMIC_RELEASE);
+  __atomic_add_fetch(&ring->frames, 1, __ATOMIC_RELEASE);
+}
+
+void hvc_image_ring_sink_init(struct hvc_image_sink* sink, struct hvc_image_ring* ring, char* buffer, int size)
+{
+  ring->buffer = buffer;
+  ring->size = size;
+  ring->head = 0;
+  ring->tail = 0;
+  ring->cursor = 0;
+  ring->frames = 0;
+
+  sink->begin = _hvc_image_ring_begin;
+  sink->write = _hvc_image_ring_write;
+  sink->end = _hvc_image_ring_end;
+  sink->ctx = ring;
+}
+
+int hvc_image_ring_read(struct hvc_image_ring* ring, char* data, int length)
+{
+  int head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+  int tail = ring->tail;
+  int available = (head - tail + ring->size) % ring->size;
+
+  if (length > available) length = available;
+
+  int first = ring->size - tail;
+
+  if (first > length) first = length;
+
+  memcpy(data, ring->buffer + tail, first);
+  memcpy(data + first, ring->buffer, length - first);
+
+  __atomic_store_n(&ring->tail, (tail + length) % ring->size, __ATOMIC_RELEASE);
+  return length;
+}
+
+/*
+ * JPEG-LS median predictor, falls back to the only neighbour there is
+ * along the top row and the left column
+ */
+static int _hvc_image_predict(int x, int y, int left, int up, int up_left)
+{
+  if (y == 0) return x == 0 ? 128 : left;
+  if (x == 0) return up;
+
+  int lo = left < up ? left : up;
+  int hi = left < up ? up : left;
+
+  if (up_left >= hi) return lo;
+  if (up_left <= lo) return hi;
+
+  return left + up - up_left;
+}
+
+/*
+ * Predict a block of a delta image from the previous image, unless its
+ * neighbours predicted the same columns of the row above better
+ */
+static bool _hvc_image_block_delta(const uint16_t* spatial, const uint16_t* delta, int block, int y)
+{
+  return y == 0 || delta[block] <= spatial[block];
+}
+
+/*
+ * Smallest Rice parameter that covers the mean residual
+ */
+static int _hvc_image_rice_k(int sum, int count)
+{
+  int k = 0;
+
+  while (k < 7 && (count << k) < sum) k++;
+
+  return k;
+}
+
+static void _hvc_image_rice_update(int* sum, int* count, int value)
+{
+  *sum += value;
+
+  // Halve the history now and then so the parameter follows the image
+  if (++*count == 64)
+  {
+    *sum >>= 1;
+    *count >>= 1;
+  }
+}
+
+static void _hvc_image_encoder_put(struct hvc_image_encoder* encoder, uint32_t code, int length)
+{
+  encoder->bits = (encoder->bits << length) | code;
+  encoder->bit_count += length;
+
+  while (encoder->bit_count >= 8)
+  {
+    encoder->bit_count -= 8;
+    encoder->buffer[encoder->buffered++] = encoder->bits >> encoder->bit_count;
+  }
+}
+
+/*
+ * Hand staged bytes to the output sink, returns false if it failed
+ */
+static bool _hvc_image_encoder_flush(struct hvc_image_encoder* encoder)
+{
+  int sent = 0;
+
+  while (sent < encoder->buffered)
+  {
+    int res = encoder->out->write(encoder->out->ctx, encoder->buffer + sent, encoder->buffered - sent);
+
+    if (res < 0) return false;
+    if (res == 0) break;
+
+    sent += res;
+  }
+
+  memmove(encoder->buffer, encoder->buffer + sent, encoder->buffered - sent);
+  encoder->buffered -= sent;
+  encoder->bytes_out += sent;
+
+  return true;
+}
+
+static void _hvc_image_encoder_pixel(struct hvc_image_encoder* encoder, uint8_t pixel)
+{
+  int x = encoder->x;
+  int index = encoder->y * encoder->width + x;
+  int up = encoder->row[x];
+  int left = x > 0 ? encoder->row[x - 1] : 0;
+  int predicted = _hvc_image_predict(x, encoder->y, left, up, encoder->up_left);
+
+  encoder->up_left = up;
+  encoder->row[x] = pixel;
+
+  if (encoder->format == HVC_IMAGE_FORMAT_DELTA)
+  {
+    int previous = (uint8_t) encoder->reference[index];
+    int block = x / HVC_IMAGE_BLOCK;
+
+    if (x % HVC_IMAGE_BLOCK == 0)
+    {
+      encoder->use_delta = _hvc_image_block_delta(encoder->block_spatial, encoder->block_delta, block, encoder->y);
+      encoder->cost_spatial = 0;
+      encoder->cost_delta = 0;
+    }
+
+    encoder->cost_spatial += abs((int8_t) (pixel - predicted));
+    encoder->cost_delta += abs((int8_t) (pixel - previous));
+
+    if (x % HVC_IMAGE_BLOCK == HVC_IMAGE_BLOCK - 1 || x == encoder->width - 1)
+    {
+      encoder->block_spatial[block] = encoder->cost_spatial;
+      encoder->block_delta[block] = encoder->cost_delta;
+    }
+
+    if (encoder->use_delta) predicted = previous;
+  }
+
+  if (encoder->update_reference) encoder->reference[index] = pixel;
+
+  // Fold the residual into 0-255, small magnitudes first
+  int residual = (int8_t) (pixel - predicted);
+  int value = residual >= 0 ? residual * 2 : -residual * 2 - 1;
+  int k = _hvc_image_rice_k(encoder->rice_sum, encoder->rice_count);
+  int quotient = value >> k;
+
+  if (quotient < HVC_IMAGE_RICE_LIMIT)
+  {
+    _hvc_image_encoder_put(encoder, (1 << (quotient + 1)) - 2, quotient + 1);
+    _hvc_image_encoder_put(encoder, value & ((1 << k) - 1), k);
+  }
+  else
+  {
+    _hvc_image_encoder_put(encoder, (1 << HVC_IMAGE_RICE_LIMIT) - 1, HVC_IMAGE_RICE_LIMIT);
+    _hvc_image_encoder_put(encoder, value, 8);
+  }
+
+  _hvc_image_rice_update(&encoder->rice_sum, &encoder->rice_count, value);
+
+  if (++encoder->x == encoder->width)
+  {
+    encoder->x = 0;
+    encoder->y++;
+  }
+}
+
+static bool _hvc_image_encoder_begin(void* ctx, int width, int height)
+{
+  struct hvc_image_encoder* encoder = (struct hvc_image_encoder*) ctx;
+
+  if (width <= 0 || height <= 0 || width > HVC_IMAGE_MAX_WIDTH)
+  {
+    HVC_LOG_ERROR("Unable to encode a %d X %d image", width, height);
+    return false;
+  }
+
+  bool fits = width * height <= encoder->reference_size;
+  bool key = hvc_image_encoder_key_due(encoder) || width != encoder->width || height != encoder->height || !fits;
+
+  if (!encoder->out->begin(encoder->out->ctx, width, height)) return false;
+
+  encoder->width = width;
+  encoder->height = height;
+  encoder->x = 0;
+  encoder->y = 0;
+  encoder->format = key ? HVC_IMAGE_FORMAT_KEY : HVC_IMAGE_FORMAT_DELTA;
+  encoder->update_reference = fits;
+  encoder->up_left = 0;
+  encoder->rice_sum = 4;
+  encoder->rice_count = 1;
+  encoder->bits = 0;
+  encoder->bit_count = 0;
+  encoder->buffer[0] = encoder->format;
+  encoder->buffered = 1;
+  encoder->bytes_in = 0;
+  encoder->bytes_out = 0;
+
+  // The reference is overwritten as the image streams in, it only
+  // becomes valid again once the image completes
+  encoder->have_reference = false;
+
+  return true;
+}
+
+static int _hvc_image_encoder_write(void* ctx, const char* data, int length)
+{
+  struct hvc_image_encoder* encoder = (struct hvc_image_encoder*) ctx;
+
+  if (!_hvc_image_encoder_flush(encoder)) return -1;
+
+  // A pixel never takes more than 3 bytes, plus the partial byte before it
+  int consumed = 0;
+  int pixels = encoder->width * encoder->height - encoder->bytes_in;
+
+  if (length > pixels) length = pixels;
+
+  while (consumed < length && encoder->buffered <= HVC_IMAGE_ENCODER_BUFFER - 4)
+  {
+    _hvc_image_encoder_pixel(encoder, data[consumed++]);
+  }
+
+  encoder->bytes_in += consumed;
+
+  if (!_hvc_image_encoder_flush(encoder)) return -1;
+
+  return consumed;
+}
+
+static void _hvc_image_encoder_end(void* ctx, int status)
+{
+  struct hvc_image_encoder* encoder = (struct hvc_image_encoder*) ctx;
+
+  if (encoder->bit_count > 0) _hvc_image_encoder_put(encoder, 0, 8 - encoder->bit_count);
+
+  for (int retry = 0; encoder->buffered > 0 && retry <= HVC_IMAGE_SINK_RETRY; retry++)
+  {
+    if (!_hvc_image_encoder_flush(encoder)) break;
+  }
+
+  if (encoder->buffered > 0 && status == HVC_OK) status = HVC_ERR_SINK;
+
+  if (status == HVC_OK && encoder->update_reference)
+  {
+    encoder->have_reference = true;
+    encoder->since_key = encoder->format == HVC_IMAGE_FORMAT_KEY ? 0 : encoder->since_key + 1;
+  }
+
+  HVC_LOG_DEBUG("Image encoded %u -> %u bytes", encoder->bytes_in, encoder->bytes_out);
+
+  if (encoder->out->end) encoder->out->end(encoder->out->ctx, status);
+}
+
+void hvc_image_encoder_init(struct hvc_image_sink* sink, struct hvc_image_encoder* encoder, struct hvc_image_sink* out,
+  char* reference, int reference_size, int key_interval)
+{
+  memset(encoder, 0, sizeof(struct hvc_image_encoder));
+
+  encoder->out = out;
+  encoder->reference = reference;
+  encoder->reference_size = reference ? reference_size : 0;
+  encoder->key_interval = key_interval;
+
+  sink->begin = _hvc_image_encoder_begin;
+  sink->write = _hvc_image_encoder_write;
+  sink->end = _hvc_image_encoder_end;
+  sink->ctx = encoder;
+}
+
+bool hvc_image_encoder_key_due(const struct hvc_image_encoder* encoder)
+{
+  if (!encoder->reference || !encoder->have_reference) return true;
+
+  return encoder->key_interval > 0 && encoder->since_key + 1 >= encoder->key_interval;
+}
+
+/*
+ * Bit reader of the decoder, most significant bit first
+ */
+struct hvc_image_bits
+{
+  const char* data;
+  int length;
+  int pos;
+  uint32_t acc;
+  int count;
+};
+
+static bool _hvc_image_get(struct hvc_image_bits* bits, int length, int* value)
+{
+  while (bits->count < length)
+  {
+    if (bits->pos == bits->length) return false;
+
+    bits->acc = (bits->acc << 8) | (uint8_t) bits->data[bits->pos++];
+    bits->count += 8;
+  }
+
+  bits->count -= length;
+  *value = (bits->acc >> bits->count) & ((1 << length) - 1);
+
+  return true;
+}
+
+int hvc_image_decode(const char* data, int length, int width, int height, char* image)
+{
+  if (length < 1 || width <= 0 || height <= 0) return HVC_ERR_PAYLOAD;
+
+  int format = data[0];
+
+  if (format != HVC_IMAGE_FORMAT_KEY && format != HVC_IMAGE_FORMAT_DELTA) return HVC_ERR_PAYLOAD;
+
+  struct hvc_image_bits bits = { .data = data, .length = length, .pos = 1 };
+  int rice_sum = 4;
+  int rice_count = 1;
+
+  // Block costs of the row above, mirrors the encoder
+  uint16_t block_spatial[HVC_IMAGE_BLOCKS];
+  uint16_t block_delta[HVC_IMAGE_BLOCKS];
+  int cost_spatial = 0;
+  int cost_delta = 0;
+  bool use_delta = true;
+
+  if (width > HVC_IMAGE_MAX_WIDTH) return HVC_ERR_PAYLOAD;
+
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      int index = y * width + x;
+      int left = x > 0 ? (uint8_t) image[index - 1] : 0;
+      int up = y > 0 ? (uint8_t) image[index - width] : 0;
+      int up_left = x > 0 && y > 0 ? (uint8_t) image[index - width - 1] : 0;
+      int predicted = _hvc_image_predict(x, y, left, up, up_left);
+      int previous = (uint8_t) image[index];
+      int block = x / HVC_IMAGE_BLOCK;
+
+      if (format == HVC_IMAGE_FORMAT_DELTA && x % HVC_IMAGE_BLOCK == 0)
+      {
+        use_delta = _hvc_image_block_delta(block_spatial, block_delta, block, y);
+        cost_spatial = 0;
+        cost_delta = 0;
+      }
+
+      int k = _hvc_image_rice_k(rice_sum, rice_count);
+      int quotient = 0;
+      int bit;
+      int value;
+
+      while (quotient < HVC_IMAGE_RICE_LIMIT)
+      {
+        if (!_hvc_image_get(&bits, 1, &bit)) return HVC_ERR_PAYLOAD;
+        if (!bit) break;
+
+        quotient++;
+      }
+
+      if (quotient == HVC_IMAGE_RICE_LIMIT)
+      {
+        if (!_hvc_image_get(&bits, 8, &value)) return HVC_ERR_PAYLOAD;
+      }
+      else
+      {
+        if (!_hvc_image_get(&bits, k, &value)) return HVC_ERR_PAYLOAD;
+
+        value |= quotient << k;
+      }
+
+      if (value > 255) return HVC_ERR_PAYLOAD;
+
+      _hvc_image_rice_update(&rice_sum, &rice_count, value);
+
+      int residual = value & 1 ? -(value >> 1) - 1 : value >> 1;
+      int pixel = ((format == HVC_IMAGE_FORMAT_DELTA && use_delta ? previous : predicted) + residual) & 0xFF;
+
+      if (format == HVC_IMAGE_FORMAT_DELTA)
+      {
+        cost_spatial += abs((int8_t) (pixel - predicted));
+        cost_delta += abs((int8_t) (pixel - previous));
+
+        if (x % HVC_IMAGE_BLOCK == HVC_IMAGE_BLOCK - 1 || x == width - 1)
+        {
+          block_spatial[block] = cost_spatial;
+          block_delta[block] = cost_delta;
+        }
+      }
+
+      image[index] = pixel;
+    }
+  }
+
+  return bits.pos;
+}
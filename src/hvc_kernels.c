@@ -0,0 +1,243 @@
+/**
+ * Image kernels, vector paths for SSE2 and NEON with a portable C path
+ * every other target (ESP32 included) builds.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_kernels.h"
+
+#if defined(HVC_KERNEL_SSE2)
+#include <emmintrin.h>
+#elif defined(HVC_KERNEL_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+ * Pixels a 16 bit lane of the portable brightness sum takes before it
+ * has to be flushed, 256 * 255 still fits.
+ */
+#define HVC_KERNEL_SWAR_FLUSH 256
+
+#if defined(HVC_KERNEL_NEON)
+static uint32_t _hvc_kernel_neon_sum(uint32x4_t v)
+{
+  uint64x2_t pairs = vpaddlq_u32(v);
+
+  return (uint32_t) (vgetq_lane_u64(pairs, 0) + vgetq_lane_u64(pairs, 1));
+}
+#endif
+
+void hvc_kernel_downscale(const uint8_t* src, int width, int height, uint8_t* dst)
+{
+  for (int y = 0; y + 1 < height; y += 2)
+  {
+    const uint8_t* r0 = src + y * width;
+    const uint8_t* r1 = r0 + width;
+    int x = 0;
+
+#if defined(HVC_KERNEL_SSE2)
+    const __m128i low = _mm_set1_epi16(0x00FF);
+    const __m128i two = _mm_set1_epi16(2);
+
+    for (; x + 16 <= width; x += 16)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i*) (r0 + x));
+      __m128i b = _mm_loadu_si128((const __m128i*) (r1 + x));
+
+      // Even and odd pixels of both rows in 16 bit lanes
+      __m128i sum = _mm_add_epi16(_mm_and_si128(a, low), _mm_srli_epi16(a, 8));
+      sum = _mm_add_epi16(sum, _mm_and_si128(b, low));
+      sum = _mm_add_epi16(sum, _mm_srli_epi16(b, 8));
+      sum = _mm_srli_epi16(_mm_add_epi16(sum, two), 2);
+
+      _mm_storel_epi64((__m128i*) dst, _mm_packus_epi16(sum, sum));
+      dst += 8;
+    }
+#elif defined(HVC_KERNEL_NEON)
+    for (; x + 16 <= width; x += 16)
+    {
+      uint16x8_t sum = vpaddlq_u8(vld1q_u8(r0 + x));
+      sum = vpadalq_u8(sum, vld1q_u8(r1 + x));
+
+      vst1_u8(dst, vrshrn_n_u16(sum, 2));
+      dst += 8;
+    }
+#endif
+
+    for (; x + 1 < width; x += 2)
+    {
+      *dst++ = (uint8_t) ((r0[x] + r0[x + 1] + r1[x] + r1[x + 1] + 2) >> 2);
+    }
+  }
+}
+
+void hvc_kernel_histogram(const uint8_t* image, int length, uint32_t histogram[256])
+{
+  // Neighbouring pixels are often equal, counting every other one into a
+  // second table keeps the increments from waiting on each other
+  uint32_t odd[256];
+  int i = 0;
+
+  memset(histogram, 0, 256 * sizeof(uint32_t));
+  memset(odd, 0, sizeof(odd));
+
+  for (; i + 4 <= length; i += 4)
+  {
+    histogram[image[i]]++;
+    odd[image[i + 1]]++;
+    histogram[image[i + 2]]++;
+    odd[image[i + 3]]++;
+  }
+
+  for (; i < length; i++) histogram[image[i]]++;
+
+  for (int n = 0; n < 256; n++) histogram[n] += odd[n];
+}
+
+uint32_t hvc_kernel_sum(const uint8_t* image, int length)
+{
+  uint32_t sum = 0;
+  int i = 0;
+
+#if defined(HVC_KERNEL_SSE2)
+  __m128i acc = _mm_setzero_si128();
+
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i*) (image + i));
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(v, _mm_setzero_si128()));
+  }
+
+  sum = (uint32_t) _mm_cvtsi128_si32(acc) + (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+#elif defined(HVC_KERNEL_NEON)
+  uint32x4_t acc = vdupq_n_u32(0);
+
+  for (; i + 16 <= length; i += 16)
+  {
+    acc = vpadalq_u16(acc, vpaddlq_u8(vld1q_u8(image + i)));
+  }
+
+  sum = _hvc_kernel_neon_sum(acc);
+#else
+  // Four pixels per word, even and odd bytes summed in 16 bit lanes
+  while (i + 4 <= length)
+  {
+    uint32_t even = 0;
+    uint32_t odd = 0;
+
+    for (int n = 0; n < HVC_KERNEL_SWAR_FLUSH && i + 4 <= length; n++, i += 4)
+    {
+      uint32_t word;
+      memcpy(&word, image + i, sizeof(word));
+
+      even += word & 0x00FF00FF;
+      odd += (word >> 8) & 0x00FF00FF;
+    }
+
+    sum += (even & 0xFFFF) + (even >> 16) + (odd & 0xFFFF) + (odd >> 16);
+  }
+#endif
+
+  for (; i < length; i++) sum += image[i];
+
+  return sum;
+}
+
+int hvc_kernel_mean(const uint8_t* image, int length)
+{
+  if (length <= 0) return 0;
+
+  return (int) ((hvc_kernel_sum(image, length) + length / 2) / length);
+}
+
+void hvc_kernel_motion(const uint8_t* image, const uint8_t* previous, int length, int threshold, struct hvc_motion* motion)
+{
+  uint32_t sad = 0;
+  uint32_t changed = 0;
+  int i = 0;
+
+  if (threshold < 0) threshold = 0;
+  if (threshold > 255) threshold = 255;
+
+#if defined(HVC_KERNEL_SSE2)
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi8(1);
+  const __m128i limit = _mm_set1_epi8((char) threshold);
+  __m128i acc = zero;
+  __m128i count = zero;
+
+  for (; i + 16 <= length; i += 16)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*) (image + i));
+    __m128i b = _mm_loadu_si128((const __m128i*) (previous + i));
+    __m128i diff = _mm_or_si128(_mm_subs_epu8(a, b), _mm_subs_epu8(b, a));
+
+    acc = _mm_add_epi64(acc, _mm_sad_epu8(diff, zero));
+
+    // Lanes at or below the threshold saturate to zero, the others count 1
+    __m128i still = _mm_cmpeq_epi8(_mm_subs_epu8(diff, limit), zero);
+    count = _mm_add_epi64(count, _mm_sad_epu8(_mm_andnot_si128(still, one), zero));
+  }
+
+  sad = (uint32_t) _mm_cvtsi128_si32(acc) + (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+  changed = (uint32_t) _mm_cvtsi128_si32(count) + (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(count, 8));
+#elif defined(HVC_KERNEL_NEON)
+  const uint8x16_t limit = vdupq_n_u8((uint8_t) threshold);
+  uint32x4_t acc = vdupq_n_u32(0);
+  uint32x4_t count = vdupq_n_u32(0);
+
+  for (; i + 16 <= length; i += 16)
+  {
+    uint8x16_t diff = vabdq_u8(vld1q_u8(image + i), vld1q_u8(previous + i));
+    uint8x16_t over = vshrq_n_u8(vcgtq_u8(diff, limit), 7);
+
+    acc = vpadalq_u16(acc, vpaddlq_u8(diff));
+    count = vpadalq_u16(count, vpaddlq_u8(over));
+  }
+
+  sad = _hvc_kernel_neon_sum(acc);
+  changed = _hvc_kernel_neon_sum(count);
+#endif
+
+  for (; i < length; i++)
+  {
+    int diff = image[i] > previous[i] ? image[i] - previous[i] : previous[i] - image[i];
+
+    sad += diff;
+    if (diff > threshold) changed++;
+  }
+
+  motion->sad = sad;
+  motion->changed = changed;
+}
+
+int hvc_kernel_crop(const uint8_t* image, int width, int height, const struct hvc_detection* detection,
+  uint8_t* dst, int size, int* crop_width, int* crop_height)
+{
+  // Detections are centered squares on the sensor, scale them to the image
+  int half = detection->size / 2;
+  int x0 = (detection->x - half) * width / HVC_KERNEL_SENSOR_WIDTH;
+  int y0 = (detection->y - half) * height / HVC_KERNEL_SENSOR_HEIGHT;
+  int x1 = (detection->x + half) * width / HVC_KERNEL_SENSOR_WIDTH;
+  int y1 = (detection->y + half) * height / HVC_KERNEL_SENSOR_HEIGHT;
+
+  if (x0 < 0) x0 = 0;
+  if (y0 < 0) y0 = 0;
+  if (x1 > width) x1 = width;
+  if (y1 > height) y1 = height;
+
+  if (x1 <= x0 || y1 <= y0 || (x1 - x0) * (y1 - y0) > size)
+  {
+    return HVC_ERR_ARGS;
+  }
+
+  for (int y = y0; y < y1; y++)
+  {
+    memcpy(dst + (y - y0) * (x1 - x0), image + y * width + x0, x1 - x0);
+  }
+
+  *crop_width = x1 - x0;
+  *crop_height = y1 - y0;
+
+  return (x1 - x0) * (y1 - y0);
+}
@@ -0,0 +1,52 @@
+/**
+ * Level gate and per call site rate limits in front of the port's log
+ * functions.
+ */
+#include <stddef.h>
+#include "hvc_log.h"
+
+int hvc_log_level = HVC_LOG_LEVEL_INFO;
+
+static int64_t (*hvc_log_clock)(void) = NULL;
+
+void hvc_log_set_level(int level)
+{
+  hvc_log_level = level;
+}
+
+void hvc_log_set_clock(int64_t (*clock)(void))
+{
+  hvc_log_clock = clock;
+}
+
+bool hvc_log_allow(struct hvc_log_site* site, int level)
+{
+  if (!hvc_log_clock) return true;
+
+  int64_t now = hvc_log_clock();
+
+  if (site->count > 0 && now - site->window_start < (int64_t) HVC_LOG_WINDOW_MS * 1000)
+  {
+    if (site->count >= HVC_LOG_BURST)
+    {
+      site->suppressed++;
+      return false;
+    }
+
+    site->count++;
+    return true;
+  }
+
+  // New window, own up to what the last one swallowed
+  if (site->suppressed > 0)
+  {
+    if (level == HVC_LOG_LEVEL_ERROR) hvc_log_error("%d similar messages suppressed", site->suppressed);
+    else if (level == HVC_LOG_LEVEL_INFO) hvc_log_info("%d similar messages suppressed", site->suppressed);
+    else hvc_log_debug("%d similar messages suppressed", site->suppressed);
+  }
+
+  site->window_start = now;
+  site->count = 1;
+  site->suppressed = 0;
+  return true;
+}
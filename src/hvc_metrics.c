@@ -0,0 +1,79 @@
+/**
+ * Per device counters and round trip histograms.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_metrics.h"
+
+void hvc_metrics_reset(struct hvc_metrics* metrics)
+{
+  memset(metrics, 0, sizeof(struct hvc_metrics));
+}
+
+const struct hvc_command_metrics* hvc_metrics_find(const struct hvc_metrics* metrics, int cmd)
+{
+  for (int i = 0; i < metrics->command_count; i++)
+  {
+    if (metrics->commands[i].cmd == cmd) return &metrics->commands[i];
+  }
+
+  return NULL;
+}
+
+void hvc_metrics_error(struct hvc_metrics* metrics, int status)
+{
+  if (status < 0 && -status < HVC_METRICS_ERRORS) metrics->errors[-status]++;
+}
+
+void hvc_metrics_resync(struct hvc_metrics* metrics, int discarded)
+{
+  if (discarded <= 0) return;
+
+  metrics->resyncs++;
+  metrics->discarded += discarded;
+}
+
+void hvc_metrics_wake(struct hvc_metrics* metrics, int elapsed_ms)
+{
+  if (elapsed_ms < 0) return;
+
+  metrics->wakes++;
+  metrics->wake_last_ms = elapsed_ms;
+  metrics->wake_total_ms += elapsed_ms;
+
+  if ((uint32_t) elapsed_ms > metrics->wake_max_ms) metrics->wake_max_ms = elapsed_ms;
+}
+
+void hvc_metrics_command(struct hvc_metrics* metrics, int cmd, int status, int elapsed_us)
+{
+  struct hvc_command_metrics* command = (struct hvc_command_metrics*) hvc_metrics_find(metrics, cmd);
+
+  if (!command)
+  {
+    if (metrics->command_count == HVC_METRICS_COMMANDS) return;
+
+    command = &metrics->commands[metrics->command_count++];
+    command->cmd = cmd;
+  }
+
+  command->count++;
+
+  if (status != HVC_OK) command->errors++;
+
+  if (elapsed_us < 0) return;
+
+  command->total_us += elapsed_us;
+
+  if ((uint32_t) elapsed_us > command->max_us) command->max_us = elapsed_us;
+
+  int bucket = 0;
+  int ms = elapsed_us / 1000;
+
+  while (ms > 0 && bucket < HVC_METRICS_BUCKETS - 1)
+  {
+    ms >>= 1;
+    bucket++;
+  }
+
+  command->histogram[bucket]++;
+}
@@ -0,0 +1,132 @@
+/**
+ * Decoders for HVC response payloads. All parsers work on a payload that
+ * has already been received into memory, so they can be shared by the
+ * blocking API and the asynchronous engine. Fixed size responses are
+ * decoded through their command descriptor, execution records by the
+ * decoders generated from their layouts.
+ */
+#include "hvc.h"
+#include "hvc_command.h"
+
+HVC_DEFINE_DECODER(_hvc_parse_detection, struct hvc_detection, HVC_LAYOUT_DETECTION)
+HVC_DEFINE_DECODER(_hvc_parse_direction, struct hvc_face_direction, HVC_LAYOUT_FACE_DIRECTION)
+HVC_DEFINE_DECODER(_hvc_parse_age, struct hvc_face_age, HVC_LAYOUT_FACE_AGE)
+HVC_DEFINE_DECODER(_hvc_parse_gender, struct hvc_face_gender, HVC_LAYOUT_FACE_GENDER)
+HVC_DEFINE_DECODER(_hvc_parse_gaze, struct hvc_face_gaze, HVC_LAYOUT_FACE_GAZE)
+HVC_DEFINE_DECODER(_hvc_parse_blink, struct hvc_face_blink, HVC_LAYOUT_FACE_BLINK)
+HVC_DEFINE_DECODER(_hvc_parse_expression, struct hvc_face_expression, HVC_LAYOUT_FACE_EXPRESSION)
+HVC_DEFINE_DECODER(_hvc_parse_recognition, struct hvc_face_recognition, HVC_LAYOUT_FACE_RECOGNITION)
+
+/*
+ * Size of a single face record for the requested execution flags
+ */
+static int _hvc_face_record_size(int function)
+{
+  int size = HVC_DETECTION_SIZE;
+
+  if (function & HVC_EX_FACE_DIRECTION) size += HVC_FACE_DIRECTION_SIZE;
+  if (function & HVC_EX_AGE_ESTIMATION) size += HVC_FACE_AGE_SIZE;
+  if (function & HVC_EX_GENDER_ESTIMATION) size += HVC_FACE_GENDER_SIZE;
+  if (function & HVC_EX_GAZE_ESTIMATION) size += HVC_FACE_GAZE_SIZE;
+  if (function & HVC_EX_BLINK_ESTIMATION) size += HVC_FACE_BLINK_SIZE;
+  if (function & HVC_EX_EXPRESSION_ESTIMATION) size += HVC_FACE_EXPRESSION_SIZE;
+  if (function & HVC_EX_FACE_RECOGNITION) size += HVC_FACE_RECOGNITION_SIZE;
+
+  return size;
+}
+
+static const char* _hvc_parse_face(const char* bytes, int function, struct hvc_face* face)
+{
+  bytes = _hvc_parse_detection(bytes, &face->detection);
+
+  if (function & HVC_EX_FACE_DIRECTION) bytes = _hvc_parse_direction(bytes, &face->direction);
+  if (function & HVC_EX_AGE_ESTIMATION) bytes = _hvc_parse_age(bytes, &face->age);
+  if (function & HVC_EX_GENDER_ESTIMATION) bytes = _hvc_parse_gender(bytes, &face->gender);
+  if (function & HVC_EX_GAZE_ESTIMATION) bytes = _hvc_parse_gaze(bytes, &face->gaze);
+  if (function & HVC_EX_BLINK_ESTIMATION) bytes = _hvc_parse_blink(bytes, &face->blink);
+  if (function & HVC_EX_EXPRESSION_ESTIMATION) bytes = _hvc_parse_expression(bytes, &face->expression);
+  if (function & HVC_EX_FACE_RECOGNITION) bytes = _hvc_parse_recognition(bytes, &face->recognition);
+
+  return bytes;
+}
+
+int hvc_parse_version(const char* payload, int length, struct hvc_get_version_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_VERSION, payload, length, res);
+}
+
+int hvc_parse_camera_angle(const char* payload, int length, struct hvc_get_camera_angle_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_CAMERA_ANGLE, payload, length, res);
+}
+
+int hvc_parse_threshold_values(const char* payload, int length, struct hvc_get_threshold_values_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_THRESHOLD_VALUES, payload, length, res);
+}
+
+int hvc_parse_detection_size(const char* payload, int length, struct hvc_get_detection_size_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_DETECTION_SIZE, payload, length, res);
+}
+
+int hvc_parse_face_angle(const char* payload, int length, struct hvc_get_face_angle_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_FACE_ANGLE, payload, length, res);
+}
+
+int hvc_parse_user_data(const char* payload, int length, struct hvc_get_user_data_response* res)
+{
+  return hvc_command_decode(HVC_CMD_GET_USER_DATA, payload, length, res);
+}
+
+int hvc_execution_payload_size(const char* header, int function)
+{
+  uint8_t body_count = header[0];
+  uint8_t hand_count = header[1];
+  uint8_t face_count = header[2];
+
+  if (body_count > HVC_MAX_BODIES || hand_count > HVC_MAX_HANDS || face_count > HVC_MAX_FACES)
+  {
+    HVC_LOG_ERROR("Detection count out of range: %d/%d/%d", body_count, hand_count, face_count);
+    return HVC_ERR_PAYLOAD;
+  }
+
+  return HVC_EXECUTION_HEADER_SIZE +
+    (body_count + hand_count) * HVC_DETECTION_SIZE +
+    face_count * _hvc_face_record_size(function);
+}
+
+int hvc_parse_execution(const char* payload, int length, int function, struct hvc_execution_response* res)
+{
+  if (length < HVC_EXECUTION_HEADER_SIZE) return HVC_ERR_PAYLOAD;
+
+  int size = hvc_execution_payload_size(payload, function);
+
+  if (size < 0 || size > length) return HVC_ERR_PAYLOAD;
+
+  res->function = function;
+  res->body_count = payload[0];
+  res->hand_count = payload[1];
+  res->face_count = payload[2];
+  // payload[3] reserved and unused
+
+  const char* bytes = payload + HVC_EXECUTION_HEADER_SIZE;
+
+  for (int i = 0; i < res->body_count; i++)
+  {
+    bytes = _hvc_parse_detection(bytes, &res->bodies[i]);
+  }
+
+  for (int i = 0; i < res->hand_count; i++)
+  {
+    bytes = _hvc_parse_detection(bytes, &res->hands[i]);
+  }
+
+  for (int i = 0; i < res->face_count; i++)
+  {
+    bytes = _hvc_parse_face(bytes, function, &res->faces[i]);
+  }
+
+  return HVC_OK;
+}
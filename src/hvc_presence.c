@@ -0,0 +1,161 @@
+/**
+ * Presence engine, smooths the per frame detections into debounced
+ * occupied/vacant transitions and changes in the number of people.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_presence.h"
+
+static void _hvc_presence_event(struct hvc_presence* presence, int event)
+{
+  presence->events++;
+
+  if (presence->cb) presence->cb(presence, event, presence->ctx);
+}
+
+/*
+ * Start a new occupied or vacant period
+ */
+static void _hvc_presence_transition(struct hvc_presence* presence, bool occupied, int count, int64_t time_ms)
+{
+  presence->occupied = occupied;
+  presence->count = count;
+  presence->pending_frames = 0;
+  presence->duration = time_ms - presence->since;
+  presence->since = time_ms;
+
+  _hvc_presence_event(presence, occupied ? HVC_PRESENCE_OCCUPIED : HVC_PRESENCE_VACANT);
+}
+
+/*
+ * Whether a detection counts, raises evidence to its confidence if it does
+ */
+static bool _hvc_presence_counts(const struct hvc_detection* detection, int min_confidence, int* evidence)
+{
+  if (detection->confidence < min_confidence) return false;
+
+  if (detection->confidence > *evidence) *evidence = detection->confidence;
+
+  return true;
+}
+
+/*
+ * Number of people in the window. The evidence weighted median, but as
+ * dropouts only ever hide people the current count holds while a
+ * quarter of the evidence still sees that many.
+ */
+static int _hvc_presence_vote(const struct hvc_presence* presence)
+{
+  int32_t votes[HVC_MAX_BODIES + 2] = { 0 };
+
+  for (int i = 0; i < presence->config.window; i++)
+  {
+    votes[presence->people[i]] += presence->evidence[i];
+  }
+
+  // From here on votes[n] is the evidence of frames seeing at least n
+  for (int n = HVC_MAX_BODIES; n >= 1; n--) votes[n] += votes[n + 1];
+
+  int32_t total = votes[1];
+  int median = 1;
+
+  while (median < HVC_MAX_BODIES && votes[median + 1] * 2 >= total) median++;
+
+  if (median < presence->count && votes[presence->count] * 4 >= total) return presence->count;
+
+  return median;
+}
+
+void hvc_presence_init(struct hvc_presence* presence, const struct hvc_presence_config* config, hvc_presence_cb cb, void* ctx)
+{
+  memset(presence, 0, sizeof(struct hvc_presence));
+
+  presence->config = *config;
+  presence->cb = cb;
+  presence->ctx = ctx;
+
+  if (presence->config.window < 1) presence->config.window = 1;
+  if (presence->config.window > HVC_PRESENCE_MAX_WINDOW) presence->config.window = HVC_PRESENCE_MAX_WINDOW;
+  if (presence->config.enter < 1) presence->config.enter = 1;
+  if (presence->config.leave > presence->config.enter) presence->config.leave = presence->config.enter;
+  if (presence->config.leave < 1) presence->config.leave = 1;
+  if (presence->config.count_frames < 1) presence->config.count_frames = 1;
+}
+
+void hvc_presence_update(struct hvc_presence* presence, const struct hvc_execution_response* res, int64_t time_ms)
+{
+  const struct hvc_presence_config* config = &presence->config;
+  int evidence = 0;
+  int bodies = 0;
+  int faces = 0;
+
+  for (int i = 0; i < res->body_count && i < HVC_MAX_BODIES; i++)
+  {
+    if (_hvc_presence_counts(&res->bodies[i], config->min_confidence, &evidence)) bodies++;
+  }
+
+  for (int i = 0; i < res->face_count && i < HVC_MAX_FACES; i++)
+  {
+    if (_hvc_presence_counts(&res->faces[i].detection, config->min_confidence, &evidence)) faces++;
+  }
+
+  // A face belongs to a body that may or may not be seen, the larger
+  // count is the number of people
+  int people = bodies > faces ? bodies : faces;
+
+  if (evidence > HVC_PRESENCE_EVIDENCE_MAX) evidence = HVC_PRESENCE_EVIDENCE_MAX;
+
+  if (presence->frames++ == 0) presence->since = time_ms;
+
+  // Slide the window, the slot being overwritten leaves the sum
+  int previous = presence->evidence[(presence->head + config->window - 1) % config->window];
+
+  presence->score += evidence - presence->evidence[presence->head];
+  presence->evidence[presence->head] = evidence;
+  presence->people[presence->head] = people;
+  presence->head = (presence->head + 1) % config->window;
+
+  if (!presence->occupied)
+  {
+    // A stray detection needs a second one right behind it
+    bool confirmed = evidence >= config->enter || (evidence > 0 && previous > 0);
+
+    if (presence->score >= config->enter && confirmed)
+    {
+      _hvc_presence_transition(presence, true, _hvc_presence_vote(presence), time_ms);
+    }
+
+    return;
+  }
+
+  if (presence->score < config->leave)
+  {
+    _hvc_presence_transition(presence, false, 0, time_ms);
+    return;
+  }
+
+  int count = _hvc_presence_vote(presence);
+
+  if (count == presence->count)
+  {
+    presence->pending_frames = 0;
+    return;
+  }
+
+  if (presence->pending_frames > 0 && count == presence->pending_count)
+  {
+    presence->pending_frames++;
+  }
+  else
+  {
+    presence->pending_count = count;
+    presence->pending_frames = 1;
+  }
+
+  if (presence->pending_frames >= config->count_frames)
+  {
+    presence->count = count;
+    presence->pending_frames = 0;
+    _hvc_presence_event(presence, HVC_PRESENCE_COUNT);
+  }
+}
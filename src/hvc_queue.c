@@ -0,0 +1,251 @@
+/**
+ * Command queue, keeps the sensor busy by sending the next command as
+ * soon as a response is drained, before its result is processed.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_queue.h"
+
+static struct hvc_queue_request* _hvc_queue_head(struct hvc_queue* queue)
+{
+  return &queue->requests[queue->head];
+}
+
+static void _hvc_queue_pop(struct hvc_queue* queue)
+{
+  _hvc_queue_head(queue)->state = HVC_QUEUE_FREE;
+  queue->head = (queue->head + 1) % HVC_QUEUE_SIZE;
+  queue->count--;
+}
+
+/*
+ * Report a request that didn't complete, it stays queued until its
+ * response (if any) is drained
+ */
+static void _hvc_queue_fail(struct hvc_queue* queue, struct hvc_queue_request* request, int status)
+{
+  request->done = true;
+
+  // Send failures were counted by the device already
+  if (status == HVC_ERR_CANCELLED || status == HVC_ERR_TIMEOUT)
+  {
+    if (status == HVC_ERR_CANCELLED) queue->cancelled++;
+    if (status == HVC_ERR_TIMEOUT) queue->timeouts++;
+
+    hvc_metrics_error(hvc_get_metrics(queue->async.dev), status);
+  }
+
+  if (request->cb) request->cb(queue, request, status, request->ctx);
+}
+
+static void _hvc_queue_done(struct hvc_async* async, int status, void* ctx);
+
+/*
+ * Send the oldest request that is still wanted, unless a command is in
+ * flight
+ */
+static void _hvc_queue_start(struct hvc_queue* queue)
+{
+  while (queue->count > 0 && hvc_async_idle(&queue->async))
+  {
+    struct hvc_queue_request* request = _hvc_queue_head(queue);
+
+    if (request->done)
+    {
+      _hvc_queue_pop(queue);
+      continue;
+    }
+
+    request->sent = hvc_clock(queue->async.dev);
+
+    int status = request->cmd == HVC_CMD_EXECUTE
+      ? hvc_async_execute(&queue->async, request->function, request->image, _hvc_queue_done, queue)
+      : hvc_async_submit(&queue->async, request->cmd, request->data, request->data_size, _hvc_queue_done, queue);
+
+    if (status == HVC_OK)
+    {
+      request->state = HVC_QUEUE_SENT;
+      return;
+    }
+
+    _hvc_queue_fail(queue, request, status);
+  }
+}
+
+static void _hvc_queue_done(struct hvc_async* async, int status, void* ctx)
+{
+  struct hvc_queue* queue = (struct hvc_queue*) ctx;
+
+  // The slot is reused once popped, report from a copy
+  struct hvc_queue_request request = *_hvc_queue_head(queue);
+  int64_t now = hvc_clock(async->dev);
+
+  request.latency_ms = now >= 0 && request.sent >= 0 ? (int) ((now - request.sent) / 1000) : -1;
+
+  // Submitting resets the payload length but leaves the bytes alone,
+  // they are only overwritten once the next response arrives
+  int payload_length = async->payload_length;
+
+  _hvc_queue_pop(queue);
+  _hvc_queue_start(queue);
+
+  if (request.done) return;
+
+  queue->completed++;
+  queue->payload = async->payload;
+  queue->payload_length = payload_length;
+
+  if (request.cb) request.cb(queue, &request, status, request.ctx);
+
+  queue->payload = NULL;
+  queue->payload_length = 0;
+}
+
+void hvc_queue_init(struct hvc_queue* queue, struct hvc_device* dev)
+{
+  memset(queue, 0, sizeof(struct hvc_queue));
+  hvc_async_init(&queue->async, dev);
+}
+
+/*
+ * Add a request behind the others and send it if the link is free
+ */
+static int _hvc_queue_push(struct hvc_queue* queue, const struct hvc_queue_request* request)
+{
+  if (queue->count == HVC_QUEUE_SIZE) return HVC_ERR_BUSY;
+
+  struct hvc_queue_request* slot = &queue->requests[(queue->head + queue->count) % HVC_QUEUE_SIZE];
+
+  *slot = *request;
+  slot->state = HVC_QUEUE_WAITING;
+  slot->id = ++queue->next_id;
+  slot->age_ms = 0;
+  slot->done = false;
+  slot->sent = -1;
+  slot->latency_ms = -1;
+
+  // Ids stay positive when the counter wraps
+  if (queue->next_id == INT32_MAX) queue->next_id = 0;
+
+  queue->count++;
+
+  int id = slot->id;
+
+  _hvc_queue_start(queue);
+
+  return id;
+}
+
+int hvc_queue_submit(struct hvc_queue* queue, char cmd, const char* data, int data_size, int timeout_ms, hvc_queue_cb cb, void* ctx)
+{
+  if (data_size < 0 || data_size > HVC_QUEUE_DATA_SIZE) return HVC_ERR_ARGS;
+
+  struct hvc_queue_request request = {
+    .cmd = cmd,
+    .data_size = data_size,
+    .timeout_ms = timeout_ms,
+    .cb = cb,
+    .ctx = ctx
+  };
+
+  if (data_size) memcpy(request.data, data, data_size);
+
+  return _hvc_queue_push(queue, &request);
+}
+
+int hvc_queue_execute(struct hvc_queue* queue, int function, int image, int timeout_ms, hvc_queue_cb cb, void* ctx)
+{
+  struct hvc_queue_request request = {
+    .cmd = HVC_CMD_EXECUTE,
+    .function = function,
+    .image = image,
+    .timeout_ms = timeout_ms,
+    .cb = cb,
+    .ctx = ctx
+  };
+
+  return _hvc_queue_push(queue, &request);
+}
+
+int hvc_queue_cancel(struct hvc_queue* queue, int id)
+{
+  for (int i = 0; i < HVC_QUEUE_SIZE; i++)
+  {
+    struct hvc_queue_request* request = &queue->requests[i];
+
+    if (request->state == HVC_QUEUE_FREE || request->id != id) continue;
+
+    if (request->done) return HVC_ERR_ARGS;
+
+    _hvc_queue_fail(queue, request, HVC_ERR_CANCELLED);
+    return HVC_OK;
+  }
+
+  return HVC_ERR_ARGS;
+}
+
+void hvc_queue_cancel_all(struct hvc_queue* queue)
+{
+  // Requests submitted from the callbacks are cancelled too
+  for (int i = 0; i < HVC_QUEUE_SIZE; i++)
+  {
+    struct hvc_queue_request* request = &queue->requests[i];
+
+    if (request->state != HVC_QUEUE_FREE && !request->done) _hvc_queue_fail(queue, request, HVC_ERR_CANCELLED);
+  }
+}
+
+int hvc_queue_pending(struct hvc_queue* queue)
+{
+  int pending = 0;
+
+  for (int i = 0; i < HVC_QUEUE_SIZE; i++)
+  {
+    if (queue->requests[i].state != HVC_QUEUE_FREE && !queue->requests[i].done) pending++;
+  }
+
+  return pending;
+}
+
+int hvc_queue_feed(struct hvc_queue* queue, const char* data, int length)
+{
+  return hvc_async_feed(&queue->async, data, length);
+}
+
+void hvc_queue_poll(struct hvc_queue* queue)
+{
+  hvc_async_poll(&queue->async);
+}
+
+void hvc_queue_tick(struct hvc_queue* queue, int elapsed_ms)
+{
+  // Callbacks may submit into freed slots, only the requests queued
+  // before this tick age
+  int ids[HVC_QUEUE_SIZE];
+
+  for (int i = 0; i < HVC_QUEUE_SIZE; i++)
+  {
+    ids[i] = queue->requests[i].state != HVC_QUEUE_FREE ? queue->requests[i].id : 0;
+  }
+
+  for (int i = 0; i < HVC_QUEUE_SIZE; i++)
+  {
+    struct hvc_queue_request* request = &queue->requests[i];
+
+    if (request->state == HVC_QUEUE_FREE || request->done || request->id != ids[i]) continue;
+
+    request->age_ms += elapsed_ms;
+
+    if (request->timeout_ms > 0 && request->age_ms > request->timeout_ms)
+    {
+      HVC_LOG_ERROR("Command %02x timed out after %d ms", (uint8_t) request->cmd, request->age_ms);
+      _hvc_queue_fail(queue, request, HVC_ERR_TIMEOUT);
+    }
+  }
+
+  hvc_async_tick(&queue->async, elapsed_ms);
+
+  // Requests that were reported while waiting are dropped here if the
+  // link went idle without a completion to move the ring along
+  _hvc_queue_start(queue);
+}
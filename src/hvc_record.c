@@ -0,0 +1,186 @@
+/**
+ * Recording transport shim, captures the raw UART traffic of a session
+ * so it can be replayed against the parser later.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_record.h"
+
+static void _hvc_record_put_u16(char* out, uint16_t val)
+{
+  out[0] = val & 0xFF;
+  out[1] = (val >> 8) & 0xFF;
+}
+
+static void _hvc_record_put_u32(char* out, uint32_t val)
+{
+  _hvc_record_put_u16(out, val & 0xFFFF);
+  _hvc_record_put_u16(out + 2, val >> 16);
+}
+
+static void _hvc_record_stop(struct hvc_recorder* rec)
+{
+  if (!rec->fp) return;
+
+  if (fclose(rec->fp) != 0) HVC_LOG_ERROR("Unable to finish recording");
+
+  rec->fp = NULL;
+}
+
+static void _hvc_record_write(struct hvc_recorder* rec, int type, const char* data, int length)
+{
+  if (rec->stop) _hvc_record_stop(rec);
+
+  if (!rec->fp) return;
+
+  int64_t now = rec->inner.clock ? rec->inner.clock(rec->inner.ctx) : 0;
+  int64_t delta = now - rec->last_time;
+
+  if (delta < 0) delta = 0;
+  if (delta > UINT32_MAX) delta = UINT32_MAX;
+
+  rec->last_time = now;
+
+  do
+  {
+    int chunk = length > HVC_RECORD_MAX_DATA ? HVC_RECORD_MAX_DATA : length;
+
+    if (rec->max_bytes && rec->bytes + HVC_RECORD_HEADER + chunk > rec->max_bytes)
+    {
+      HVC_LOG_INFO("Recording reached %u bytes, stopped", rec->bytes);
+      rec->truncated = true;
+      _hvc_record_stop(rec);
+      return;
+    }
+
+    char header[HVC_RECORD_HEADER];
+
+    header[0] = type;
+    _hvc_record_put_u16(header + 1, chunk);
+    _hvc_record_put_u32(header + 3, delta);
+
+    if (fwrite(header, 1, sizeof(header), rec->fp) != sizeof(header) ||
+        fwrite(data, 1, chunk, rec->fp) != (size_t) chunk)
+    {
+      HVC_LOG_ERROR("Unable to write recording, stopped");
+      _hvc_record_stop(rec);
+      return;
+    }
+
+    rec->bytes += HVC_RECORD_HEADER + chunk;
+    rec->records++;
+
+    data += chunk;
+    length -= chunk;
+    delta = 0;
+  } while (length > 0);
+}
+
+static int _hvc_record_read(void* ctx, char* data, int length, int timeout_ms)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+  int read = rec->inner.read(rec->inner.ctx, data, length, timeout_ms);
+
+  if (read > 0) _hvc_record_write(rec, HVC_RECORD_RX, data, read);
+
+  return read;
+}
+
+static int _hvc_record_write_bytes(void* ctx, const char* data, int length)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  _hvc_record_write(rec, HVC_RECORD_TX, data, length);
+
+  return rec->inner.write(rec->inner.ctx, data, length);
+}
+
+static int _hvc_record_available(void* ctx)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  return rec->inner.available(rec->inner.ctx);
+}
+
+static int _hvc_record_wait(void* ctx, int length, int timeout_ms)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  return rec->inner.wait(rec->inner.ctx, length, timeout_ms);
+}
+
+static void _hvc_record_sleep(void* ctx, int ms)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  rec->inner.sleep(rec->inner.ctx, ms);
+}
+
+static bool _hvc_record_set_baudrate(void* ctx, int baudrate)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  if (rec->inner.set_baudrate && !rec->inner.set_baudrate(rec->inner.ctx, baudrate)) return false;
+
+  char data[4];
+  _hvc_record_put_u32(data, baudrate);
+  _hvc_record_write(rec, HVC_RECORD_BAUDRATE, data, sizeof(data));
+
+  return true;
+}
+
+static int64_t _hvc_record_clock(void* ctx)
+{
+  struct hvc_recorder* rec = (struct hvc_recorder*) ctx;
+
+  return rec->inner.clock(rec->inner.ctx);
+}
+
+int hvc_recorder_open(struct hvc_recorder* rec, const char* path, uint32_t max_bytes,
+  const struct hvc_transport* inner, struct hvc_transport* transport)
+{
+  memset(rec, 0, sizeof(struct hvc_recorder));
+
+  rec->fp = fopen(path, "wb");
+
+  if (!rec->fp)
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", path);
+    return HVC_ERR_SINK;
+  }
+
+  char header[HVC_RECORD_FILE_HEADER];
+
+  memcpy(header, HVC_RECORD_MAGIC, 4);
+  _hvc_record_put_u16(header + 4, HVC_RECORD_VERSION);
+  _hvc_record_put_u16(header + 6, HVC_RECORD_HEADER);
+
+  if (fwrite(header, 1, sizeof(header), rec->fp) != sizeof(header))
+  {
+    HVC_LOG_ERROR("Unable to write recording to %s", path);
+    fclose(rec->fp);
+    remove(path);
+    return HVC_ERR_SINK;
+  }
+
+  rec->inner = *inner;
+  rec->max_bytes = max_bytes;
+  rec->bytes = HVC_RECORD_FILE_HEADER;
+  rec->last_time = inner->clock ? inner->clock(inner->ctx) : 0;
+
+  transport->read = _hvc_record_read;
+  transport->write = _hvc_record_write_bytes;
+  transport->available = _hvc_record_available;
+  transport->wait = _hvc_record_wait;
+  transport->sleep = _hvc_record_sleep;
+  transport->set_baudrate = _hvc_record_set_baudrate;
+  transport->clock = rec->inner.clock ? _hvc_record_clock : NULL;
+  transport->ctx = rec;
+
+  return HVC_OK;
+}
+
+void hvc_recorder_close(struct hvc_recorder* rec)
+{
+  _hvc_record_stop(rec);
+}
@@ -0,0 +1,108 @@
+/**
+ * Adaptive detection scheduler, picks the cadence and execution flags
+ * of the next detection from recent results and latency.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_scheduler.h"
+
+static int _hvc_scheduler_average(int average, int sample)
+{
+  if (average == 0) return sample;
+
+  return average + (sample - average) / HVC_SCHEDULER_LATENCY_WEIGHT;
+}
+
+void hvc_scheduler_init(struct hvc_scheduler* scheduler, const struct hvc_scheduler_config* config)
+{
+  memset(scheduler, 0, sizeof(struct hvc_scheduler));
+
+  scheduler->config = *config;
+
+  if (scheduler->config.duty_cycle <= 0 || scheduler->config.duty_cycle > 100)
+  {
+    scheduler->config.duty_cycle = 100;
+  }
+
+  scheduler->function = config->idle_function;
+  scheduler->idle_period = config->idle_interval;
+}
+
+int hvc_scheduler_function(struct hvc_scheduler* scheduler)
+{
+  return scheduler->function;
+}
+
+int hvc_scheduler_update(struct hvc_scheduler* scheduler, const struct hvc_execution_response* res, int latency_ms)
+{
+  struct hvc_scheduler_config* config = &scheduler->config;
+
+  scheduler->latency = _hvc_scheduler_average(scheduler->latency, latency_ms);
+
+  if (scheduler->active && scheduler->function == config->active_function)
+  {
+    scheduler->active_latency = _hvc_scheduler_average(scheduler->active_latency, latency_ms);
+  }
+
+  // A failed detection tells us nothing about the scene, keep the state
+  if (res)
+  {
+    if (res->body_count || res->face_count)
+    {
+      if (!scheduler->active) HVC_LOG_DEBUG("Scheduler active");
+
+      scheduler->active = true;
+      scheduler->empty_frames = 0;
+    }
+    else if (scheduler->active && ++scheduler->empty_frames >= config->idle_after)
+    {
+      HVC_LOG_DEBUG("Scheduler idle");
+      scheduler->active = false;
+      scheduler->degraded = false;
+    }
+  }
+
+  // Drop the estimations while they are too slow, probe them again now and then
+  if (config->latency_target > 0 && scheduler->active)
+  {
+    if (!scheduler->degraded && scheduler->active_latency > config->latency_target)
+    {
+      HVC_LOG_INFO("Detection latency %d ms over target, dropping estimations", scheduler->active_latency);
+      scheduler->degraded = true;
+      scheduler->degraded_frames = 0;
+    }
+    else if (scheduler->degraded && ++scheduler->degraded_frames >= HVC_SCHEDULER_PROBE_FRAMES)
+    {
+      scheduler->degraded = false;
+      scheduler->active_latency = 0;
+    }
+  }
+
+  scheduler->function = (scheduler->active && !scheduler->degraded)
+    ? config->active_function
+    : config->idle_function;
+
+  // The interval is a frame period, the detection itself already used part of it
+  int period = scheduler->active ? config->active_interval : scheduler->idle_period;
+
+  // The longer the scene stays empty the less often it is looked at
+  if (scheduler->active || config->max_idle_interval <= config->idle_interval)
+  {
+    scheduler->idle_period = config->idle_interval;
+  }
+  else if (res && scheduler->idle_period < config->max_idle_interval)
+  {
+    scheduler->idle_period *= 2;
+
+    if (scheduler->idle_period > config->max_idle_interval) scheduler->idle_period = config->max_idle_interval;
+  }
+
+  // Keep the sensor busy no more than duty_cycle percent of the time
+  int min_period = scheduler->latency * 100 / config->duty_cycle;
+
+  if (period < min_period) period = min_period;
+
+  int delay = period - latency_ms;
+
+  return delay > 0 ? delay : 0;
+}
@@ -0,0 +1,88 @@
+/**
+ * Binary trace ring. Recording costs a few stores, no formatting, so it
+ * can stay on in the detection loop and be decoded offline.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "hvc.h"
+#include "hvc_trace.h"
+
+void hvc_trace_init(struct hvc_trace* trace, struct hvc_trace_record* records, uint32_t size)
+{
+  memset(records, 0, sizeof(struct hvc_trace_record) * size);
+
+  trace->records = records;
+  trace->size = size;
+  trace->head = 0;
+}
+
+void hvc_trace_record(struct hvc_trace* trace, uint32_t time, int event, int arg0, int arg1)
+{
+  struct hvc_trace_record* record = &trace->records[trace->head & (trace->size - 1)];
+
+  record->time = time;
+  record->event = event;
+  record->arg0 = arg0;
+  record->arg1 = arg1;
+
+  trace->head++;
+}
+
+static void _hvc_trace_put_u16(char* out, uint16_t val)
+{
+  out[0] = val & 0xFF;
+  out[1] = (val >> 8) & 0xFF;
+}
+
+static void _hvc_trace_put_u32(char* out, uint32_t val)
+{
+  _hvc_trace_put_u16(out, val & 0xFFFF);
+  _hvc_trace_put_u16(out + 2, val >> 16);
+}
+
+int hvc_trace_save_file(const struct hvc_trace* trace, const char* path)
+{
+  FILE* fp = fopen(path, "wb");
+
+  if (!fp)
+  {
+    HVC_LOG_ERROR("Unable to open file path: %s", path);
+    return HVC_ERR_SINK;
+  }
+
+  uint32_t head = trace->head;
+  uint32_t count = head < trace->size ? head : trace->size;
+  char header[HVC_TRACE_FILE_HEADER];
+
+  memcpy(header, HVC_TRACE_MAGIC, 4);
+  _hvc_trace_put_u16(header + 4, HVC_TRACE_VERSION);
+  _hvc_trace_put_u16(header + 6, HVC_TRACE_RECORD_SIZE);
+  _hvc_trace_put_u32(header + 8, count);
+  _hvc_trace_put_u32(header + 12, head - count);
+
+  bool ok = fwrite(header, 1, sizeof(header), fp) == sizeof(header);
+
+  for (uint32_t i = head - count; ok && i != head; i++)
+  {
+    const struct hvc_trace_record* record = &trace->records[i & (trace->size - 1)];
+    char out[HVC_TRACE_RECORD_SIZE];
+
+    _hvc_trace_put_u32(out, record->time);
+    _hvc_trace_put_u16(out + 4, record->event);
+    _hvc_trace_put_u16(out + 6, record->arg0);
+    _hvc_trace_put_u32(out + 8, record->arg1);
+
+    ok = fwrite(out, 1, sizeof(out), fp) == sizeof(out);
+  }
+
+  if (fclose(fp) != 0) ok = false;
+
+  if (!ok)
+  {
+    HVC_LOG_ERROR("Unable to write trace to %s", path);
+    remove(path);
+    return HVC_ERR_SINK;
+  }
+
+  return count;
+}
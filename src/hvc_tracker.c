@@ -0,0 +1,260 @@
+/**
+ * Multi object tracker, turns the anonymous detections of every frame
+ * into tracks with stable IDs and enter/update/leave events.
+ */
+#include <string.h>
+#include "hvc.h"
+#include "hvc_tracker.h"
+
+/*
+ * Velocity smoothing, weight of the newest sample 1/N
+ */
+#define HVC_TRACKER_VELOCITY_WEIGHT 4
+
+#define HVC_TRACKER_MIN(a, b) ((a) < (b) ? (a) : (b))
+#define HVC_TRACKER_MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/*
+ * Intersection over union of two square boxes, scaled to
+ * HVC_TRACKER_SCORE_MAX
+ */
+static int _hvc_tracker_overlap(const struct hvc_detection* a, const struct hvc_detection* b)
+{
+  int half_a = a->size / 2;
+  int half_b = b->size / 2;
+
+  int w = HVC_TRACKER_MIN(a->x + half_a, b->x + half_b) - HVC_TRACKER_MAX(a->x - half_a, b->x - half_b);
+  int h = HVC_TRACKER_MIN(a->y + half_a, b->y + half_b) - HVC_TRACKER_MAX(a->y - half_a, b->y - half_b);
+
+  if (w <= 0 || h <= 0) return 0;
+
+  int64_t intersection = (int64_t) w * h;
+  int64_t area = (int64_t) a->size * a->size + (int64_t) b->size * b->size - intersection;
+
+  if (area <= 0) return 0;
+
+  return (int) (intersection * HVC_TRACKER_SCORE_MAX / area);
+}
+
+static void _hvc_tracker_event(struct hvc_tracker* tracker, int event, const struct hvc_track* track)
+{
+  if (tracker->cb) tracker->cb(tracker, event, track, tracker->ctx);
+}
+
+static void _hvc_tracker_confirm(struct hvc_tracker* tracker, struct hvc_track* track)
+{
+  track->confirmed = true;
+  track->id = tracker->next_id++;
+
+  _hvc_tracker_event(tracker, HVC_TRACK_ENTER, track);
+}
+
+/*
+ * Best unassigned detection of a track, returns its index or -1
+ */
+static int _hvc_tracker_best(struct hvc_tracker* tracker, int track, const bool* assigned, int count, int* score)
+{
+  int best = -1;
+  *score = tracker->config.min_overlap - 1;
+
+  for (int d = 0; d < count; d++)
+  {
+    if (!assigned[d] && tracker->scores[track][d] > *score)
+    {
+      *score = tracker->scores[track][d];
+      best = d;
+    }
+  }
+
+  return best;
+}
+
+static void _hvc_tracker_remove(struct hvc_tracker* tracker, int index)
+{
+  tracker->tracks[index] = tracker->tracks[--tracker->track_count];
+}
+
+void hvc_tracker_init(struct hvc_tracker* tracker, const struct hvc_tracker_config* config, hvc_tracker_cb cb, void* ctx)
+{
+  memset(tracker, 0, sizeof(struct hvc_tracker));
+
+  tracker->config = *config;
+  tracker->next_id = 1;
+  tracker->cb = cb;
+  tracker->ctx = ctx;
+
+  if (tracker->config.min_overlap < 1) tracker->config.min_overlap = 1;
+  if (tracker->config.confirm_frames < 1) tracker->config.confirm_frames = 1;
+  if (tracker->config.leave_frames < 0) tracker->config.leave_frames = 0;
+}
+
+void hvc_tracker_update(struct hvc_tracker* tracker, const struct hvc_execution_response* res, int64_t time_ms)
+{
+  const struct hvc_detection* detections[HVC_MAX_BODIES];
+  int16_t users[HVC_MAX_BODIES];
+  int count;
+
+  if (tracker->config.kind == HVC_TRACK_FACES)
+  {
+    bool recognition = res->function & HVC_EX_FACE_RECOGNITION;
+    count = HVC_TRACKER_MIN(res->face_count, HVC_MAX_FACES);
+
+    for (int d = 0; d < count; d++)
+    {
+      detections[d] = &res->faces[d].detection;
+      users[d] = recognition ? res->faces[d].recognition.user_id : HVC_USER_NOT_RECOGNIZED;
+    }
+  }
+  else
+  {
+    count = HVC_TRACKER_MIN(res->body_count, HVC_MAX_BODIES);
+
+    for (int d = 0; d < count; d++)
+    {
+      detections[d] = &res->bodies[d];
+      users[d] = HVC_USER_NOT_RECOGNIZED;
+    }
+  }
+
+  // Score every track, at the position its velocity predicts, against
+  // every detection and note each track's best candidate
+  int best[HVC_TRACKER_MAX_TRACKS];
+  int best_score[HVC_TRACKER_MAX_TRACKS];
+  int matched[HVC_TRACKER_MAX_TRACKS];
+  bool assigned[HVC_MAX_BODIES] = { false };
+
+  for (int t = 0; t < tracker->track_count; t++)
+  {
+    struct hvc_track* track = &tracker->tracks[t];
+    struct hvc_detection predicted = track->detection;
+    int frames = track->misses + 1;
+
+    predicted.x += track->vx * frames / 16;
+    predicted.y += track->vy * frames / 16;
+
+    for (int d = 0; d < count; d++)
+    {
+      tracker->scores[t][d] = _hvc_tracker_overlap(&predicted, detections[d]);
+    }
+
+    best[t] = _hvc_tracker_best(tracker, t, assigned, count, &best_score[t]);
+    matched[t] = -1;
+  }
+
+  // Greedy assignment, the best overlapping pair first. Only tracks that
+  // wanted a detection that was just taken need a new candidate.
+  for (;;)
+  {
+    int t = -1;
+
+    for (int i = 0; i < tracker->track_count; i++)
+    {
+      if (matched[i] < 0 && best[i] >= 0 && (t < 0 || best_score[i] > best_score[t])) t = i;
+    }
+
+    if (t < 0) break;
+
+    int d = best[t];
+    matched[t] = d;
+    assigned[d] = true;
+
+    for (int i = 0; i < tracker->track_count; i++)
+    {
+      if (matched[i] < 0 && best[i] == d) best[i] = _hvc_tracker_best(tracker, i, assigned, count, &best_score[i]);
+    }
+  }
+
+  // Continue the matched tracks, age the rest. Walk backwards so removed
+  // tracks can be replaced by the last one.
+  for (int t = tracker->track_count - 1; t >= 0; t--)
+  {
+    struct hvc_track* track = &tracker->tracks[t];
+
+    if (matched[t] < 0)
+    {
+      track->misses++;
+
+      if (!track->confirmed)
+      {
+        _hvc_tracker_remove(tracker, t);
+      }
+      else if (track->misses > tracker->config.leave_frames)
+      {
+        _hvc_tracker_event(tracker, HVC_TRACK_LEAVE, track);
+        _hvc_tracker_remove(tracker, t);
+      }
+
+      continue;
+    }
+
+    const struct hvc_detection* detection = detections[matched[t]];
+    int frames = track->misses + 1;
+    int vx = (detection->x - track->detection.x) * 16 / frames;
+    int vy = (detection->y - track->detection.y) * 16 / frames;
+
+    track->vx += (vx - track->vx) / HVC_TRACKER_VELOCITY_WEIGHT;
+    track->vy += (vy - track->vy) / HVC_TRACKER_VELOCITY_WEIGHT;
+    track->detection = *detection;
+    track->hits++;
+    track->misses = 0;
+    track->last_seen = time_ms;
+
+    if (users[matched[t]] >= 0) track->user_id = users[matched[t]];
+
+    if (track->confirmed)
+    {
+      _hvc_tracker_event(tracker, HVC_TRACK_UPDATE, track);
+    }
+    else if (track->hits >= tracker->config.confirm_frames)
+    {
+      _hvc_tracker_confirm(tracker, track);
+    }
+  }
+
+  // Whatever is left starts a new track
+  for (int d = 0; d < count; d++)
+  {
+    if (assigned[d]) continue;
+
+    if (tracker->track_count == HVC_TRACKER_MAX_TRACKS)
+    {
+      tracker->overflow++;
+      continue;
+    }
+
+    struct hvc_track* track = &tracker->tracks[tracker->track_count++];
+
+    memset(track, 0, sizeof(struct hvc_track));
+    track->detection = *detections[d];
+    track->user_id = users[d] >= 0 ? users[d] : HVC_USER_NOT_RECOGNIZED;
+    track->hits = 1;
+    track->first_seen = time_ms;
+    track->last_seen = time_ms;
+
+    if (tracker->config.confirm_frames <= 1) _hvc_tracker_confirm(tracker, track);
+  }
+}
+
+int hvc_tracker_count(const struct hvc_tracker* tracker)
+{
+  int count = 0;
+
+  for (int t = 0; t < tracker->track_count; t++)
+  {
+    if (tracker->tracks[t].confirmed) count++;
+  }
+
+  return count;
+}
+
+void hvc_tracker_reset(struct hvc_tracker* tracker)
+{
+  while (tracker->track_count > 0)
+  {
+    struct hvc_track* track = &tracker->tracks[tracker->track_count - 1];
+
+    if (track->confirmed) _hvc_tracker_event(tracker, HVC_TRACK_LEAVE, track);
+
+    tracker->track_count--;
+  }
+}
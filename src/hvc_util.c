@@ -1,20 +1,6 @@
+#include <stdint.h>
 #include "hvc_util.h"
 
-#define DEBUG_BUFFER_SIZE 50
-
-char debug_buffer[DEBUG_BUFFER_SIZE];
-
-char* util_terminate_string(char *arr, int arr_size)
-{
-  for (int i = 0; i < arr_size; i++)
-  {
-    debug_buffer[i] = arr[i];
-  }
-
-  debug_buffer[arr_size] = '\0';
-  return debug_buffer;
-}
-
 void util_slice(char *arr, char *dest, int start, int offset)
 {
   for (int i = start; i < start + offset; i++)
@@ -25,7 +11,7 @@ void util_slice(char *arr, char *dest, int start, int offset)
 
 int util_bytes_to_int(char lsb, char msb)
 {
-  return lsb + (msb << 8);
+  return (uint8_t) lsb + ((uint8_t) msb << 8);
 }
 
 void util_int_into_lsb_msb(char* arr, int index, int val)
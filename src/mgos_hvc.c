@@ -2,74 +2,226 @@
  * Mongoose OS specific logic for dealing with the HVC-P sensor. Registers
  * listeners and executes setup commands to do face/body recognition.
  */
+#include <FreeRTOS.h>
+#include <queue.h>
+#include <task.h>
 #include "mgos.h"
 #include "mgos_event.h"
+#include "mgos_rpc.h"
 #include "mgos_hvc.h"
 #include "mgos_uart.h"
 #include "mgos_sys_config.h"
 #include "hvc.h"
+#include "hvc_frames.h"
+#include "hvc_queue.h"
+#include "hvc_record.h"
 #include "hvc_response.h"
+#include "hvc_scheduler.h"
+#include "hvc_trace.h"
 #include "hvc_util.h"
 
 
 #include "driver/uart.h"
 
 /*
- * Proxy logging, we don't want to redefine log functions
- * so we use a buffer we will use to forward information to MGOS
+ * Every sensor runs on its own UART with its own device, scheduler and
+ * detection loop. Nothing is shared between sensors.
  */
-char log_buffer[MGOS_HVC_LOG_BUFFER];
+struct mgos_hvc_sensor
+{
+  int index;
+  int uart_num;
+
+  // UART driver event queue, used to wake up whoever is waiting for bytes
+  QueueHandle_t uart_queue;
+
+  struct hvc_device device;
+
+  // Decides the cadence and execution flags of the detections
+  struct hvc_scheduler scheduler;
+
+  // Execution results are decoded into this buffer every iteration, it is
+  // only valid for the duration of the event dispatch.
+  struct hvc_execution_response execution_res;
+  struct hvc_get_version_response version_res;
+
+  // Milliseconds from the start of init until the sensor was configured
+  int time_to_ready;
+
+  // Settings written at init and again whenever the sensor is powered up
+  struct hvc_config config;
+  int max_baudrate;
+
+  // Power gating, hvc.power.*. GPIO switching the sensor (-1 if it is
+  // always on), when the last power up started (0 once a detection
+  // followed it) and how long bringing the sensor back took.
+  int power_gpio;
+  int64_t wake_start;
+  int wake_ms;
+
+  // Bodies and faces followed across frames, hvc.tracker.*
+  bool tracking;
+  struct hvc_tracker body_tracker;
+  struct hvc_tracker face_tracker;
+
+  // Debounced occupancy, hvc.presence.*
+  bool presence_enabled;
+  struct hvc_presence presence;
+
+  // Every result is published here for consumers on other tasks
+  struct hvc_frame_slot frame_slots[MGOS_HVC_FRAME_RING_SIZE];
+  struct hvc_frame_ring frames;
+
+  // Optional binary trace of the link, hvc.trace records
+  struct hvc_trace trace;
+
+  // Optional raw capture of the UART traffic, hvc.record bytes
+  bool recording;
+  struct hvc_recorder recorder;
+
+  // Debug images are streamed straight to flash, optionally through the
+  // encoder (hvc.debug_encode)
+  struct hvc_image_file debug_image_file;
+  struct hvc_image_sink debug_image_sink;
+  struct hvc_image_encoder debug_image_encoder;
+  struct hvc_image_sink debug_encoder_sink;
+  int iteration;
+
+  // Asynchronous mode state. With hvc.pipeline the next execution is
+  // queued while the current one runs.
+  struct hvc_queue queue;
+  bool pipeline;
+  int queued;
+  int64_t async_last_tick;
+  int async_wait_ms;
+  int async_delay_ms;
+};
+
+static struct mgos_hvc_sensor sensors[MGOS_HVC_MAX_SENSORS];
+static int sensor_count = 0;
+
+static const char* debug_image_paths[MGOS_HVC_MAX_SENSORS] = { HVC_DEBUG_IMAGE_PATH, HVC_DEBUG_IMAGE_PATH_2 };
+
+/*
+ * Proxy logging, the library filters by level before formatting so only
+ * messages that will be printed reach this point. Formatted on the
+ * calling task's stack, sensors log from their own tasks.
+ */
+static void _mgos_hvc_log(enum cs_log_level level, const char* format, va_list ap)
+{
+  char buffer[MGOS_HVC_LOG_BUFFER];
+
+  vsnprintf(buffer, sizeof(buffer), format, ap);
+  LOG(level, ("%s", buffer));
+}
 
 void hvc_log_debug(const char* format, ...)
 {
   va_list ap;
   va_start(ap, format);
-
-  vsprintf(log_buffer, format, ap);
+  _mgos_hvc_log(LL_DEBUG, format, ap);
   va_end(ap);
-
-  LOG(LL_DEBUG, (util_terminate_string(log_buffer, strlen(log_buffer))));
 }
 
 void hvc_log_info(const char* format, ...)
 {
   va_list ap;
   va_start(ap, format);
-
-  vsprintf(log_buffer, format, ap);
+  _mgos_hvc_log(LL_INFO, format, ap);
   va_end(ap);
-
-  LOG(LL_INFO, (util_terminate_string(log_buffer, strlen(log_buffer))));
 }
 
 void hvc_log_error(const char* format, ...)
 {
   va_list ap;
   va_start(ap, format);
-
-  vsprintf(log_buffer, format, ap);
+  _mgos_hvc_log(LL_ERROR, format, ap);
   va_end(ap);
+}
 
-  LOG(LL_ERROR, (util_terminate_string(log_buffer, strlen(log_buffer))));
+static int64_t _mgos_hvc_log_clock()
+{
+  return mgos_uptime_micros();
 }
 
-int hvc_read_bytes_available()
+static int _mgos_hvc_available(void* ctx)
 {
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
   int length;
-  uart_get_buffered_data_len(HVC_UART_NUM, (size_t*) &length);
+
+  uart_get_buffered_data_len(sensor->uart_num, (size_t*) &length);
   return length;
 }
 
 /*
- * Mongoose OS specific implementation of the write function
+ * Mongoose OS specific implementation of the wait function. Blocks on the
+ * UART driver event queue until enough bytes are buffered or the deadline
+ * passes.
+ *
+ * @param void* ctx
+ * @param int   length
+ * @param int   timeout_ms
+ */
+static int _mgos_hvc_wait(void* ctx, int length, int timeout_ms)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+  TickType_t deadline = xTaskGetTickCount() + pdMS_TO_TICKS(timeout_ms);
+  int avail;
+
+  while ((avail = _mgos_hvc_available(sensor)) < length)
+  {
+    TickType_t remaining = deadline - xTaskGetTickCount();
+
+    if ((int32_t) remaining <= 0) break;
+
+    uart_event_t event;
+    xQueueReceive(sensor->uart_queue, &event, remaining);
+  }
+
+  return avail;
+}
+
+static void _mgos_hvc_sleep(void* ctx, int ms)
+{
+  vTaskDelay(ms / portTICK_RATE_MS);
+}
+
+/*
+ * Mongoose OS specific implementation of the host baudrate switch. Waits
+ * for pending writes to go out at the old rate and drops anything received
+ * at the wrong rate.
  *
+ * @param void* ctx
+ * @param int   baudrate
+ */
+static bool _mgos_hvc_set_baudrate(void* ctx, int baudrate)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+
+  uart_wait_tx_done(sensor->uart_num, pdMS_TO_TICKS(HVC_RESPONSE_TIMEOUT));
+
+  if (uart_set_baudrate(sensor->uart_num, baudrate) != ESP_OK)
+  {
+    LOG(LL_ERROR, ("Unable to set UART%d baudrate %d", sensor->uart_num, baudrate));
+    return false;
+  }
+
+  uart_flush_input(sensor->uart_num);
+  return true;
+}
+
+/*
+ * Mongoose OS specific implementation of the read function
+ *
+ * @param void* ctx
  * @param char* data
  * @param int   length
+ * @param int   timeout_ms
  */
-int hvc_read_bytes(char* data, int length)
+static int _mgos_hvc_read(void* ctx, char* data, int length, int timeout_ms)
 {
-  // TODO configure timeout
-  int read = uart_read_bytes(HVC_UART_NUM, (unsigned char*) data, length, 100);
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+  int read = uart_read_bytes(sensor->uart_num, (unsigned char*) data, length, pdMS_TO_TICKS(timeout_ms));
 
   if (read != length)
   {
@@ -82,12 +234,14 @@ int hvc_read_bytes(char* data, int length)
 /*
  * Mongoose OS specific implementation of the write function
  *
- * @param char* data
- * @param int   length
+ * @param void*       ctx
+ * @param const char* data
+ * @param int         length
  */
-int hvc_write_bytes(char* data, int length)
+static int _mgos_hvc_write(void* ctx, const char* data, int length)
 {
-  int written = uart_write_bytes(HVC_UART_NUM, data, length);
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+  int written = uart_write_bytes(sensor->uart_num, data, length);
 
   if (written != length)
   {
@@ -97,51 +251,425 @@ int hvc_write_bytes(char* data, int length)
   return written;
 }
 
-static void _hvc_exec()
+/*
+ * Mongoose OS specific monotonic clock in microseconds
+ *
+ * @param void* ctx
+ */
+static int64_t _mgos_hvc_clock(void* ctx)
+{
+  return mgos_uptime_micros();
+}
+
+/*
+ * Debug image settings, an image is captured on the first detection and
+ * then every debug_interval detections if configured.
+ */
+static bool debug = false;
+static int debug_interval = 0;
+static bool debug_encode = false;
+static bool detection_events = false;
+
+static void _hvc_scheduler_init(struct mgos_hvc_sensor* sensor)
+{
+  struct hvc_scheduler_config config = {
+    .idle_interval = mgos_sys_config_get_hvc_scheduler_idle_interval(),
+    .active_interval = mgos_sys_config_get_hvc_scheduler_active_interval(),
+    .idle_after = mgos_sys_config_get_hvc_scheduler_idle_after(),
+    .idle_function = mgos_sys_config_get_hvc_scheduler_idle_function(),
+    .active_function = mgos_sys_config_get_hvc_scheduler_active_function(),
+    .duty_cycle = mgos_sys_config_get_hvc_scheduler_duty_cycle(),
+    .latency_target = mgos_sys_config_get_hvc_scheduler_latency_target(),
+    .max_idle_interval = mgos_sys_config_get_hvc_power_enable() ? mgos_sys_config_get_hvc_power_max_interval() : 0
+  };
+
+  hvc_scheduler_init(&sensor->scheduler, &config);
+}
+
+static int _hvc_next_image(struct mgos_hvc_sensor* sensor)
+{
+  int iteration = sensor->iteration++;
+  bool capture = debug && (iteration == 0 || (debug_interval > 0 && iteration % debug_interval == 0));
+
+  // Delta images are appended to the key image they build on, a key
+  // image starts the file over
+  if (capture && debug_encode)
+  {
+    sensor->debug_image_file.append = !hvc_image_encoder_key_due(&sensor->debug_image_encoder);
+  }
+
+  return capture ? HVC_EX_IMAGE_QVGA_HALF : HVC_EX_IMAGE_NONE;
+}
+
+static void _hvc_track_event(struct hvc_tracker* tracker, int event, const struct hvc_track* track, void* ctx)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+
+  struct mgos_hvc_track_event data = {
+    .sensor = sensor->index,
+    .kind = tracker->config.kind,
+    .event = event,
+    .count = hvc_tracker_count(tracker),
+    .track = track
+  };
+
+  mgos_event_trigger(MGOS_HVC_EVENT_TRACK, &data);
+}
+
+static void _hvc_tracker_init(struct mgos_hvc_sensor* sensor)
+{
+  sensor->tracking = mgos_sys_config_get_hvc_tracker_enable();
+
+  struct hvc_tracker_config config = {
+    .kind = HVC_TRACK_BODIES,
+    .min_overlap = mgos_sys_config_get_hvc_tracker_min_overlap(),
+    .confirm_frames = mgos_sys_config_get_hvc_tracker_confirm_frames(),
+    .leave_frames = mgos_sys_config_get_hvc_tracker_leave_frames()
+  };
+
+  hvc_tracker_init(&sensor->body_tracker, &config, _hvc_track_event, sensor);
+
+  config.kind = HVC_TRACK_FACES;
+  hvc_tracker_init(&sensor->face_tracker, &config, _hvc_track_event, sensor);
+}
+
+static void _hvc_presence_event(struct hvc_presence* presence, int event, void* ctx)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+
+  struct mgos_hvc_presence_event data = {
+    .sensor = sensor->index,
+    .event = event,
+    .count = presence->count,
+    .duration = event == HVC_PRESENCE_COUNT ? 0 : (int) presence->duration
+  };
+
+  LOG(LL_INFO, ("HVC%d %s, %d people", sensor->index,
+    presence->occupied ? "occupied" : "vacant", presence->count));
+
+  mgos_event_trigger(MGOS_HVC_EVENT_PRESENCE, &data);
+}
+
+static void _hvc_presence_init(struct mgos_hvc_sensor* sensor)
+{
+  sensor->presence_enabled = mgos_sys_config_get_hvc_presence_enable();
+
+  struct hvc_presence_config config = {
+    .window = mgos_sys_config_get_hvc_presence_window(),
+    .enter = mgos_sys_config_get_hvc_presence_enter(),
+    .leave = mgos_sys_config_get_hvc_presence_leave(),
+    .min_confidence = mgos_sys_config_get_hvc_presence_min_confidence(),
+    .count_frames = mgos_sys_config_get_hvc_presence_count_frames()
+  };
+
+  hvc_presence_init(&sensor->presence, &config, _hvc_presence_event, sensor);
+}
+
+static void _hvc_dispatch(struct mgos_hvc_sensor* sensor)
+{
+  struct hvc_execution_response* result = &sensor->execution_res;
+  int64_t now = mgos_uptime_micros();
+
+  hvc_frame_ring_publish(&sensor->frames, now, result);
+
+  if (sensor->tracking)
+  {
+    hvc_tracker_update(&sensor->body_tracker, result, now / 1000);
+    hvc_tracker_update(&sensor->face_tracker, result, now / 1000);
+  }
+
+  if (sensor->presence_enabled)
+  {
+    hvc_presence_update(&sensor->presence, result, now / 1000);
+  }
+
+  int matches = result->body_count + result->face_count;
+
+  if (detection_events && matches)
+  {
+    struct mgos_hvc_detection_event event = { .sensor = sensor->index, .res = result };
+    mgos_event_trigger(MGOS_HVC_EVENT_DETECTION, &event);
+  }
+}
+
+static void _hvc_dispatch_init(struct mgos_hvc_sensor* sensor)
+{
+  struct mgos_hvc_init_event event = {
+    .sensor = sensor->index,
+    .version = &sensor->version_res,
+    .time_to_ready = sensor->time_to_ready
+  };
+
+  mgos_event_trigger(MGOS_HVC_EVENT_INIT, &event);
+}
+
+/*
+ * Power gating, the sensor is switched off for pauses of at least
+ * hvc.power.off_min ms while the scene is empty.
+ */
+static void _hvc_power(struct mgos_hvc_sensor* sensor, bool on)
+{
+  mgos_gpio_write(sensor->power_gpio, on == mgos_sys_config_get_hvc_power_active_high());
+}
+
+/*
+ * Power the sensor and wait for it to answer, then bring the link back
+ * up to speed and write the settings it lost. Returns false if it didn't
+ * come up within hvc.power.boot_timeout ms.
+ */
+static bool _hvc_power_up(struct mgos_hvc_sensor* sensor)
 {
-  bool debug = mgos_sys_config_get_hvc_debug();
+  struct hvc_device* dev = &sensor->device;
+  struct hvc_get_version_response version;
+  int64_t deadline = mgos_uptime_micros() + mgos_sys_config_get_hvc_power_boot_timeout() * 1000LL;
+  bool ready;
+
+  _hvc_power(sensor, true);
 
-  // TODO NULL protection
-  struct hvc_get_version_response* version_res = hvc_get_version();
-  mgos_event_trigger(MGOS_HVC_EVENT_INIT, version_res);
-  free(version_res);
+  // The HVC boots at its default rate, no point retrying while it does
+  hvc_set_retry(dev, 0);
+  hvc_set_host_baudrate(dev, mgos_sys_config_get_hvc_baudrate());
+
+  while (!(ready = hvc_get_version_r(dev, &version) == HVC_OK) && mgos_uptime_micros() < deadline)
+  {
+    vTaskDelay(HVC_POWER_POLL_INTERVAL / portTICK_RATE_MS);
+  }
+
+  if (ready && sensor->max_baudrate > 0) ready = hvc_negotiate_baudrate(dev, sensor->max_baudrate) > 0;
+
+  // Nothing to read back, a fresh HVC has its defaults
+  if (ready) ready = hvc_restore_config(dev, &sensor->config, MGOS_HVC_CONFIG_RETRY) >= 0;
+
+  hvc_set_retry(dev, HVC_DEFAULT_READ_RETRY);
+
+  if (!ready) LOG(LL_ERROR, ("HVC%d didn't come up after power on", sensor->index));
+
+  return ready;
+}
+
+/*
+ * Sleep through a pause with the sensor off, powering it up early enough
+ * for the next detection to be on time
+ */
+static void _hvc_power_cycle(struct mgos_hvc_sensor* sensor, int delay)
+{
+  LOG(LL_DEBUG, ("HVC%d off for %d ms", sensor->index, delay));
+
+  _hvc_power(sensor, false);
+  vTaskDelay((delay - sensor->wake_ms) / portTICK_RATE_MS);
+
+  int64_t start = mgos_uptime_micros();
+
+  if (sensor->wake_start == 0) sensor->wake_start = start;
+
+  _hvc_power_up(sensor);
+  sensor->wake_ms = (mgos_uptime_micros() - start) / 1000;
+}
+
+static void _hvc_exec(void* arg)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) arg;
+  struct hvc_device* dev = &sensor->device;
+
+  if (hvc_get_version_r(dev, &sensor->version_res) == HVC_OK)
+  {
+    _hvc_dispatch_init(sensor);
+  }
+  else
+  {
+    LOG(LL_ERROR, ("Unable to read HVC%d version", sensor->index));
+  }
 
   // Delay initialization before we start running executions. This
   // will give the event handler code time to register the init event.
-  vTaskDelay(100 / portTICK_RATE_MS);
+  vTaskDelay(HVC_EXECUTION_INTERVAL / portTICK_RATE_MS);
 
   while(1)
   {
-    struct hvc_execution_response* res = hvc_execution(
-      HVC_EX_BODY_DETECTION | HVC_EX_FACE_DETECTION,
-      debug ? HVC_EX_IMAGE_QVGA_HALF : HVC_EX_IMAGE_NONE
-    );
+    int64_t start = mgos_uptime_micros();
+    int status = hvc_execution_r(dev, hvc_scheduler_function(&sensor->scheduler), _hvc_next_image(sensor), &sensor->execution_res);
+    int latency = (mgos_uptime_micros() - start) / 1000;
 
-    if (res != NULL)
+    // The detections are complete when only the debug capture failed
+    if (status == HVC_ERR_SINK) status = HVC_OK;
+
+    if (status == HVC_OK && sensor->wake_start)
     {
-      int matches = res->body_count + res->face_count;
+      hvc_metrics_wake(hvc_get_metrics(dev), (start - sensor->wake_start) / 1000 + latency);
+      sensor->wake_start = 0;
+    }
 
-      if (matches)
-      {
-        mgos_event_trigger(MGOS_HVC_EVENT_DETECTION, res);
-      }
+    if (status == HVC_OK)
+    {
+      _hvc_dispatch(sensor);
     }
 
-    // Unset debug. We don't want images to keep dumping, just
-    // when the device boots up and does the first recognition.
-    debug = false;
+    int delay = hvc_scheduler_update(&sensor->scheduler, status == HVC_OK ? &sensor->execution_res : NULL, latency);
 
-    // Free the resource
-    free(res);
+    if (sensor->power_gpio >= 0 && delay >= mgos_sys_config_get_hvc_power_off_min() && delay > sensor->wake_ms)
+    {
+      _hvc_power_cycle(sensor, delay);
+      continue;
+    }
 
-    vTaskDelay(HVC_EXECUTION_INTERVAL / portTICK_RATE_MS);
+    vTaskDelay(delay / portTICK_RATE_MS);
   }
 
   vTaskDelete(NULL);
 }
 
-void mgos_hvc_init()
+/*
+ * Asynchronous mode, the queues are driven from Mongoose OS timers so no
+ * dedicated tasks are needed.
+ */
+static void _hvc_async_exec_done(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx);
+
+static void _hvc_async_execute(struct mgos_hvc_sensor* sensor)
 {
+  int id = hvc_queue_execute(&sensor->queue, hvc_scheduler_function(&sensor->scheduler), _hvc_next_image(sensor), 0, _hvc_async_exec_done, sensor);
+
+  if (id > 0) sensor->queued++;
+}
+
+static void _hvc_async_exec_done(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+
+  sensor->queued--;
+
+  // The detections are complete when only the debug capture failed
+  if (status == HVC_OK || status == HVC_ERR_SINK)
+  {
+    status = hvc_parse_execution(queue->payload, queue->payload_length, request->function, &sensor->execution_res);
+  }
+
+  // The next execution, if queued, is already running on the sensor.
+  // When the scheduler wants no pause queue the one after it before
+  // dispatching, the execution flags lag one frame behind.
+  int latency = request->latency_ms > 0 ? request->latency_ms : 0;
+
+  sensor->async_delay_ms = hvc_scheduler_update(&sensor->scheduler, status == HVC_OK ? &sensor->execution_res : NULL, latency);
+  sensor->async_wait_ms = 0;
+
+  if (sensor->pipeline && sensor->async_delay_ms == 0 && sensor->queued < 2)
+  {
+    _hvc_async_execute(sensor);
+  }
+
+  if (status == HVC_OK)
+  {
+    _hvc_dispatch(sensor);
+  }
+}
+
+static void _hvc_async_version_done(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) ctx;
+
+  if (status == HVC_OK && hvc_parse_version(queue->payload, queue->payload_length, &sensor->version_res) == HVC_OK)
+  {
+    _hvc_dispatch_init(sensor);
+  }
+  else
+  {
+    LOG(LL_ERROR, ("Unable to read HVC%d version", sensor->index));
+  }
+
+  sensor->async_wait_ms = 0;
+}
+
+static void _hvc_async_timer(void* arg)
+{
+  struct mgos_hvc_sensor* sensor = (struct mgos_hvc_sensor*) arg;
+  struct hvc_queue* queue = &sensor->queue;
+  int64_t now = mgos_uptime_micros();
+  int elapsed = (now - sensor->async_last_tick) / 1000;
+  sensor->async_last_tick = now;
+
+  hvc_queue_poll(queue);
+  hvc_queue_tick(queue, elapsed);
+
+  if (hvc_queue_pending(queue) > 0) return;
+
+  // Wait the delay the scheduler asked for between the end of one
+  // detection and the start of the next, like the blocking loop does.
+  sensor->async_wait_ms += elapsed;
+
+  if (sensor->async_wait_ms >= sensor->async_delay_ms)
+  {
+    _hvc_async_execute(sensor);
+  }
+}
+
+static void _hvc_start_async(struct mgos_hvc_sensor* sensor)
+{
+  hvc_queue_init(&sensor->queue, &sensor->device);
+  sensor->pipeline = mgos_sys_config_get_hvc_pipeline();
+  sensor->queued = 0;
+  sensor->async_last_tick = mgos_uptime_micros();
+  sensor->async_wait_ms = 0;
+  sensor->async_delay_ms = HVC_EXECUTION_INTERVAL;
+
+  hvc_queue_submit(&sensor->queue, HVC_CMD_GET_VERSION, NULL, 0, 0, _hvc_async_version_done, sensor);
+
+  mgos_set_timer(HVC_ASYNC_POLL_INTERVAL, MGOS_TIMER_REPEAT, _hvc_async_timer, sensor);
+}
+
+/*
+ * Install the UART driver of a sensor and bring the HVC into the
+ * configured state.
+ */
+static void _hvc_sensor_init(struct mgos_hvc_sensor* sensor, int index, int uart_num, int rx, int tx, int power_gpio)
+{
+  int64_t start = mgos_uptime_micros();
+
+  sensor->index = index;
+  sensor->uart_num = uart_num;
+  sensor->power_gpio = mgos_sys_config_get_hvc_power_enable() ? power_gpio : -1;
+
+  struct hvc_transport transport = {
+    .read = _mgos_hvc_read,
+    .write = _mgos_hvc_write,
+    .available = _mgos_hvc_available,
+    .wait = _mgos_hvc_wait,
+    .sleep = _mgos_hvc_sleep,
+    .set_baudrate = _mgos_hvc_set_baudrate,
+    .clock = _mgos_hvc_clock,
+    .ctx = sensor
+  };
+
+  // Capture the traffic from the first byte for replay on a host
+  int record_size = mgos_sys_config_get_hvc_record();
+
+  if (record_size > 0)
+  {
+    char path[sizeof(MGOS_HVC_RECORD_PATH) + 8];
+    snprintf(path, sizeof(path), MGOS_HVC_RECORD_PATH, index);
+
+    sensor->recording = hvc_recorder_open(&sensor->recorder, path, record_size, &transport, &transport) == HVC_OK;
+  }
+
+  struct hvc_device* dev = &sensor->device;
+  hvc_device_init(dev, &transport);
+
+  // Trace the link from the first byte, init is where things go wrong
+  int trace_size = mgos_sys_config_get_hvc_trace();
+
+  if (trace_size > 0 && (trace_size & (trace_size - 1)) == 0)
+  {
+    struct hvc_trace_record* records = calloc(trace_size, sizeof(struct hvc_trace_record));
+
+    if (records)
+    {
+      hvc_trace_init(&sensor->trace, records, trace_size);
+      hvc_set_trace(dev, &sensor->trace);
+    }
+  }
+  else if (trace_size != 0)
+  {
+    LOG(LL_ERROR, ("hvc.trace must be a power of two, tracing disabled"));
+  }
+
   // Configure parameters of an UART driver,
   // communication pins and install the driver
   uart_config_t uart_config = {
@@ -152,58 +680,289 @@ void mgos_hvc_init()
     .flow_ctrl = UART_HW_FLOWCTRL_DISABLE
   };
 
-  int rx = mgos_sys_config_get_hvc_rx();
-  int tx = mgos_sys_config_get_hvc_tx();
-
-  ESP_ERROR_CHECK(uart_param_config(HVC_UART_NUM, &uart_config));
-  ESP_ERROR_CHECK(uart_set_pin(HVC_UART_NUM, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
-  ESP_ERROR_CHECK(uart_driver_install(HVC_UART_NUM, HVC_UART_BUFFER_SIZE, 0, 0, NULL, 0));
+  ESP_ERROR_CHECK(uart_param_config(uart_num, &uart_config));
+  ESP_ERROR_CHECK(uart_set_pin(uart_num, tx, rx, UART_PIN_NO_CHANGE, UART_PIN_NO_CHANGE));
+  ESP_ERROR_CHECK(uart_driver_install(uart_num, HVC_UART_BUFFER_SIZE, 0, HVC_UART_QUEUE_SIZE, &sensor->uart_queue, 0));
 
   // Don't attempt to retry these first connections, if they can't complete
   // quickly then something is wrong and we should probably reset sooner rather
   // than later.
-  hvc_set_retry(0);
+  hvc_set_retry(dev, 0);
 
   // Drain the buffer before executing more. The reason we do this is
   // that there might be previous command responses still flowing in even after
   // the system restarted.
-  ESP_ERROR_CHECK(uart_flush(HVC_UART_NUM));
+  ESP_ERROR_CHECK(uart_flush(uart_num));
 
   // Flushing doesn't seem sufficient, lets manually drain the buffer if
-  // anything is left.
-  char c;
+  // anything is left. Whatever still trickles in later is skipped by the
+  // parser's resynchronisation.
+  hvc_flush(dev);
+
+  // Configuration variables. Don't think the face angle matching needs
+  // to be configurable at this point.
+  struct hvc_config config = {
+    .camera_angle = { .angle = mgos_sys_config_get_hvc_camera_angle() },
+    .thresholds = {
+      .body = mgos_sys_config_get_hvc_thresholds_body(),
+      .hand = mgos_sys_config_get_hvc_thresholds_hand(),
+      .face = mgos_sys_config_get_hvc_thresholds_face(),
+      .recognition = mgos_sys_config_get_hvc_thresholds_recognition()
+    },
+    .detection_size = {
+      .min_body = mgos_sys_config_get_hvc_detection_size_min_body(),
+      .max_body = mgos_sys_config_get_hvc_detection_size_max_body(),
+      .min_hand = mgos_sys_config_get_hvc_detection_size_min_hand(),
+      .max_hand = mgos_sys_config_get_hvc_detection_size_max_hand(),
+      .min_face = mgos_sys_config_get_hvc_detection_size_min_face(),
+      .max_face = mgos_sys_config_get_hvc_detection_size_max_face()
+    },
+    .face_angle = { .yaw = HVC_YAW_ANGLE_30, .roll = HVC_ROLL_ANGLE_15 }
+  };
 
-  while (hvc_read_bytes_available())
+  sensor->config = config;
+  sensor->max_baudrate = mgos_sys_config_get_hvc_max_baudrate();
+
+  // Below the slowest rate negotiation would always fail, leave the link alone
+  if (sensor->max_baudrate > 0 && sensor->max_baudrate < hvc_baudrate_value(HVC_BAUD_9600))
   {
-    hvc_read_bytes(&c, 500);
+    LOG(LL_ERROR, ("hvc.max_baudrate %d is below 9600, negotiation disabled", sensor->max_baudrate));
+    sensor->max_baudrate = 0;
   }
 
-  // Configuration variables
-  int angle = mgos_sys_config_get_hvc_camera_angle();
-  int thres_b = mgos_sys_config_get_hvc_thresholds_body();
-  int thres_h = mgos_sys_config_get_hvc_thresholds_hand();
-  int thres_f = mgos_sys_config_get_hvc_thresholds_face();
-  int thres_r  = mgos_sys_config_get_hvc_thresholds_recognition();
-  int dmin_b = mgos_sys_config_get_hvc_detection_size_min_body();
-  int dmax_b = mgos_sys_config_get_hvc_detection_size_max_body();
-  int dmin_h = mgos_sys_config_get_hvc_detection_size_min_hand();
-  int dmax_h = mgos_sys_config_get_hvc_detection_size_max_hand();
-  int dmin_f = mgos_sys_config_get_hvc_detection_size_min_face();
-  int dmax_f = mgos_sys_config_get_hvc_detection_size_max_face();
+  if (sensor->power_gpio >= 0)
+  {
+    // A gated sensor may have been off until now, it comes up exactly
+    // like it does after every pause
+    mgos_gpio_set_mode(sensor->power_gpio, MGOS_GPIO_MODE_OUTPUT);
+    MGOS_HVC_ERROR_CHECK(_hvc_power_up(sensor));
+  }
+  else
+  {
+    // Move the link to the fastest rate both ends can sustain
+    if (sensor->max_baudrate > 0 && hvc_negotiate_baudrate(dev, sensor->max_baudrate) < 0)
+    {
+      LOG(LL_ERROR, ("Unable to reach HVC%d, restart...", index));
+      mgos_system_restart();
+    }
 
-  // Setup HVC
-  MGOS_HVC_ERROR_CHECK(hvc_set_camera_angle(angle));
-  MGOS_HVC_ERROR_CHECK(hvc_set_threshold_values(thres_b, thres_h, thres_f, thres_r));
-  MGOS_HVC_ERROR_CHECK(hvc_set_detection_size(dmin_b, dmax_b, dmin_h, dmax_h, dmin_f, dmax_f));
+    // Setup HVC, a sensor that kept its settings across our reboot only
+    // costs one burst of reads. Restart if a setting can't be written
+    // even after retrying.
+    MGOS_HVC_ERROR_CHECK(hvc_apply_config(dev, &config, MGOS_HVC_CONFIG_RETRY) >= 0);
+  }
 
-  // Don't think the face angle matching needs to be configurable at this point
-  MGOS_HVC_ERROR_CHECK(hvc_set_face_angle(HVC_YAW_ANGLE_30, HVC_ROLL_ANGLE_15));
+  sensor->time_to_ready = (mgos_uptime_micros() - start) / 1000;
+  sensor->wake_ms = sensor->time_to_ready;
+  LOG(LL_INFO, ("HVC%d ready in %d ms", index, sensor->time_to_ready));
 
   // Reset the retry before our normal procedures commence.
-  hvc_set_retry(HVC_DEFAULT_READ_RETRY);
+  hvc_set_retry(dev, HVC_DEFAULT_READ_RETRY);
+
+  hvc_image_file_sink_init(&sensor->debug_image_sink, &sensor->debug_image_file, debug_image_paths[index]);
+  hvc_set_image_sink(dev, &sensor->debug_image_sink);
+
+  if (debug_encode)
+  {
+    // Deltas need the previous image, QVGA_HALF is what gets captured
+    int key_interval = mgos_sys_config_get_hvc_debug_key_interval();
+    int reference_size = MGOS_HVC_DEBUG_IMAGE_WIDTH * MGOS_HVC_DEBUG_IMAGE_HEIGHT;
+    char* reference = key_interval > 1 ? malloc(reference_size) : NULL;
+
+    hvc_image_encoder_init(&sensor->debug_encoder_sink, &sensor->debug_image_encoder, &sensor->debug_image_sink,
+      reference, reference_size, key_interval);
+    hvc_set_image_sink(dev, &sensor->debug_encoder_sink);
+  }
+
+  hvc_frame_ring_init(&sensor->frames, sensor->frame_slots, MGOS_HVC_FRAME_RING_SIZE);
+
+  _hvc_scheduler_init(sensor);
+  _hvc_tracker_init(sensor);
+  _hvc_presence_init(sensor);
+}
+
+/*
+ * json_printf callbacks for the HVC.Metrics response
+ */
+static int _hvc_metrics_errors_json(struct json_out* out, va_list* ap)
+{
+  const struct hvc_metrics* metrics = va_arg(*ap, const struct hvc_metrics*);
+  int len = json_printf(out, "[");
+
+  for (int i = 0; i < HVC_METRICS_ERRORS; i++)
+  {
+    len += json_printf(out, "%s%u", i ? "," : "", (unsigned) metrics->errors[i]);
+  }
 
-  // Run setup task in different vTask since we don't want to block
-  // the UART task from pushing and pulling from the socket.
-  // TODO check stack size please
-  xTaskCreate(&_hvc_exec, "_hvc_exec", 5000, NULL, 1, NULL);
-}
\ No newline at end of file
+  return len + json_printf(out, "]");
+}
+
+static int _hvc_metrics_commands_json(struct json_out* out, va_list* ap)
+{
+  const struct hvc_metrics* metrics = va_arg(*ap, const struct hvc_metrics*);
+  int len = json_printf(out, "[");
+
+  for (int i = 0; i < metrics->command_count; i++)
+  {
+    const struct hvc_command_metrics* cmd = &metrics->commands[i];
+    unsigned avg = cmd->count ? (unsigned) (cmd->total_us / cmd->count) : 0;
+
+    len += json_printf(out, "%s{cmd: %d, count: %u, errors: %u, avg_us: %u, max_us: %u, histogram: [",
+      i ? "," : "", cmd->cmd, (unsigned) cmd->count, (unsigned) cmd->errors, avg, (unsigned) cmd->max_us);
+
+    for (int j = 0; j < HVC_METRICS_BUCKETS; j++)
+    {
+      len += json_printf(out, "%s%u", j ? "," : "", (unsigned) cmd->histogram[j]);
+    }
+
+    len += json_printf(out, "]}");
+  }
+
+  return len + json_printf(out, "]");
+}
+
+/*
+ * HVC.Metrics {sensor: 0}, dump the instrumentation of a sensor
+ */
+static void _hvc_metrics_handler(struct mg_rpc_request_info* ri, void* cb_arg,
+                                 struct mg_rpc_frame_info* fi, struct mg_str args)
+{
+  int index = 0;
+  json_scanf(args.p, args.len, ri->args_fmt, &index);
+
+  const struct hvc_metrics* metrics = mgos_hvc_get_metrics(index);
+
+  if (metrics == NULL)
+  {
+    mg_rpc_send_errorf(ri, 400, "Sensor %d is not enabled", index);
+    return;
+  }
+
+  unsigned wake_avg_ms = metrics->wakes ? (unsigned) (metrics->wake_total_ms / metrics->wakes) : 0;
+
+  mg_rpc_send_responsef(ri, "{sensor: %d, bytes_tx: %u, bytes_rx: %u, image_missing: %u, resyncs: %u, discarded: %u, "
+    "wakes: %u, wake_last_ms: %u, wake_avg_ms: %u, wake_max_ms: %u, errors: %M, commands: %M}",
+    index, (unsigned) metrics->bytes_tx, (unsigned) metrics->bytes_rx, (unsigned) metrics->image_missing,
+    (unsigned) metrics->resyncs, (unsigned) metrics->discarded,
+    (unsigned) metrics->wakes, (unsigned) metrics->wake_last_ms, wake_avg_ms, (unsigned) metrics->wake_max_ms,
+    _hvc_metrics_errors_json, metrics, _hvc_metrics_commands_json, metrics);
+}
+
+/*
+ * HVC.Trace {sensor: 0}, save the trace ring of a sensor to a file that
+ * can be fetched with mos get
+ */
+static void _hvc_trace_handler(struct mg_rpc_request_info* ri, void* cb_arg,
+                               struct mg_rpc_frame_info* fi, struct mg_str args)
+{
+  int index = 0;
+  json_scanf(args.p, args.len, ri->args_fmt, &index);
+
+  if (index < 0 || index >= sensor_count || !sensors[index].device.trace)
+  {
+    mg_rpc_send_errorf(ri, 400, "Sensor %d is not tracing", index);
+    return;
+  }
+
+  char path[sizeof(MGOS_HVC_TRACE_PATH) + 8];
+  snprintf(path, sizeof(path), MGOS_HVC_TRACE_PATH, index);
+
+  int records = hvc_trace_save_file(&sensors[index].trace, path);
+
+  if (records < 0)
+  {
+    mg_rpc_send_errorf(ri, 500, "Unable to write %s", path);
+    return;
+  }
+
+  mg_rpc_send_responsef(ri, "{file: %Q, records: %d}", path, records);
+}
+
+/*
+ * HVC.Record {sensor: 0}, finish the raw capture of a sensor so it can be
+ * fetched with mos get. The file is closed by the sensor's next command.
+ */
+static void _hvc_record_handler(struct mg_rpc_request_info* ri, void* cb_arg,
+                                struct mg_rpc_frame_info* fi, struct mg_str args)
+{
+  int index = 0;
+  json_scanf(args.p, args.len, ri->args_fmt, &index);
+
+  if (index < 0 || index >= sensor_count || !sensors[index].recording)
+  {
+    mg_rpc_send_errorf(ri, 400, "Sensor %d is not recording", index);
+    return;
+  }
+
+  struct hvc_recorder* rec = &sensors[index].recorder;
+  rec->stop = true;
+
+  char path[sizeof(MGOS_HVC_RECORD_PATH) + 8];
+  snprintf(path, sizeof(path), MGOS_HVC_RECORD_PATH, index);
+
+  mg_rpc_send_responsef(ri, "{file: %Q, bytes: %u, truncated: %B}", path, (unsigned) rec->bytes, rec->truncated);
+}
+
+void mgos_hvc_init()
+{
+  // Messages are only formatted when Mongoose OS would print them
+  hvc_log_set_level(cs_log_level >= LL_DEBUG ? HVC_LOG_LEVEL_DEBUG : cs_log_level >= LL_INFO ? HVC_LOG_LEVEL_INFO : HVC_LOG_LEVEL_ERROR);
+  hvc_log_set_clock(_mgos_hvc_log_clock);
+
+  debug = mgos_sys_config_get_hvc_debug();
+  debug_interval = mgos_sys_config_get_hvc_debug_interval();
+  debug_encode = mgos_sys_config_get_hvc_debug_encode();
+  detection_events = mgos_sys_config_get_hvc_detection_events();
+
+  int count = 0;
+
+  _hvc_sensor_init(&sensors[count++], 0, mgos_sys_config_get_hvc_uart_num(), mgos_sys_config_get_hvc_rx(), mgos_sys_config_get_hvc_tx(),
+    mgos_sys_config_get_hvc_power_gpio());
+
+  if (mgos_sys_config_get_hvc_sensor2_enable())
+  {
+    _hvc_sensor_init(&sensors[count++], 1, mgos_sys_config_get_hvc_sensor2_uart_num(), mgos_sys_config_get_hvc_sensor2_rx(), mgos_sys_config_get_hvc_sensor2_tx(),
+      mgos_sys_config_get_hvc_sensor2_power_gpio());
+  }
+
+  sensor_count = count;
+
+  mg_rpc_add_handler(mgos_rpc_get_global(), "HVC.Metrics", "{sensor: %d}", _hvc_metrics_handler, NULL);
+  mg_rpc_add_handler(mgos_rpc_get_global(), "HVC.Trace", "{sensor: %d}", _hvc_trace_handler, NULL);
+  mg_rpc_add_handler(mgos_rpc_get_global(), "HVC.Record", "{sensor: %d}", _hvc_record_handler, NULL);
+
+  for (int i = 0; i < count; i++)
+  {
+    if (mgos_sys_config_get_hvc_async() || mgos_sys_config_get_hvc_pipeline())
+    {
+      // Powering up blocks for seconds, the event loop can't wait that long
+      if (sensors[i].power_gpio >= 0)
+      {
+        LOG(LL_ERROR, ("HVC%d power gating needs hvc.async and hvc.pipeline off, sensor stays on", i));
+        sensors[i].power_gpio = -1;
+      }
+
+      _hvc_start_async(&sensors[i]);
+      continue;
+    }
+
+    // Run every detection loop in its own vTask since we don't want to
+    // block the UART task from pushing and pulling from the socket.
+    // TODO check stack size please
+    xTaskCreate(&_hvc_exec, "_hvc_exec", 5000, &sensors[i], 1, NULL);
+  }
+}
+
+struct hvc_frame_ring* mgos_hvc_get_frames(int sensor)
+{
+  if (sensor < 0 || sensor >= sensor_count) return NULL;
+
+  return &sensors[sensor].frames;
+}
+
+struct hvc_metrics* mgos_hvc_get_metrics(int sensor)
+{
+  if (sensor < 0 || sensor >= sensor_count) return NULL;
+
+  return hvc_get_metrics(&sensors[sensor].device);
+}
@@ -0,0 +1,125 @@
+/**
+ * Album transfer benchmark. Registers users on the simulated sensor,
+ * saves the album to a file through the album cache, clears the sensor
+ * and loads it back, timing both directions at an emulated baud rate.
+ * The simulator paces what it sends, the host writes are paced here.
+ *
+ *   bench_album [-b baudrate]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_album.h"
+#include "hvc_test.h"
+
+static const int bench_users[] = { 25, 50, HVC_ALBUM_MAX_USERS };
+
+static struct hvc_transport bench_inner;
+static int bench_baudrate;
+
+/*
+ * Block for the wire time of the bytes written, 10 bits per byte
+ */
+static int bench_write(void* ctx, const char* data, int length)
+{
+  int written = bench_inner.write(ctx, data, length);
+
+  if (written > 0) usleep((useconds_t) ((int64_t) written * 10 * 1000000 / bench_baudrate));
+
+  return written;
+}
+
+/*
+ * Every user is enrolled with a different set of data slots
+ */
+static int bench_user_data(int user, int users)
+{
+  return user < users ? 1 << (user % HVC_ALBUM_MAX_DATA) : 0;
+}
+
+int main(int argc, char** argv)
+{
+  char path[] = "/tmp/hvc_album_XXXXXX";
+  int baudrate = 921600;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "b:")) != -1)
+  {
+    if (opt != 'b')
+    {
+      fprintf(stderr, "usage: %s [-b baudrate]\n", argv[0]);
+      return 2;
+    }
+
+    baudrate = atoi(optarg);
+  }
+
+  int fd = mkstemp(path);
+
+  if (fd < 0)
+  {
+    perror("mkstemp");
+    return 2;
+  }
+
+  close(fd);
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+
+  printf("%d baud\n\n%6s %10s %10s %10s %10s %9s\n", baudrate, "users", "bytes", "save ms", "load ms", "save KB/s", "restored");
+
+  for (int u = 0; u < (int) (sizeof(bench_users) / sizeof(bench_users[0])); u++)
+  {
+    static struct hvc_test_link link;
+    struct hvc_get_user_data_response data;
+    struct hvc_sim_config config;
+    int users = bench_users[u];
+
+    hvc_sim_default_config(&config);
+    config.compute_delay_ms = 0;
+    config.emulate_baudrate = true;
+    hvc_test_link_start(&link, &config);
+
+    if (hvc_negotiate_baudrate(&link.dev, baudrate) != baudrate)
+    {
+      fprintf(stderr, "Unable to run the link at %d baud\n", baudrate);
+      return 1;
+    }
+
+    bench_inner = link.dev.transport;
+    bench_baudrate = baudrate;
+    link.dev.transport.write = bench_write;
+
+    for (int user = 0; user < users; user++)
+    {
+      for (int slot = 0; slot < HVC_ALBUM_MAX_DATA; slot++)
+      {
+        if (bench_user_data(user, users) & (1 << slot)) hvc_register_data(&link.dev, user, slot);
+      }
+    }
+
+    int64_t start = hvc_test_now_us();
+    int size = hvc_album_save_file(&link.dev, path);
+    double save_ms = (hvc_test_now_us() - start) / 1000.0;
+
+    hvc_delete_all_data(&link.dev);
+
+    start = hvc_test_now_us();
+    int status = hvc_album_load_file(&link.dev, path);
+    double load_ms = (hvc_test_now_us() - start) / 1000.0;
+
+    int restored = 0;
+
+    for (int user = 0; user < HVC_ALBUM_MAX_USERS; user++)
+    {
+      if (hvc_get_user_data_r(&link.dev, user, &data) == HVC_OK && data.data == bench_user_data(user, users)) restored++;
+    }
+
+    printf("%6d %10d %10.1f %10.1f %10.1f %8d%%\n", users, size, save_ms, status == HVC_OK ? load_ms : -1,
+      size / save_ms, restored * 100 / HVC_ALBUM_MAX_USERS);
+
+    hvc_test_link_stop(&link);
+  }
+
+  unlink(path);
+  return 0;
+}
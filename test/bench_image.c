@@ -0,0 +1,246 @@
+/**
+ * Image encoder benchmark. Encodes a synthetic room with a person
+ * walking through it at QVGA and QVGA_HALF and increasing sensor noise,
+ * every image on its own and as deltas with a key image every 10. Reports
+ * the compression ratio and encode and decode times, every image must
+ * decode bit exact. Finishes with captures through the simulator into a
+ * sink that applies backpressure.
+ *
+ *   bench_image [-n frames]
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "hvc_image.h"
+#include "hvc_test.h"
+
+#define BENCH_PIXELS (320 * 240)
+
+/*
+ * Collects the encoder output, with backpressure it takes at most 37
+ * bytes per call and turns away a third of them
+ */
+struct bench_output
+{
+  char data[BENCH_PIXELS * 2];
+  int length;
+  bool backpressure;
+  int failures;
+};
+
+static unsigned bench_seed = 1;
+
+static bool bench_begin(void* ctx, int width, int height)
+{
+  struct bench_output* out = (struct bench_output*) ctx;
+
+  out->data[0] = width & 0xFF;
+  out->data[1] = width >> 8;
+  out->data[2] = height & 0xFF;
+  out->data[3] = height >> 8;
+  out->length = 4;
+
+  return true;
+}
+
+static int bench_write(void* ctx, const char* data, int length)
+{
+  struct bench_output* out = (struct bench_output*) ctx;
+
+  if (out->backpressure)
+  {
+    if (rand_r(&bench_seed) % 3 == 0) return 0;
+    if (length > 37) length = 37;
+  }
+
+  if (out->length + length > (int) sizeof(out->data)) return -1;
+
+  memcpy(out->data + out->length, data, length);
+  out->length += length;
+
+  return length;
+}
+
+static void bench_end(void* ctx, int status)
+{
+  struct bench_output* out = (struct bench_output*) ctx;
+
+  if (status != HVC_OK) out->failures++;
+}
+
+static double bench_gauss(void)
+{
+  double u = (rand_r(&bench_seed) + 1.0) / (RAND_MAX + 2.0);
+  double v = (rand_r(&bench_seed) + 1.0) / (RAND_MAX + 2.0);
+
+  return sqrt(-2 * log(u)) * cos(2 * M_PI * v);
+}
+
+/*
+ * A lit wall, two pieces of furniture and a person crossing the room
+ * every 40 frames
+ */
+static void bench_scene(unsigned char* image, int width, int height, int frame, double noise)
+{
+  double cx = width * (0.2 + 0.6 * ((frame % 40) / 40.0));
+  double cy = height * 0.55;
+
+  for (int y = 0; y < height; y++)
+  {
+    for (int x = 0; x < width; x++)
+    {
+      double v = 60 + 100.0 * x / width + 40.0 * y / height;
+
+      if (x > width / 8 && x < width / 3 && y > height / 2) v = 40 + 10 * sin(x * 0.3);
+      if (x > width * 2 / 3 && y > height / 5 && y < height / 2) v = 200;
+
+      double dx = (x - cx) / (width * 0.06);
+      double dy = (y - cy) / (height * 0.25);
+      double r = dx * dx + dy * dy;
+
+      if (r < 1) v = 90 + 30 * (1 - r);
+
+      v += noise * bench_gauss();
+
+      if (v < 0) v = 0;
+      if (v > 255) v = 255;
+
+      image[y * width + x] = (unsigned char) v;
+    }
+  }
+}
+
+static struct bench_output bench_output;
+static struct hvc_image_sink bench_sink = { bench_begin, bench_write, bench_end, &bench_output };
+
+static void bench_encoding(int width, int height, double noise, bool delta, int frames)
+{
+  static struct hvc_image_encoder encoder;
+  static struct hvc_image_sink sink;
+  static char reference[BENCH_PIXELS];
+  static unsigned char image[BENCH_PIXELS];
+  static char decoded[BENCH_PIXELS];
+  int pixels = width * height;
+  int64_t encode = 0, decode = 0;
+  long in = 0, out = 0;
+  int bad = 0;
+
+  hvc_image_encoder_init(&sink, &encoder, &bench_sink, delta ? reference : NULL, sizeof(reference), delta ? 10 : 0);
+
+  for (int frame = 0; frame < frames; frame++)
+  {
+    bench_scene(image, width, height, frame, noise);
+
+    // Fed in chunks the size of a UART read
+    int64_t t = hvc_test_now_us();
+    int offset = 0;
+
+    sink.begin(sink.ctx, width, height);
+
+    while (offset < pixels)
+    {
+      int length = pixels - offset < 400 ? pixels - offset : 400;
+      int written = sink.write(sink.ctx, (const char*) image + offset, length);
+
+      if (written < 0) break;
+
+      offset += written;
+    }
+
+    sink.end(sink.ctx, offset == pixels ? HVC_OK : HVC_ERR_SINK);
+    encode += hvc_test_now_us() - t;
+
+    in += pixels;
+    out += bench_output.length - 4;
+
+    t = hvc_test_now_us();
+
+    int used = hvc_image_decode(bench_output.data + 4, bench_output.length - 4, width, height, decoded);
+
+    decode += hvc_test_now_us() - t;
+
+    if (used != bench_output.length - 4 || memcmp(decoded, image, pixels) != 0) bad++;
+  }
+
+  printf("%3dx%-3d noise %.1f %-8s ratio %5.2f, encode %5lld us (%4.1f ns/px), decode %5lld us, %d bad\n", width,
+    height, noise, delta ? "delta/10" : "key", (double) in / out, (long long) (encode / frames),
+    encode * 1000.0 / frames / pixels, (long long) (decode / frames), bad);
+}
+
+/*
+ * Captures from the simulator, decoded on the fly. The decoded image is
+ * the reference of the next delta.
+ */
+static void bench_capture(int captures)
+{
+  static struct hvc_test_link link;
+  static struct hvc_image_encoder encoder;
+  static struct hvc_image_sink sink;
+  static struct hvc_execution_response res;
+  static char reference[BENCH_PIXELS];
+  static char decoded[BENCH_PIXELS];
+  struct hvc_sim_config config;
+  long in = 0, out = 0;
+  int ok = 0;
+
+  hvc_sim_default_config(&config);
+  hvc_test_link_start(&link, &config);
+
+  hvc_image_encoder_init(&sink, &encoder, &bench_sink, reference, sizeof(reference), 4);
+  hvc_set_image_sink(&link.dev, &sink);
+
+  bench_output.backpressure = true;
+  bench_output.failures = 0;
+
+  for (int i = 0; i < captures; i++)
+  {
+    int status = hvc_execution_r(&link.dev, HVC_EX_BODY_DETECTION | HVC_EX_FACE_DETECTION, HVC_EX_IMAGE_QVGA_HALF, &res);
+    int used = hvc_image_decode(bench_output.data + 4, bench_output.length - 4, 160, 120, decoded);
+
+    if (status == HVC_OK && used == bench_output.length - 4) ok++;
+
+    in += 160 * 120;
+    out += bench_output.length - 4;
+  }
+
+  printf("simulator with backpressure: %d/%d captures decoded, %d failed, ratio %.2f\n", ok, captures,
+    bench_output.failures, (double) in / out);
+
+  hvc_test_link_stop(&link);
+}
+
+int main(int argc, char** argv)
+{
+  static const int sizes[][2] = { { 320, 240 }, { 160, 120 } };
+  static const double noises[] = { 0, 1.5, 4 };
+  int frames = 30;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if (opt != 'n')
+    {
+      fprintf(stderr, "usage: %s [-n frames]\n", argv[0]);
+      return 2;
+    }
+
+    frames = atoi(optarg);
+  }
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+
+  for (int i = 0; i < 2; i++)
+  {
+    for (int j = 0; j < 3; j++)
+    {
+      bench_encoding(sizes[i][0], sizes[i][1], noises[j], false, frames);
+      bench_encoding(sizes[i][0], sizes[i][1], noises[j], true, frames);
+    }
+  }
+
+  bench_capture(12);
+
+  return 0;
+}
@@ -0,0 +1,166 @@
+/**
+ * Image kernel benchmark. Times every kernel on a QVGA frame with the
+ * instruction set picked at compile time and prints a checksum of their
+ * results, which must match between builds. Compare with the portable
+ * kernels by building them separately:
+ *
+ *   make BUILD=build-scalar CPPFLAGS=-DHVC_KERNEL_SCALAR
+ *
+ *   bench_kernels [-n rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_kernels.h"
+#include "hvc_test.h"
+
+#define BENCH_WIDTH  320
+#define BENCH_HEIGHT 240
+#define BENCH_PIXELS (BENCH_WIDTH * BENCH_HEIGHT)
+
+static uint8_t bench_image[BENCH_PIXELS];
+static uint8_t bench_previous[BENCH_PIXELS];
+static uint8_t bench_output[BENCH_PIXELS];
+
+static uint64_t bench_checksum;
+
+static void bench_mix(uint64_t value)
+{
+  bench_checksum = bench_checksum * 31 + value;
+}
+
+static void bench_mix_bytes(const uint8_t* data, int length)
+{
+  for (int i = 0; i < length; i++) bench_mix(data[i]);
+}
+
+static void bench_report(const char* kernel, int64_t start, int rounds)
+{
+  printf("%-10s %8.2f us\n", kernel, (double) (hvc_test_now_us() - start) / rounds);
+}
+
+/*
+ * Results of every kernel, including odd lengths and unaligned starts
+ * that take the tail paths of the vector kernels
+ */
+static void bench_verify(void)
+{
+  static const struct hvc_detection boxes[] = {
+    { 800, 600, 400, 900 },
+    { 10, 10, 400, 900 },
+    { 1590, 1190, 123, 900 },
+  };
+  uint32_t histogram[256];
+  struct hvc_motion motion;
+
+  for (int offset = 0; offset < 3; offset++)
+  {
+    int length = BENCH_PIXELS - offset * 7;
+
+    hvc_kernel_histogram(bench_image + offset, length, histogram);
+
+    for (int i = 0; i < 256; i++) bench_mix(histogram[i]);
+
+    bench_mix(hvc_kernel_sum(bench_image + offset, length));
+    bench_mix((uint64_t) hvc_kernel_mean(bench_image + offset, length));
+
+    hvc_kernel_motion(bench_image + offset, bench_previous, length, 20, &motion);
+    bench_mix(motion.sad);
+    bench_mix(motion.changed);
+  }
+
+  hvc_kernel_downscale(bench_image, BENCH_WIDTH, BENCH_HEIGHT, bench_output);
+  bench_mix_bytes(bench_output, BENCH_PIXELS / 4);
+
+  hvc_kernel_downscale(bench_image, BENCH_WIDTH - 3, BENCH_HEIGHT - 1, bench_output);
+  bench_mix_bytes(bench_output, ((BENCH_WIDTH - 3) / 2) * ((BENCH_HEIGHT - 1) / 2));
+
+  for (int i = 0; i < (int) (sizeof(boxes) / sizeof(boxes[0])); i++)
+  {
+    int width = 0, height = 0;
+    int length = hvc_kernel_crop(bench_image, BENCH_WIDTH, BENCH_HEIGHT, &boxes[i], bench_output, BENCH_PIXELS,
+      &width, &height);
+
+    bench_mix((uint64_t) (length << 16 | width << 8 | height));
+
+    if (length > 0) bench_mix_bytes(bench_output, length);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  static const struct hvc_detection box = { 800, 600, 400, 900 };
+  volatile uint32_t sink = 0;
+  uint32_t histogram[256];
+  struct hvc_motion motion;
+  int rounds = 2000;
+  int width, height;
+  int64_t start;
+  unsigned seed = 1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if (opt != 'n')
+    {
+      fprintf(stderr, "usage: %s [-n rounds]\n", argv[0]);
+      return 2;
+    }
+
+    rounds = atoi(optarg);
+  }
+
+  if (rounds < 1) rounds = 1;
+
+  // A gradient with noise, the previous frame differs in every 8th pixel
+  for (int i = 0; i < BENCH_PIXELS; i++)
+  {
+    bench_image[i] = (uint8_t) (i % BENCH_WIDTH + i / BENCH_WIDTH + rand_r(&seed) % 16);
+    bench_previous[i] = (uint8_t) (bench_image[i] + (rand_r(&seed) % 8 == 0 ? rand_r(&seed) % 64 : 0));
+  }
+
+  printf("%dx%d, %d rounds, %s kernels\n", BENCH_WIDTH, BENCH_HEIGHT, rounds, HVC_KERNEL_ISA);
+
+  start = hvc_test_now_us();
+  for (int r = 0; r < rounds; r++)
+  {
+    hvc_kernel_downscale(bench_image, BENCH_WIDTH, BENCH_HEIGHT, bench_output);
+    sink += bench_output[r % (BENCH_PIXELS / 4)];
+  }
+  bench_report("downscale", start, rounds);
+
+  start = hvc_test_now_us();
+  for (int r = 0; r < rounds; r++)
+  {
+    hvc_kernel_histogram(bench_image, BENCH_PIXELS, histogram);
+    sink += histogram[r & 0xFF];
+  }
+  bench_report("histogram", start, rounds);
+
+  start = hvc_test_now_us();
+  for (int r = 0; r < rounds; r++) sink += hvc_kernel_sum(bench_image + (r & 1), BENCH_PIXELS - 1);
+  bench_report("sum", start, rounds);
+
+  start = hvc_test_now_us();
+  for (int r = 0; r < rounds; r++)
+  {
+    hvc_kernel_motion(bench_image, bench_previous + (r & 1), BENCH_PIXELS - 1, 20, &motion);
+    sink += motion.sad + motion.changed;
+  }
+  bench_report("motion", start, rounds);
+
+  start = hvc_test_now_us();
+  for (int r = 0; r < rounds; r++)
+  {
+    int length = hvc_kernel_crop(bench_image, BENCH_WIDTH, BENCH_HEIGHT, &box, bench_output, BENCH_PIXELS, &width,
+      &height);
+    sink += bench_output[r % length];
+  }
+  bench_report("crop", start, rounds);
+
+  bench_verify();
+
+  printf("checksum %016llx\n", (unsigned long long) bench_checksum);
+
+  return 0;
+}
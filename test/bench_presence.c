@@ -0,0 +1,185 @@
+/**
+ * Presence filter benchmark. Simulates hours of a room at 10 frames per
+ * second: visits of one to three people with missed detections, gaps in
+ * between and stray low confidence detections. Compares how many frames
+ * had detections with how many events the filter raised, and measures
+ * how long the scene took to become occupied after the first detection
+ * of a visit.
+ *
+ *   bench_presence [-H hours] [-x stray detection rate] [-s seed]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "hvc_presence.h"
+#include "hvc_test.h"
+
+struct bench_events
+{
+  long occupied;
+  long vacant;
+  long count;
+};
+
+static unsigned bench_seed = 7;
+
+static double bench_random(void)
+{
+  return rand_r(&bench_seed) / (double) RAND_MAX;
+}
+
+static void bench_event(struct hvc_presence* presence, int event, void* ctx)
+{
+  struct bench_events* events = (struct bench_events*) ctx;
+
+  (void) presence;
+
+  if (event == HVC_PRESENCE_OCCUPIED) events->occupied++;
+  else if (event == HVC_PRESENCE_VACANT) events->vacant++;
+  else events->count++;
+}
+
+static int64_t bench_now_ns(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, char** argv)
+{
+  static struct hvc_presence presence;
+  static struct hvc_execution_response res;
+  struct bench_events events = { 0 };
+  double hours = 4, stray = 0.01;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "H:x:s:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'H': hours = atof(optarg); break;
+      case 'x': stray = atof(optarg); break;
+      case 's': bench_seed = (unsigned) atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-H hours] [-x stray detection rate] [-s seed]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  struct hvc_presence_config config = {
+    .window = 8,
+    .enter = 1000,
+    .leave = 500,
+    .min_confidence = 0,
+    .count_frames = 2,
+  };
+
+  hvc_presence_init(&presence, &config, bench_event, &events);
+
+  long frames = (long) (hours * 36000);
+  long detections = 0, visits = 0, false_occupied = 0;
+  long entries = 0, latency = 0, latency_max = 0;
+  int people = 0, visit_left = 0, gap_left = 300;
+  long first_detection = -1;
+  bool was_occupied = false;
+  int64_t spent = 0;
+
+  for (long frame = 0; frame < frames; frame++)
+  {
+    // Visits last 10 s to 5 min with a 10 s to 5 min gap, people come
+    // and go during a visit now and then
+    if (people == 0)
+    {
+      if (--gap_left <= 0)
+      {
+        people = 1 + (bench_random() < 0.3) + (bench_random() < 0.1);
+        visit_left = 100 + rand_r(&bench_seed) % 3000;
+        first_detection = -1;
+        visits++;
+      }
+    }
+    else if (--visit_left <= 0)
+    {
+      people = 0;
+      gap_left = 50 + rand_r(&bench_seed) % 3000;
+    }
+    else if (bench_random() < 0.002)
+    {
+      people += bench_random() < 0.5 && people > 1 ? -1 : 1;
+    }
+
+    memset(&res, 0, sizeof(res));
+    res.function = HVC_EX_BODY_DETECTION | HVC_EX_FACE_DETECTION;
+
+    for (int i = 0; i < people; i++)
+    {
+      if (bench_random() < 0.85)
+      {
+        res.bodies[res.body_count].confidence = 650 + rand_r(&bench_seed) % 300;
+        res.bodies[res.body_count].size = 100;
+        res.body_count++;
+      }
+
+      if (bench_random() < 0.6)
+      {
+        res.faces[res.face_count].detection.confidence = 600 + rand_r(&bench_seed) % 350;
+        res.face_count++;
+      }
+    }
+
+    if (bench_random() < stray)
+    {
+      res.bodies[res.body_count].confidence = 500 + rand_r(&bench_seed) % 200;
+      res.body_count++;
+    }
+
+    if (res.body_count + res.face_count > 0)
+    {
+      detections++;
+
+      if (people > 0 && first_detection < 0) first_detection = frame;
+    }
+
+    int64_t t = bench_now_ns();
+
+    hvc_presence_update(&presence, &res, (int64_t) frame * 100);
+
+    spent += bench_now_ns() - t;
+
+    if (presence.occupied && !was_occupied)
+    {
+      if (people == 0)
+      {
+        false_occupied++;
+      }
+      else
+      {
+        long l = frame - first_detection;
+
+        entries++;
+        latency += l;
+
+        if (l > latency_max) latency_max = l;
+      }
+    }
+
+    was_occupied = presence.occupied;
+  }
+
+  long raised = events.occupied + events.vacant + events.count;
+
+  printf("%.1f h at 10 fps, stray rate %.3f: %ld visits, %ld frames with detections\n", hours, stray, visits,
+    detections);
+  printf("events %ld (occupied %ld, vacant %ld, count %ld), %.0fx fewer than detection frames\n", raised,
+    events.occupied, events.vacant, events.count, raised ? (double) detections / raised : 0.0);
+  printf("entry latency from first detection %.2f frames average, %ld worst, %ld false occupied\n",
+    entries ? (double) latency / entries : 0.0, latency_max, false_occupied);
+  printf("%.1f ns per update\n", (double) spent / frames);
+
+  return 0;
+}
@@ -0,0 +1,159 @@
+/**
+ * Protocol benchmark against the simulated sensor. Reports commands per
+ * second and p50/p99 latency for every getter, setter and a range of
+ * execution flag sets.
+ *
+ *   bench_protocol [-n iterations] [-b baudrate] [-c compute_ms] [-f faults]
+ *
+ * -b emulates the wire time of the given rate (negotiated first), -c sets
+ * the simulated detection time and -f injects faults into that many per
+ * mille responses.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_test.h"
+
+#define BENCH_MAX_ITERATIONS 100000
+
+enum
+{
+  BENCH_GET_VERSION,
+  BENCH_GET_CAMERA_ANGLE,
+  BENCH_SET_CAMERA_ANGLE,
+  BENCH_GET_THRESHOLDS,
+  BENCH_SET_THRESHOLDS,
+  BENCH_GET_DETECTION_SIZE,
+  BENCH_SET_DETECTION_SIZE,
+  BENCH_GET_FACE_ANGLE,
+  BENCH_SET_FACE_ANGLE,
+  BENCH_EXECUTE
+};
+
+struct bench_case
+{
+  const char* name;
+  int kind;
+  int function;
+  int image;
+};
+
+static const struct bench_case bench_cases[] = {
+  { "get_version", BENCH_GET_VERSION, 0, 0 },
+  { "get_camera_angle", BENCH_GET_CAMERA_ANGLE, 0, 0 },
+  { "set_camera_angle", BENCH_SET_CAMERA_ANGLE, 0, 0 },
+  { "get_thresholds", BENCH_GET_THRESHOLDS, 0, 0 },
+  { "set_thresholds", BENCH_SET_THRESHOLDS, 0, 0 },
+  { "get_detection_size", BENCH_GET_DETECTION_SIZE, 0, 0 },
+  { "set_detection_size", BENCH_SET_DETECTION_SIZE, 0, 0 },
+  { "get_face_angle", BENCH_GET_FACE_ANGLE, 0, 0 },
+  { "set_face_angle", BENCH_SET_FACE_ANGLE, 0, 0 },
+  { "execute body", BENCH_EXECUTE, HVC_EX_BODY_DETECTION, HVC_EX_IMAGE_NONE },
+  { "execute body+hand+face", BENCH_EXECUTE, 0x007, HVC_EX_IMAGE_NONE },
+  { "execute face+estimations", BENCH_EXECUTE, 0x1FC, HVC_EX_IMAGE_NONE },
+  { "execute all", BENCH_EXECUTE, 0x3FF, HVC_EX_IMAGE_NONE },
+  { "execute all+qvga_half", BENCH_EXECUTE, 0x3FF, HVC_EX_IMAGE_QVGA_HALF },
+  { "execute all+qvga", BENCH_EXECUTE, 0x3FF, HVC_EX_IMAGE_QVGA }
+};
+
+static int bench_run(struct hvc_device* dev, const struct bench_case* c, int i)
+{
+  static struct hvc_execution_response execution;
+  struct hvc_get_version_response version;
+  struct hvc_get_camera_angle_response angle;
+  struct hvc_get_threshold_values_response thresholds;
+  struct hvc_get_detection_size_response size;
+  struct hvc_get_face_angle_response face_angle;
+
+  switch (c->kind)
+  {
+    case BENCH_GET_VERSION: return hvc_get_version_r(dev, &version);
+    case BENCH_GET_CAMERA_ANGLE: return hvc_get_camera_angle_r(dev, &angle);
+    case BENCH_SET_CAMERA_ANGLE: return hvc_set_camera_angle(dev, i & 3) ? HVC_OK : HVC_ERR_RESPONSE;
+    case BENCH_GET_THRESHOLDS: return hvc_get_threshold_values_r(dev, &thresholds);
+    case BENCH_SET_THRESHOLDS: return hvc_set_threshold_values(dev, 500 + i % 100, 500, 500, 500) ? HVC_OK : HVC_ERR_RESPONSE;
+    case BENCH_GET_DETECTION_SIZE: return hvc_get_detection_size_r(dev, &size);
+    case BENCH_SET_DETECTION_SIZE: return hvc_set_detection_size(dev, 30 + i % 10, 8192, 40, 8192, 64, 8192) ? HVC_OK : HVC_ERR_RESPONSE;
+    case BENCH_GET_FACE_ANGLE: return hvc_get_face_angle_r(dev, &face_angle);
+    case BENCH_SET_FACE_ANGLE: return hvc_set_face_angle(dev, HVC_YAW_ANGLE_30, HVC_ROLL_ANGLE_15) ? HVC_OK : HVC_ERR_RESPONSE;
+    default: return hvc_execution_r(dev, c->function, c->image, &execution);
+  }
+}
+
+int main(int argc, char** argv)
+{
+  struct hvc_sim_config config;
+  int iterations = 200;
+  int baudrate = 0;
+  int opt;
+
+  hvc_sim_default_config(&config);
+  config.bodies = 35;
+  config.hands = 35;
+  config.faces = 35;
+  config.compute_delay_ms = 0;
+
+  while ((opt = getopt(argc, argv, "n:b:c:f:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': iterations = atoi(optarg); break;
+      case 'b': baudrate = atoi(optarg); break;
+      case 'c': config.compute_delay_ms = atoi(optarg); break;
+      case 'f':
+        config.fault_rate = atoi(optarg);
+        config.fault_mask = HVC_SIM_FAULT_NOISE | HVC_SIM_FAULT_SYNC | HVC_SIM_FAULT_RESPONSE | HVC_SIM_FAULT_TRUNCATE;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-n iterations] [-b baudrate] [-c compute_ms] [-f faults]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (iterations < 1 || iterations > BENCH_MAX_ITERATIONS)
+  {
+    fprintf(stderr, "iterations must be 1-%d\n", BENCH_MAX_ITERATIONS);
+    return 2;
+  }
+
+  static struct hvc_test_link link;
+  static double latency[BENCH_MAX_ITERATIONS];
+
+  config.emulate_baudrate = baudrate > 0;
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+  hvc_test_link_start(&link, &config);
+
+  if (baudrate > 0 && hvc_negotiate_baudrate(&link.dev, baudrate) != baudrate)
+  {
+    fprintf(stderr, "Unable to run the link at %d baud\n", baudrate);
+    return 1;
+  }
+
+  printf("%d iterations, %s, %d ms compute, 35 bodies/hands/faces\n\n", iterations,
+    baudrate > 0 ? "emulated baudrate" : "unthrottled link", config.compute_delay_ms);
+  printf("%-26s %8s %10s %10s %10s\n", "command", "errors", "cmds/s", "p50 ms", "p99 ms");
+
+  for (int c = 0; c < (int) (sizeof(bench_cases) / sizeof(bench_cases[0])); c++)
+  {
+    int errors = 0;
+    int64_t start = hvc_test_now_us();
+
+    for (int i = 0; i < iterations; i++)
+    {
+      int64_t t = hvc_test_now_us();
+
+      if (bench_run(&link.dev, &bench_cases[c], i) != HVC_OK) errors++;
+
+      latency[i] = (hvc_test_now_us() - t) / 1000.0;
+    }
+
+    double elapsed = (hvc_test_now_us() - start) / 1e6;
+
+    printf("%-26s %8d %10.0f %10.3f %10.3f\n", bench_cases[c].name, errors, iterations / elapsed,
+      hvc_test_percentile(latency, iterations, 50), hvc_test_percentile(latency, iterations, 99));
+  }
+
+  hvc_test_link_stop(&link);
+  return 0;
+}
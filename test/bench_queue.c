@@ -0,0 +1,178 @@
+/**
+ * Command queue benchmark. Runs back to back executions against the
+ * simulator at 921600 baud with a realistic detection time, and spends a
+ * fixed time dispatching every frame. Serial waits for the dispatch
+ * before it sends the next execution, pipelined keeps one execution
+ * queued behind the one in flight so dispatch overlaps detection.
+ *
+ *   bench_queue [-n frames] [-c compute ms -d dispatch ms]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_queue.h"
+#include "hvc_test.h"
+
+#define BENCH_FUNCTION (HVC_EX_BODY_DETECTION | HVC_EX_FACE_DETECTION | HVC_EX_AGE_ESTIMATION)
+
+struct bench_case
+{
+  int compute_ms;
+  int dispatch_ms;
+};
+
+static const struct bench_case bench_cases[] = {
+  { 100, 30 },
+  { 300, 50 },
+  { 50, 40 },
+};
+
+struct bench_run
+{
+  bool pipelined;
+  int dispatch_ms;
+  int target;
+
+  int frames;
+  int errors;
+  int queued;
+  int64_t first;
+};
+
+/*
+ * Stand-in for decoding and running the event handlers, keeps the host
+ * busy like they would
+ */
+static void bench_dispatch(int ms)
+{
+  int64_t end = hvc_test_now_us() + ms * 1000;
+
+  while (hvc_test_now_us() < end)
+  {
+  }
+}
+
+static void bench_done(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx)
+{
+  static struct hvc_execution_response res;
+  struct bench_run* run = (struct bench_run*) ctx;
+
+  run->queued--;
+
+  if (status == HVC_OK &&
+    hvc_parse_execution(queue->payload, queue->payload_length, request->function, &res) == HVC_OK)
+  {
+    run->frames++;
+  }
+  else
+  {
+    run->errors++;
+  }
+
+  // The clock starts at the first frame, the rate is the steady state one
+  if (run->frames == 1) run->first = hvc_test_now_us();
+
+  if (!run->pipelined) bench_dispatch(run->dispatch_ms);
+
+  int depth = run->pipelined ? 2 : 1;
+
+  while (run->frames + run->queued <= run->target && run->queued < depth)
+  {
+    if (hvc_queue_execute(queue, BENCH_FUNCTION, HVC_EX_IMAGE_NONE, 0, bench_done, run) < 0) break;
+
+    run->queued++;
+  }
+
+  if (run->pipelined) bench_dispatch(run->dispatch_ms);
+}
+
+static double bench_fps(const struct bench_case* c, bool pipelined, int frames, int* errors)
+{
+  static struct hvc_test_link link;
+  static struct hvc_queue queue;
+  struct hvc_sim_config config;
+  struct bench_run run = { .pipelined = pipelined, .dispatch_ms = c->dispatch_ms, .target = frames };
+
+  hvc_sim_default_config(&config);
+  config.bodies = 3;
+  config.faces = 3;
+  config.compute_delay_ms = c->compute_ms;
+  config.byte_delay_us = 11;
+
+  hvc_test_link_start(&link, &config);
+  hvc_queue_init(&queue, &link.dev);
+
+  if (hvc_queue_execute(&queue, BENCH_FUNCTION, HVC_EX_IMAGE_NONE, 0, bench_done, &run) > 0) run.queued++;
+
+  int64_t last = hvc_test_now_us();
+
+  while (run.frames <= frames && run.queued > 0)
+  {
+    hvc_wait_bytes_available(&link.dev, 1, 5);
+    hvc_queue_poll(&queue);
+
+    int64_t now = hvc_test_now_us();
+    int elapsed = (int) ((now - last) / 1000);
+
+    if (elapsed > 0)
+    {
+      hvc_queue_tick(&queue, elapsed);
+      last += elapsed * 1000;
+    }
+  }
+
+  double fps = run.frames > 1 ? (run.frames - 1) / ((hvc_test_now_us() - run.first) / 1e6) : 0;
+
+  hvc_test_link_stop(&link);
+  *errors = run.errors;
+
+  return fps;
+}
+
+int main(int argc, char** argv)
+{
+  struct bench_case custom = { 0, 0 };
+  int frames = 20;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:c:d:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': frames = atoi(optarg); break;
+      case 'c': custom.compute_ms = atoi(optarg); break;
+      case 'd': custom.dispatch_ms = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n frames] [-c compute ms -d dispatch ms]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (frames < 2) frames = 2;
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+
+  const struct bench_case* cases = bench_cases;
+  int count = sizeof(bench_cases) / sizeof(bench_cases[0]);
+
+  if (custom.compute_ms > 0)
+  {
+    cases = &custom;
+    count = 1;
+  }
+
+  printf("%d frames at 921600 baud, 3 bodies and faces\n\n", frames);
+  printf("%10s %11s %10s %10s %8s\n", "compute ms", "dispatch ms", "serial", "pipelined", "errors");
+
+  for (int i = 0; i < count; i++)
+  {
+    int serial_errors, pipelined_errors;
+    double serial = bench_fps(&cases[i], false, frames, &serial_errors);
+    double pipelined = bench_fps(&cases[i], true, frames, &pipelined_errors);
+
+    printf("%10d %11d %10.1f %10.1f %8d\n", cases[i].compute_ms, cases[i].dispatch_ms, serial, pipelined,
+      serial_errors + pipelined_errors);
+  }
+
+  return 0;
+}
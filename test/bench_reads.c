@@ -0,0 +1,165 @@
+/**
+ * Transport call benchmark. Counts the transport calls every command
+ * makes and measures the host CPU time it takes, the simulator thread
+ * excluded. On the device every read is a uart_read_bytes round trip.
+ *
+ *   bench_reads [-n iterations]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include "hvc_test.h"
+
+/*
+ * Transport that counts the calls into the POSIX one
+ */
+struct bench_counter
+{
+  struct hvc_transport inner;
+  long reads;
+  long waits;
+  long available;
+};
+
+static struct bench_counter bench_counter;
+
+static int bench_read(void* ctx, char* data, int length, int timeout_ms)
+{
+  bench_counter.reads++;
+  return bench_counter.inner.read(ctx, data, length, timeout_ms);
+}
+
+static int bench_wait(void* ctx, int length, int timeout_ms)
+{
+  bench_counter.waits++;
+  return bench_counter.inner.wait(ctx, length, timeout_ms);
+}
+
+static int bench_available(void* ctx)
+{
+  bench_counter.available++;
+  return bench_counter.inner.available(ctx);
+}
+
+static double bench_cpu_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+
+  return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+enum
+{
+  BENCH_EXECUTE,
+  BENCH_GET_VERSION,
+  BENCH_GET_THRESHOLDS,
+  BENCH_GET_DETECTION_SIZE
+};
+
+struct bench_case
+{
+  const char* name;
+  int kind;
+  int function;
+  int image;
+};
+
+static const struct bench_case bench_cases[] = {
+  { "execute body", BENCH_EXECUTE, HVC_EX_BODY_DETECTION, HVC_EX_IMAGE_NONE },
+  { "execute all", BENCH_EXECUTE, 0x3FF, HVC_EX_IMAGE_NONE },
+  { "execute all+qvga_half", BENCH_EXECUTE, 0x3FF, HVC_EX_IMAGE_QVGA_HALF },
+  { "get_version", BENCH_GET_VERSION, 0, 0 },
+  { "get_thresholds", BENCH_GET_THRESHOLDS, 0, 0 },
+  { "get_detection_size", BENCH_GET_DETECTION_SIZE, 0, 0 }
+};
+
+int main(int argc, char** argv)
+{
+  static struct hvc_sim sim;
+  static struct hvc_posix port;
+  static struct hvc_device dev;
+  static struct hvc_execution_response execution;
+  struct hvc_get_version_response version;
+  struct hvc_get_threshold_values_response thresholds;
+  struct hvc_get_detection_size_response size;
+  struct hvc_sim_config config;
+  struct hvc_transport transport;
+  int iterations = 1000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if (opt != 'n')
+    {
+      fprintf(stderr, "usage: %s [-n iterations]\n", argv[0]);
+      return 2;
+    }
+
+    iterations = atoi(optarg);
+  }
+
+  if (iterations < 1) iterations = 1;
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+  hvc_sim_default_config(&config);
+  config.bodies = 35;
+  config.hands = 35;
+  config.faces = 35;
+  config.compute_delay_ms = 0;
+
+  int fd = hvc_sim_start(&sim, &config);
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "Unable to start the simulator\n");
+    return 2;
+  }
+
+  hvc_posix_init(&port, fd, &bench_counter.inner);
+
+  transport = bench_counter.inner;
+  transport.read = bench_read;
+  transport.wait = bench_wait;
+  transport.available = bench_available;
+  hvc_device_init(&dev, &transport);
+
+  printf("%d iterations, 35 bodies/hands/faces, per command:\n\n", iterations);
+  printf("%-24s %8s %8s %10s %8s %10s\n", "command", "errors", "reads", "available", "waits", "cpu us");
+
+  for (int c = 0; c < (int) (sizeof(bench_cases) / sizeof(bench_cases[0])); c++)
+  {
+    const struct bench_case* b = &bench_cases[c];
+    int errors = 0;
+
+    bench_counter.reads = 0;
+    bench_counter.waits = 0;
+    bench_counter.available = 0;
+
+    double start = bench_cpu_us();
+
+    for (int i = 0; i < iterations; i++)
+    {
+      int status;
+
+      switch (b->kind)
+      {
+        case BENCH_GET_VERSION: status = hvc_get_version_r(&dev, &version); break;
+        case BENCH_GET_THRESHOLDS: status = hvc_get_threshold_values_r(&dev, &thresholds); break;
+        case BENCH_GET_DETECTION_SIZE: status = hvc_get_detection_size_r(&dev, &size); break;
+        default: status = hvc_execution_r(&dev, b->function, b->image, &execution); break;
+      }
+
+      if (status != HVC_OK) errors++;
+    }
+
+    double cpu = (bench_cpu_us() - start) / iterations;
+
+    printf("%-24s %8d %8.2f %10.2f %8.2f %10.2f\n", b->name, errors, (double) bench_counter.reads / iterations,
+      (double) bench_counter.available / iterations, (double) bench_counter.waits / iterations, cpu);
+  }
+
+  hvc_sim_stop(&sim);
+  return 0;
+}
@@ -0,0 +1,229 @@
+/**
+ * Record and replay benchmark. Records executions against the simulator
+ * with every fault enabled, then replays the recording at maximum,
+ * original and scaled speed. Every replayed execution must end with the
+ * status and detections it had live. Finishes with the parser throughput
+ * of repeated replays at maximum speed.
+ *
+ *   bench_replay [-n executions] [-r fault rate per mille] [-s speed %]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_record.h"
+#include "hvc_replay.h"
+#include "hvc_test.h"
+
+#define BENCH_FUNCTION 0x3FF
+
+/*
+ * Status and a hash of the detections of one execution
+ */
+struct bench_result
+{
+  int status;
+  uint32_t hash;
+};
+
+static uint32_t bench_hash_detection(uint32_t hash, const struct hvc_detection* detection)
+{
+  hash = hash * 31 + (uint16_t) detection->x;
+  hash = hash * 31 + (uint16_t) detection->y;
+  hash = hash * 31 + (uint16_t) detection->size;
+
+  return hash * 31 + (uint16_t) detection->confidence;
+}
+
+static uint32_t bench_hash(const struct hvc_execution_response* res)
+{
+  uint32_t hash = res->body_count << 16 | res->hand_count << 8 | res->face_count;
+
+  for (int i = 0; i < res->body_count; i++) hash = bench_hash_detection(hash, &res->bodies[i]);
+  for (int i = 0; i < res->hand_count; i++) hash = bench_hash_detection(hash, &res->hands[i]);
+
+  for (int i = 0; i < res->face_count; i++)
+  {
+    const struct hvc_face* face = &res->faces[i];
+
+    hash = bench_hash_detection(hash, &face->detection);
+    hash = hash * 31 + (uint16_t) face->age.age;
+    hash = hash * 31 + (uint16_t) face->recognition.user_id;
+  }
+
+  return hash;
+}
+
+/*
+ * The same executions every run, a QVGA_HALF image every 25th
+ */
+static void bench_run(struct hvc_device* dev, struct bench_result* results, int executions)
+{
+  static struct hvc_execution_response res;
+
+  for (int i = 0; i < executions; i++)
+  {
+    int image = i % 25 == 0 ? HVC_EX_IMAGE_QVGA_HALF : HVC_EX_IMAGE_NONE;
+
+    results[i].status = hvc_execution_r(dev, BENCH_FUNCTION, image, &res);
+    results[i].hash = results[i].status == HVC_OK ? bench_hash(&res) : 0;
+  }
+}
+
+/*
+ * Replay the recording once, returns the executions that differ from the
+ * live run
+ */
+static int bench_replay(const char* path, int speed, const struct bench_result* live, struct bench_result* results,
+  int executions, int64_t* elapsed)
+{
+  static struct hvc_replay replay;
+  static struct hvc_device dev;
+  struct hvc_transport transport;
+  int differ = 0;
+
+  if (hvc_replay_open(&replay, path, speed, &transport) != HVC_OK)
+  {
+    fprintf(stderr, "Unable to open the recording\n");
+    exit(2);
+  }
+
+  hvc_device_init(&dev, &transport);
+  hvc_set_retry(&dev, 0);
+
+  int64_t start = hvc_test_now_us();
+
+  bench_run(&dev, results, executions);
+
+  *elapsed = hvc_test_now_us() - start;
+
+  for (int i = 0; i < executions; i++)
+  {
+    if (results[i].status != live[i].status || results[i].hash != live[i].hash) differ++;
+  }
+
+  if (!hvc_replay_done(&replay) || replay.mismatches) differ++;
+
+  hvc_replay_close(&replay);
+
+  return differ;
+}
+
+int main(int argc, char** argv)
+{
+  static struct hvc_test_link link;
+  static struct hvc_recorder recorder;
+  char path[] = "/tmp/hvc_replay_XXXXXX";
+  struct hvc_sim_config config;
+  struct hvc_transport transport;
+  int executions = 200;
+  int fault_rate = 30;
+  int scaled = 400;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:s:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': executions = atoi(optarg); break;
+      case 'r': fault_rate = atoi(optarg); break;
+      case 's': scaled = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n executions] [-r fault rate] [-s speed %%]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  if (executions < 1) executions = 1;
+
+  int fd = mkstemp(path);
+
+  if (fd < 0)
+  {
+    perror("mkstemp");
+    return 2;
+  }
+
+  close(fd);
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+
+  struct bench_result* live = calloc(executions, sizeof(struct bench_result));
+  struct bench_result* results = calloc(executions, sizeof(struct bench_result));
+
+  // Live run through the recorder
+  hvc_sim_default_config(&config);
+  config.bodies = 20;
+  config.faces = 10;
+  config.compute_delay_ms = 5;
+  config.fault_rate = fault_rate;
+  config.fault_mask = HVC_SIM_FAULT_NOISE | HVC_SIM_FAULT_SYNC | HVC_SIM_FAULT_RESPONSE | HVC_SIM_FAULT_TRUNCATE |
+    HVC_SIM_FAULT_SILENT;
+
+  hvc_test_link_start(&link, &config);
+
+  if (hvc_recorder_open(&recorder, path, 0, &link.dev.transport, &transport) != HVC_OK)
+  {
+    fprintf(stderr, "Unable to record to %s\n", path);
+    return 2;
+  }
+
+  hvc_device_init(&link.dev, &transport);
+
+  // Faults cost a timeout, don't retry on top of it
+  hvc_set_retry(&link.dev, 0);
+
+  int64_t start = hvc_test_now_us();
+
+  bench_run(&link.dev, live, executions);
+
+  int64_t recorded = hvc_test_now_us() - start;
+  int ok = 0;
+
+  hvc_recorder_close(&recorder);
+  hvc_test_link_stop(&link);
+
+  for (int i = 0; i < executions; i++) ok += live[i].status == HVC_OK;
+
+  printf("recorded %d executions, %d ok, %d faults, %u records, %u bytes in %.2f s\n\n", executions, ok,
+    link.sim.faults, recorder.records, recorder.bytes, recorded / 1e6);
+
+  // Replays must decode exactly what the live run did
+  const int speeds[] = { HVC_REPLAY_MAX_SPEED, HVC_REPLAY_ORIGINAL_SPEED, scaled };
+  int failures = 0;
+
+  printf("%-10s %10s %10s\n", "speed", "seconds", "differ");
+
+  for (int s = 0; s < (int) (sizeof(speeds) / sizeof(speeds[0])); s++)
+  {
+    int64_t elapsed;
+    int differ = bench_replay(path, speeds[s], live, results, executions, &elapsed);
+    char name[16];
+
+    if (speeds[s] == HVC_REPLAY_MAX_SPEED) snprintf(name, sizeof(name), "max");
+    else snprintf(name, sizeof(name), "%d%%", speeds[s]);
+
+    printf("%-10s %10.2f %10d\n", name, elapsed / 1e6, differ);
+
+    failures += differ;
+  }
+
+  // Parser throughput, the replay transport costs next to nothing
+  int64_t total = 0;
+  int rounds = 20;
+
+  for (int r = 0; r < rounds; r++)
+  {
+    int64_t elapsed;
+
+    failures += bench_replay(path, HVC_REPLAY_MAX_SPEED, live, results, executions, &elapsed);
+    total += elapsed;
+  }
+
+  printf("\nmax speed: %.2f us per execution, %.1f MB/s\n", (double) total / rounds / executions,
+    (double) recorder.bytes * rounds / total);
+
+  unlink(path);
+  free(live);
+  free(results);
+
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,84 @@
+/**
+ * Helpers shared by the host tests and benchmarks.
+ */
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hvc_test.h"
+
+static int hvc_test_failures = 0;
+
+void hvc_test_check(int ok, const char* expression, const char* file, int line)
+{
+  if (ok) return;
+
+  fprintf(stderr, "%s:%d: check failed: %s\n", file, line, expression);
+  hvc_test_failures++;
+}
+
+int hvc_test_result(const char* name)
+{
+  if (hvc_test_failures)
+  {
+    printf("%s: FAIL (%d checks)\n", name, hvc_test_failures);
+    return 1;
+  }
+
+  printf("%s: PASS\n", name);
+  return 0;
+}
+
+int64_t hvc_test_now_us(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int _hvc_test_compare(const void* a, const void* b)
+{
+  double x = *(const double*) a;
+  double y = *(const double*) b;
+
+  return x < y ? -1 : x > y;
+}
+
+double hvc_test_percentile(double* values, int count, double percentile)
+{
+  if (count <= 0) return 0;
+
+  qsort(values, count, sizeof(double), _hvc_test_compare);
+
+  int rank = (int) (percentile / 100 * count + 0.5);
+
+  if (rank < 1) rank = 1;
+  if (rank > count) rank = count;
+
+  return values[rank - 1];
+}
+
+void hvc_test_link_start(struct hvc_test_link* link, const struct hvc_sim_config* config)
+{
+  struct hvc_transport transport;
+
+  // A simulator that stopped answering must not kill the process
+  signal(SIGPIPE, SIG_IGN);
+
+  int fd = hvc_sim_start(&link->sim, config);
+
+  if (fd < 0)
+  {
+    fprintf(stderr, "Unable to start the simulator\n");
+    exit(2);
+  }
+
+  hvc_posix_init(&link->port, fd, &transport);
+  hvc_device_init(&link->dev, &transport);
+}
+
+void hvc_test_link_stop(struct hvc_test_link* link)
+{
+  hvc_sim_stop(&link->sim);
+}
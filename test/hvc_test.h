@@ -0,0 +1,59 @@
+#ifndef HVC_TEST_H
+#define HVC_TEST_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#include <stdint.h>
+#include "hvc.h"
+#include "hvc_posix.h"
+#include "hvc_sim.h"
+
+/*
+ * Shared helpers of the host tests and benchmarks. Tests exit non-zero
+ * when a check failed, benchmarks print their numbers and exit zero.
+ */
+
+/*
+ * Record a failed check with its location and carry on
+ */
+#define HVC_TEST_CHECK(cond) hvc_test_check((cond), #cond, __FILE__, __LINE__)
+
+/*
+ * A simulated sensor with the POSIX transport and a device on top
+ */
+struct hvc_test_link
+{
+  struct hvc_sim sim;
+  struct hvc_posix port;
+  struct hvc_device dev;
+};
+
+void hvc_test_check(int ok, const char* expression, const char* file, int line);
+
+/*
+ * Exit status of a test, prints the verdict
+ */
+int hvc_test_result(const char* name);
+
+int64_t hvc_test_now_us(void);
+
+/*
+ * Nearest rank percentile (0-100) of count values, sorts them in place
+ */
+double hvc_test_percentile(double* values, int count, double percentile);
+
+/*
+ * Start the simulator and attach a device to it. Aborts the program if
+ * the simulator can't be started.
+ */
+void hvc_test_link_start(struct hvc_test_link* link, const struct hvc_sim_config* config);
+
+void hvc_test_link_stop(struct hvc_test_link* link);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+#endif
@@ -0,0 +1,195 @@
+/**
+ * Heap allocation test. Runs the steady state detection loop of the
+ * Mongoose OS wrapper, blocking and pipelined through the command queue,
+ * and checks it never touches the heap. malloc and friends are wrapped
+ * at link time (see the Makefile), only calls from this thread count.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "hvc_frames.h"
+#include "hvc_image.h"
+#include "hvc_presence.h"
+#include "hvc_queue.h"
+#include "hvc_scheduler.h"
+#include "hvc_test.h"
+#include "hvc_tracker.h"
+
+#define TEST_FRAMES 500
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* ptr, size_t size);
+
+static __thread int test_counting = 0;
+static __thread int test_allocations = 0;
+
+void* __wrap_malloc(size_t size)
+{
+  if (test_counting) test_allocations++;
+
+  return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+  if (test_counting) test_allocations++;
+
+  return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* ptr, size_t size)
+{
+  if (test_counting) test_allocations++;
+
+  return __real_realloc(ptr, size);
+}
+
+/*
+ * Everything the detection loop feeds, as set up by mgos_hvc.c
+ */
+struct test_pipeline
+{
+  struct hvc_scheduler scheduler;
+  struct hvc_frame_slot slots[8];
+  struct hvc_frame_ring frames;
+  struct hvc_frame_reader reader;
+  struct hvc_frame frame;
+  struct hvc_tracker body_tracker;
+  struct hvc_tracker face_tracker;
+  struct hvc_presence presence;
+  struct hvc_execution_response res;
+  int64_t time_ms;
+};
+
+static void test_pipeline_init(struct test_pipeline* p)
+{
+  struct hvc_scheduler_config scheduler = {
+    .idle_interval = 1000,
+    .active_interval = 0,
+    .idle_after = 5,
+    .idle_function = HVC_EX_BODY_DETECTION,
+    .active_function = 0x3FF,
+    .duty_cycle = 100
+  };
+  struct hvc_tracker_config tracker = { .kind = HVC_TRACK_BODIES, .min_overlap = 64, .confirm_frames = 2, .leave_frames = 5 };
+  struct hvc_presence_config presence = { .window = 8, .enter = 1000, .leave = 500, .count_frames = 2 };
+
+  hvc_scheduler_init(&p->scheduler, &scheduler);
+  hvc_frame_ring_init(&p->frames, p->slots, 8);
+  hvc_frame_reader_init(&p->reader, &p->frames);
+  hvc_tracker_init(&p->body_tracker, &tracker, NULL, NULL);
+
+  tracker.kind = HVC_TRACK_FACES;
+  hvc_tracker_init(&p->face_tracker, &tracker, NULL, NULL);
+  hvc_presence_init(&p->presence, &presence, NULL, NULL);
+}
+
+static void test_pipeline_dispatch(struct test_pipeline* p, int status, int latency)
+{
+  hvc_scheduler_update(&p->scheduler, status == HVC_OK ? &p->res : NULL, latency);
+
+  if (status != HVC_OK) return;
+
+  p->time_ms += 100;
+  hvc_frame_ring_publish(&p->frames, p->time_ms, &p->res);
+  hvc_tracker_update(&p->body_tracker, &p->res, p->time_ms);
+  hvc_tracker_update(&p->face_tracker, &p->res, p->time_ms);
+  hvc_presence_update(&p->presence, &p->res, p->time_ms);
+
+  while (hvc_frame_reader_read(&p->reader, &p->frame));
+}
+
+static int test_blocking(struct hvc_device* dev, struct test_pipeline* p, struct hvc_image_ring* ring)
+{
+  static char image[HVC_SIM_QVGA_WIDTH * HVC_SIM_QVGA_HEIGHT];
+  int ok = 0;
+
+  for (int i = 0; i < TEST_FRAMES; i++)
+  {
+    int image_flags = i % 10 == 0 ? HVC_EX_IMAGE_QVGA_HALF : HVC_EX_IMAGE_NONE;
+    int status = hvc_execution_r(dev, hvc_scheduler_function(&p->scheduler), image_flags, &p->res);
+
+    test_pipeline_dispatch(p, status, 20);
+
+    while (hvc_image_ring_read(ring, image, sizeof(image)) > 0);
+
+    if (status == HVC_OK) ok++;
+  }
+
+  return ok;
+}
+
+static void test_queue_done(struct hvc_queue* queue, const struct hvc_queue_request* request, int status, void* ctx)
+{
+  struct test_pipeline* p = (struct test_pipeline*) ctx;
+
+  if (status == HVC_OK) status = hvc_parse_execution(queue->payload, queue->payload_length, request->function, &p->res);
+
+  test_pipeline_dispatch(p, status, request->latency_ms);
+}
+
+static int test_pipelined(struct hvc_queue* queue, struct test_pipeline* p)
+{
+  int submitted = 0;
+
+  while (queue->completed + queue->timeouts + queue->cancelled < TEST_FRAMES)
+  {
+    // Keep two executions queued, like hvc.pipeline does
+    while (submitted < TEST_FRAMES && hvc_queue_pending(queue) < 2)
+    {
+      if (hvc_queue_execute(queue, hvc_scheduler_function(&p->scheduler), HVC_EX_IMAGE_NONE, 0, test_queue_done, p) > 0) submitted++;
+    }
+
+    hvc_wait_bytes_available(queue->async.dev, 1, 10);
+    hvc_queue_poll(queue);
+    hvc_queue_tick(queue, 1);
+  }
+
+  return queue->completed;
+}
+
+int main(void)
+{
+  static struct hvc_test_link link;
+  static struct test_pipeline pipeline;
+  static struct hvc_queue queue;
+  static char ring_buffer[32768];
+  struct hvc_image_ring ring;
+  struct hvc_image_sink sink;
+  struct hvc_sim_config config;
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+  hvc_sim_default_config(&config);
+  config.bodies = 3;
+  config.faces = 2;
+  config.compute_delay_ms = 0;
+
+  hvc_test_link_start(&link, &config);
+  hvc_image_ring_sink_init(&sink, &ring, ring_buffer, sizeof(ring_buffer));
+  hvc_set_image_sink(&link.dev, &sink);
+  test_pipeline_init(&pipeline);
+  hvc_queue_init(&queue, &link.dev);
+
+  // The counter works, the allocating API is seen
+  test_counting = 1;
+  free(hvc_execution(&link.dev, HVC_EX_BODY_DETECTION, HVC_EX_IMAGE_NONE));
+  test_counting = 0;
+
+  HVC_TEST_CHECK(test_allocations == 1);
+
+  test_allocations = 0;
+  test_counting = 1;
+  int blocking = test_blocking(&link.dev, &pipeline, &ring);
+  int pipelined = test_pipelined(&queue, &pipeline);
+  test_counting = 0;
+
+  printf("blocking %d/%d, pipelined %d/%d frames, %d allocations\n", blocking, TEST_FRAMES, pipelined, TEST_FRAMES, test_allocations);
+
+  HVC_TEST_CHECK(blocking == TEST_FRAMES);
+  HVC_TEST_CHECK(pipelined == TEST_FRAMES);
+  HVC_TEST_CHECK(ring.frames == TEST_FRAMES / 10);
+  HVC_TEST_CHECK(test_allocations == 0);
+
+  hvc_test_link_stop(&link);
+  return hvc_test_result("test_alloc");
+}
@@ -0,0 +1,169 @@
+/**
+ * Frame ring stress test. One producer publishes as fast as it can while
+ * readers pace themselves from flat out to stalled. Every frame a reader
+ * gets must be whole and newer than the one before, every frame it
+ * doesn't get must be counted as dropped, and the producer must finish
+ * no matter what the readers do.
+ *
+ *   test_frames [-n frames]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "hvc_frames.h"
+#include "hvc_test.h"
+
+#define TEST_SLOTS   8
+#define TEST_READERS 5
+
+struct test_reader
+{
+  struct hvc_frame_reader reader;
+
+  // Pause after every frame in us, negative stops reading for good
+  // after the first frame
+  int pause_us;
+
+  uint32_t start;
+  long read;
+  long torn;
+  long reordered;
+};
+
+static struct hvc_frame_slot test_slots[TEST_SLOTS];
+static struct hvc_frame_ring test_ring;
+static volatile int test_done = 0;
+
+/*
+ * Every field of a frame derives from its sequence, a frame mixed from
+ * two publications can't pass
+ */
+static void test_fill(struct hvc_execution_response* res, uint32_t sequence)
+{
+  res->body_count = sequence % (HVC_MAX_BODIES + 1);
+  res->bodies[0].x = (int16_t) sequence;
+  res->bodies[HVC_MAX_BODIES - 1].x = (int16_t) (sequence >> 16);
+  res->faces[HVC_MAX_FACES - 1].detection.y = (int16_t) ~sequence;
+}
+
+static bool test_whole(const struct hvc_frame* frame)
+{
+  uint32_t sequence = frame->sequence;
+  const struct hvc_execution_response* res = &frame->res;
+
+  return frame->timestamp == (int64_t) sequence * 3 &&
+    res->body_count == (int) (sequence % (HVC_MAX_BODIES + 1)) &&
+    res->bodies[0].x == (int16_t) sequence &&
+    res->bodies[HVC_MAX_BODIES - 1].x == (int16_t) (sequence >> 16) &&
+    res->faces[HVC_MAX_FACES - 1].detection.y == (int16_t) ~sequence;
+}
+
+static void* test_read(void* arg)
+{
+  struct test_reader* t = (struct test_reader*) arg;
+  static __thread struct hvc_frame frame;
+  bool first = true;
+  uint32_t last = 0;
+
+  while (1)
+  {
+    int done = test_done;
+
+    while (hvc_frame_reader_read(&t->reader, &frame))
+    {
+      t->read++;
+
+      if (!test_whole(&frame)) t->torn++;
+      if (!first && frame.sequence <= last) t->reordered++;
+
+      first = false;
+      last = frame.sequence;
+
+      if (t->pause_us < 0) return NULL;
+      if (t->pause_us > 0) usleep(t->pause_us);
+    }
+
+    // One more pass after the producer finished picks up the rest
+    if (done) return NULL;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  static struct test_reader readers[TEST_READERS] = { { .pause_us = 0 }, { .pause_us = 10 }, { .pause_us = 50 }, { .pause_us = 500 }, { .pause_us = -1 } };
+  static struct hvc_execution_response res;
+  pthread_t threads[TEST_READERS];
+  uint32_t frames = 2000000;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:")) != -1)
+  {
+    if (opt != 'n')
+    {
+      fprintf(stderr, "usage: %s [-n frames]\n", argv[0]);
+      return 2;
+    }
+
+    frames = (uint32_t) atol(optarg);
+  }
+
+  hvc_frame_ring_init(&test_ring, test_slots, TEST_SLOTS);
+
+  for (int i = 0; i < TEST_READERS; i++)
+  {
+    hvc_frame_reader_init(&readers[i].reader, &test_ring);
+    readers[i].start = readers[i].reader.next;
+    pthread_create(&threads[i], NULL, test_read, &readers[i]);
+  }
+
+  int64_t worst = 0;
+  int64_t start = hvc_test_now_us();
+
+  for (uint32_t sequence = 0; sequence < frames; sequence++)
+  {
+    int64_t t = hvc_test_now_us();
+
+    test_fill(&res, sequence);
+    hvc_frame_ring_publish(&test_ring, (int64_t) sequence * 3, &res);
+
+    t = hvc_test_now_us() - t;
+
+    if (t > worst) worst = t;
+  }
+
+  int64_t elapsed = hvc_test_now_us() - start;
+
+  test_done = 1;
+
+  printf("published %u frames, %.3f us average, %lld us worst\n", frames, (double) elapsed / frames, (long long) worst);
+
+  for (int i = 0; i < TEST_READERS; i++)
+  {
+    struct test_reader* t = &readers[i];
+
+    pthread_join(threads[i], NULL);
+
+    // A stalled reader catches up on its next read
+    if (t->pause_us < 0)
+    {
+      static struct hvc_frame frame;
+
+      while (hvc_frame_reader_read(&t->reader, &frame)) t->read++;
+    }
+
+    long accounted = t->read + t->reader.dropped;
+
+    printf("reader pausing %4d us: read %ld, dropped %u, torn %ld, reordered %ld\n", t->pause_us, t->read,
+      t->reader.dropped, t->torn, t->reordered);
+
+    HVC_TEST_CHECK(t->torn == 0);
+    HVC_TEST_CHECK(t->reordered == 0);
+    HVC_TEST_CHECK(accounted == (long) (frames - t->start));
+  }
+
+  // Nothing holds up the producer, the stalled reader included
+  HVC_TEST_CHECK(readers[TEST_READERS - 1].reader.dropped >= frames - TEST_SLOTS - 1);
+
+  return hvc_test_result("test_frames");
+}
@@ -0,0 +1,114 @@
+/**
+ * Several devices driven from their own threads at once. Every device
+ * talks to its own simulated sensor with different detection counts,
+ * settings and faults, nothing may leak from one to another.
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include "hvc_image.h"
+#include "hvc_test.h"
+
+#define TEST_DEVICES 3
+#define TEST_FRAMES  200
+
+struct test_device
+{
+  struct hvc_test_link link;
+  struct hvc_image_ring ring;
+  struct hvc_image_sink sink;
+  char ring_buffer[32768];
+  char image[32768];
+
+  int bodies;
+  int threshold;
+
+  // Results of the thread
+  int executions;
+  int images;
+  int settings;
+};
+
+static void* test_device_run(void* arg)
+{
+  struct test_device* t = (struct test_device*) arg;
+  struct hvc_device* dev = &t->link.dev;
+  struct hvc_execution_response res;
+  struct hvc_get_threshold_values_response thresholds;
+
+  hvc_set_threshold_values(dev, t->threshold, 500, 500, 500);
+
+  for (int i = 0; i < TEST_FRAMES; i++)
+  {
+    int image = i % 10 == 0 ? HVC_EX_IMAGE_QVGA_HALF : HVC_EX_IMAGE_NONE;
+
+    if (hvc_execution_r(dev, 0x3FF, image, &res) == HVC_OK && res.body_count == t->bodies) t->executions++;
+
+    // Only this device's images, each whole
+    int length = hvc_image_ring_read(&t->ring, t->image, sizeof(t->image));
+
+    if (image && length == HVC_IMAGE_HEADER_SIZE + 160 * 120) t->images++;
+
+    if (i % 20 == 0 && hvc_get_threshold_values_r(dev, &thresholds) == HVC_OK && thresholds.body == t->threshold)
+    {
+      t->settings++;
+    }
+  }
+
+  return NULL;
+}
+
+int main(void)
+{
+  static struct test_device devices[TEST_DEVICES];
+  pthread_t threads[TEST_DEVICES];
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+
+  for (int i = 0; i < TEST_DEVICES; i++)
+  {
+    struct test_device* t = &devices[i];
+    struct hvc_sim_config config;
+
+    hvc_sim_default_config(&config);
+    config.bodies = t->bodies = 3 + i * 10;
+    config.compute_delay_ms = 1 + i;
+    config.seed = i + 1;
+    t->threshold = 600 + i * 100;
+
+    // Line noise on the last sensor only
+    if (i == TEST_DEVICES - 1)
+    {
+      config.fault_rate = 100;
+      config.fault_mask = HVC_SIM_FAULT_NOISE;
+    }
+
+    hvc_test_link_start(&t->link, &config);
+    hvc_image_ring_sink_init(&t->sink, &t->ring, t->ring_buffer, sizeof(t->ring_buffer));
+    hvc_set_image_sink(&t->link.dev, &t->sink);
+  }
+
+  for (int i = 0; i < TEST_DEVICES; i++) pthread_create(&threads[i], NULL, test_device_run, &devices[i]);
+
+  for (int i = 0; i < TEST_DEVICES; i++)
+  {
+    struct test_device* t = &devices[i];
+    struct hvc_metrics* metrics = hvc_get_metrics(&t->link.dev);
+
+    pthread_join(threads[i], NULL);
+
+    printf("device %d: executions %d/%d, images %d/%d, settings %d/%d, resyncs %u\n", i, t->executions, TEST_FRAMES,
+      t->images, TEST_FRAMES / 10, t->settings, TEST_FRAMES / 20, metrics->resyncs);
+
+    HVC_TEST_CHECK(t->executions == TEST_FRAMES);
+    HVC_TEST_CHECK(t->images == TEST_FRAMES / 10);
+    HVC_TEST_CHECK(t->ring.frames == TEST_FRAMES / 10);
+    HVC_TEST_CHECK(t->settings == TEST_FRAMES / 20);
+
+    // Noise was only injected on the last link
+    HVC_TEST_CHECK(i == TEST_DEVICES - 1 ? metrics->resyncs > 0 : metrics->resyncs == 0);
+
+    hvc_test_link_stop(&t->link);
+  }
+
+  return hvc_test_result("test_multi");
+}
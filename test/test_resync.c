@@ -0,0 +1,247 @@
+/**
+ * Resynchronisation fuzz test. A second thread injects random bytes,
+ * sync codes included, into the link at random times while the simulator
+ * adds its own faults, so garbage lands before, inside and after
+ * responses. Commands may fail while that goes on but nothing may hang,
+ * and once injection stops every command must succeed again, through the
+ * blocking API and the async engine alike.
+ *
+ *   test_resync [-n commands] [-r fault rate per mille]
+ */
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include "hvc_async.h"
+#include "hvc_test.h"
+
+#define TEST_FUNCTION (HVC_EX_BODY_DETECTION | HVC_EX_HAND_DETECTION | HVC_EX_FACE_DETECTION)
+#define TEST_CLEAN    50
+
+struct test_injector
+{
+  pthread_t thread;
+  int fd;
+  unsigned seed;
+  volatile bool running;
+  long injected;
+};
+
+static void* test_inject(void* arg)
+{
+  struct test_injector* injector = (struct test_injector*) arg;
+
+  while (injector->running)
+  {
+    char data[8];
+    int length = 1 + rand_r(&injector->seed) % sizeof(data);
+
+    usleep(1000 + rand_r(&injector->seed) % 20000);
+
+    // Every fourth byte a sync code, they are the hard ones to skip
+    for (int i = 0; i < length; i++)
+    {
+      data[i] = rand_r(&injector->seed) % 4 == 0 ? HVC_SYNC_CODE : rand_r(&injector->seed) % 256;
+    }
+
+    if (send(injector->fd, data, length, MSG_NOSIGNAL) == length) injector->injected += length;
+  }
+
+  return NULL;
+}
+
+static void test_inject_start(struct test_injector* injector, struct hvc_test_link* link, unsigned seed)
+{
+  injector->fd = link->sim.fd;
+  injector->seed = seed;
+  injector->running = true;
+  injector->injected = 0;
+
+  pthread_create(&injector->thread, NULL, test_inject, injector);
+}
+
+static void test_inject_stop(struct test_injector* injector, struct hvc_test_link* link)
+{
+  injector->running = false;
+  pthread_join(injector->thread, NULL);
+
+  link->sim.config.fault_rate = 0;
+}
+
+static bool test_execution_valid(const struct hvc_execution_response* res, const struct hvc_sim_config* config)
+{
+  return res->body_count == config->bodies && res->hand_count == config->hands && res->face_count == config->faces;
+}
+
+/*
+ * Blocking API, executions mixed with getters
+ */
+static int test_blocking(struct hvc_test_link* link, const struct hvc_sim_config* config, int commands)
+{
+  struct hvc_device* dev = &link->dev;
+  static struct hvc_execution_response res;
+  struct hvc_get_version_response version;
+  struct hvc_get_threshold_values_response thresholds;
+  int ok = 0;
+
+  for (int i = 0; i < commands; i++)
+  {
+    int status;
+
+    switch (i % 3)
+    {
+      case 0:
+        status = hvc_execution_r(dev, TEST_FUNCTION, HVC_EX_IMAGE_NONE, &res);
+        if (status == HVC_OK && !test_execution_valid(&res, config)) status = HVC_ERR_PAYLOAD;
+        break;
+
+      case 1:
+        status = hvc_get_version_r(dev, &version);
+        if (status == HVC_OK && memcmp(version.model, "B5T-007001", 10) != 0) status = HVC_ERR_PAYLOAD;
+        break;
+
+      default:
+        status = hvc_get_threshold_values_r(dev, &thresholds);
+        if (status == HVC_OK && thresholds.body != link->sim.thresholds[0]) status = HVC_ERR_PAYLOAD;
+        break;
+    }
+
+    if (status == HVC_OK) ok++;
+  }
+
+  return ok;
+}
+
+struct test_async
+{
+  const struct hvc_sim_config* config;
+  bool busy;
+  int ok;
+};
+
+static void test_async_done(struct hvc_async* async, int status, void* ctx)
+{
+  struct test_async* t = (struct test_async*) ctx;
+  static struct hvc_execution_response res;
+
+  t->busy = false;
+
+  if (status != HVC_OK) return;
+
+  if (hvc_parse_execution(async->payload, async->payload_length, async->function, &res) == HVC_OK &&
+    test_execution_valid(&res, t->config))
+  {
+    t->ok++;
+  }
+}
+
+/*
+ * Async engine, driven the way an event loop would drive it
+ */
+static int test_async(struct hvc_test_link* link, const struct hvc_sim_config* config, int commands)
+{
+  static struct hvc_async async;
+  struct test_async t = { .config = config };
+  int64_t last = hvc_test_now_us();
+
+  hvc_async_init(&async, &link->dev);
+
+  for (int submitted = 0; submitted < commands || t.busy;)
+  {
+    if (!t.busy)
+    {
+      t.busy = hvc_async_execute(&async, TEST_FUNCTION, HVC_EX_IMAGE_NONE, test_async_done, &t) == HVC_OK;
+      submitted++;
+    }
+
+    hvc_wait_bytes_available(&link->dev, 1, 2);
+    hvc_async_poll(&async);
+
+    int64_t now = hvc_test_now_us();
+
+    hvc_async_tick(&async, (int) ((now - last) / 1000));
+    last += (now - last) / 1000 * 1000;
+  }
+
+  return t.ok;
+}
+
+int main(int argc, char** argv)
+{
+  static struct hvc_test_link link;
+  struct test_injector injector;
+  struct hvc_sim_config config;
+  int commands = 600;
+  int fault_rate = 100;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "n:r:")) != -1)
+  {
+    switch (opt)
+    {
+      case 'n': commands = atoi(optarg); break;
+      case 'r': fault_rate = atoi(optarg); break;
+      default:
+        fprintf(stderr, "usage: %s [-n commands] [-r fault rate]\n", argv[0]);
+        return 2;
+    }
+  }
+
+  hvc_posix_set_log_level(HVC_LOG_LEVEL_NONE);
+  hvc_sim_default_config(&config);
+  config.bodies = 2;
+  config.hands = 1;
+  config.faces = 1;
+  config.compute_delay_ms = 2;
+  config.fault_rate = fault_rate;
+  config.fault_mask = HVC_SIM_FAULT_NOISE | HVC_SIM_FAULT_SYNC | HVC_SIM_FAULT_RESPONSE | HVC_SIM_FAULT_TRUNCATE |
+    HVC_SIM_FAULT_SILENT;
+
+  hvc_test_link_start(&link, &config);
+
+  // Faults cost a timeout, don't retry on top of it
+  hvc_set_retry(&link.dev, 0);
+
+  struct hvc_metrics* metrics = hvc_get_metrics(&link.dev);
+
+  // Blocking API under fire, then clean
+  test_inject_start(&injector, &link, 7);
+
+  int ok = test_blocking(&link, &config, commands);
+
+  test_inject_stop(&injector, &link);
+
+  int clean = test_blocking(&link, &config, TEST_CLEAN);
+  uint32_t resyncs = metrics->resyncs;
+
+  printf("blocking: %d/%d ok while injecting %ld bytes with %d faults, %u resyncs, clean after %d/%d\n", ok, commands,
+    injector.injected, link.sim.faults, resyncs, clean, TEST_CLEAN);
+
+  HVC_TEST_CHECK(ok > 0);
+  HVC_TEST_CHECK(resyncs > 0);
+  HVC_TEST_CHECK(clean == TEST_CLEAN);
+
+  // The async engine, same again
+  link.sim.config.fault_rate = fault_rate;
+  link.sim.faults = 0;
+  test_inject_start(&injector, &link, 11);
+
+  ok = test_async(&link, &config, commands);
+
+  test_inject_stop(&injector, &link);
+
+  clean = test_async(&link, &config, TEST_CLEAN);
+
+  printf("async: %d/%d ok while injecting %ld bytes with %d faults, %u resyncs, clean after %d/%d\n", ok, commands,
+    injector.injected, link.sim.faults, metrics->resyncs - resyncs, clean, TEST_CLEAN);
+
+  HVC_TEST_CHECK(ok > 0);
+  HVC_TEST_CHECK(metrics->resyncs > resyncs);
+  HVC_TEST_CHECK(clean == TEST_CLEAN);
+
+  hvc_test_link_stop(&link);
+
+  return hvc_test_result("test_resync");
+}